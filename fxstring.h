@@ -10,23 +10,672 @@
 #include <stdexcept>        // For std::out_of_range, ...
 #include <cassert>          // For assert
 #include <cstddef>          // For std::ptrdiff_t
-#include <cstdio>           // For printf, ...
+#include <cstdio>           // For std::vsnprintf, ...
 #include <cstdarg>          // For va_list, va_start, va_end etc.
+#include <cwchar>           // For std::vswprintf
 #include <iterator>         // For std::iterator_traits
 #include <type_traits>      // For std::enable_if
+#include <cstdint>          // For std::uint64_t
+
+#if !defined(FXSTRING_NO_SIMD) && \
+    (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define FXSTRING_SSE2
+    #include <emmintrin.h>  // For SSE2 intrinsics
+#endif
+
+// Instrumentation counters (fxstring_stats.h), compiled in only if FXSTRING_STATS is defined
+#ifdef FXSTRING_STATS
+    #include "fxstring_stats.h"
+    #define FXSTRING_STATS_COUNT(op, buf_size, scanned_bytes, moved_bytes, truncated) \
+        khmz::detail::_stats_count(khmz::fxstring_stats_op::op, (buf_size), (scanned_bytes), (moved_bytes), (truncated))
+#else
+    #define FXSTRING_STATS_COUNT(op, buf_size, scanned_bytes, moved_bytes, truncated) ((void)0)
+#endif
 
 namespace khmz
 {
     using size_t = std::size_t;
 
-    namespace detail
-    {
-        template <typename T_VALUE>
-        inline T_VALUE _min(T_VALUE value1, T_VALUE value2)
+    namespace detail
+    {
+        template <typename T_VALUE>
+        inline T_VALUE _min(T_VALUE value1, T_VALUE value2)
+        {
+            return (value1 < value2) ? value1 : value2;
+        }
+
+        template <typename T>
+        struct is_string_class_likely
+        {
+            typedef char yes;
+            typedef short no;
+
+            template <typename U>
+            static auto test(const U *p) ->
+                decltype(std::declval<U>().data(), std::declval<U>().size(), yes());
+
+            template <typename>
+            static auto test(...) -> no;
+
+            static constexpr bool value = sizeof(decltype(test<T>(nullptr))) == sizeof(yes);
+        };
+
+        //
+        // A lazily evaluated string such as a concatenation (fxstring_concat.h).
+        // It has size(), write(dest, max_size), which writes at most max_size
+        // characters without the terminator and returns their count, and
+        // overlaps(first, last), which tells whether it reads [first, last).
+        //
+        template <typename T>
+        struct is_string_expression
+        {
+            typedef char yes;
+            typedef short no;
+
+            template <typename U>
+            static auto test(const U *p) -> decltype(typename U::string_expression_tag(), yes());
+
+            template <typename>
+            static auto test(...) -> no;
+
+            static constexpr bool value = sizeof(decltype(test<T>(nullptr))) == sizeof(yes);
+        };
+
+        // vsnprintf for char and wchar_t. vswprintf returns -1 when truncated.
+        inline int _vsnprintf(char *dest, size_t size, const char *format, va_list va)
+        {
+            return std::vsnprintf(dest, size, format, va);
+        }
+        inline int _vsnprintf(wchar_t *dest, size_t size, const wchar_t *format, va_list va)
+        {
+            return std::vswprintf(dest, size, format, va);
+        }
+
+        // The hash value of std::hash<khmz::fxstring>
+        template <typename T_CHAR>
+        inline size_t _hash(size_t max_size, const T_CHAR *str, size_t len)
+        {
+            size_t ret = max_size;
+            for (size_t i = 0; i < len; ++i)
+            {
+                ret *= 3;
+                ret ^= str[i];
+            }
+            return ret;
+        }
+
+        //
+        // Bit operations and prefetching
+        //
+        inline unsigned _ctz64(std::uint64_t bits)
+        {
+            assert(bits);
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<unsigned>(__builtin_ctzll(bits));
+#else
+            unsigned ret = 0;
+            while (!(bits & 1))
+            {
+                bits >>= 1;
+                ++ret;
+            }
+            return ret;
+#endif
+        }
+        inline unsigned _popcount64(std::uint64_t bits)
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<unsigned>(__builtin_popcountll(bits));
+#else
+            unsigned ret = 0;
+            for (; bits; bits &= bits - 1)
+                ++ret;
+            return ret;
+#endif
+        }
+        inline void _prefetch(const void *ptr)
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            __builtin_prefetch(ptr);
+#elif defined(FXSTRING_SSE2)
+            _mm_prefetch(static_cast<const char *>(ptr), _MM_HINT_T0);
+#else
+            (void)ptr;
+#endif
+        }
+
+        // The length of str without a trailing incomplete UTF-8 sequence
+        template <typename T_CHAR>
+        inline size_t _utf_complete_length(const T_CHAR *str, size_t len,
+                                           std::integral_constant<size_t, 1>)
+        {
+            for (size_t k = 1; k <= 4 && k <= len; ++k)
+            {
+                const unsigned char ch = static_cast<unsigned char>(str[len - k]);
+                if ((ch & 0xC0) == 0x80)
+                    continue;
+                size_t needed;
+                if ((ch & 0xE0) == 0xC0)
+                    needed = 2;
+                else if ((ch & 0xF0) == 0xE0)
+                    needed = 3;
+                else if ((ch & 0xF8) == 0xF0)
+                    needed = 4;
+                else
+                    needed = 1;
+                return (k < needed) ? len - k : len;
+            }
+            return len;
+        }
+        // The length of str without a trailing high surrogate
+        template <typename T_CHAR>
+        inline size_t _utf_complete_length(const T_CHAR *str, size_t len,
+                                           std::integral_constant<size_t, 2>)
+        {
+            if (!len)
+                return len;
+            const unsigned ch = static_cast<unsigned>(str[len - 1]);
+            return (0xD800 <= ch && ch <= 0xDBFF) ? len - 1 : len;
+        }
+        template <typename T_CHAR>
+        inline size_t _utf_complete_length(const T_CHAR *, size_t len,
+                                           std::integral_constant<size_t, 4>)
+        {
+            return len;
+        }
+    }
+
+    //
+    // Tag to truncate on code point boundaries (UTF-8 and UTF-16)
+    //
+    struct utf_truncate_t
+    {
+    };
+    constexpr utf_truncate_t utf_truncate = utf_truncate_t();
+
+    //
+    // Non-owning view of a character sequence
+    //
+    template <typename T_CHAR, typename T_CHAR_TRAITS = std::char_traits<T_CHAR>>
+    class fxstring_view
+    {
+    public:
+        using self_type = fxstring_view<T_CHAR, T_CHAR_TRAITS>;
+        using value_type = T_CHAR;
+        using size_type = size_t;
+        using const_reference = const value_type&;
+        using const_pointer = const value_type *;
+        using const_iterator = const value_type *;
+        using traits_type = T_CHAR_TRAITS;
+
+        static constexpr size_type npos = -1;
+
+        fxstring_view() : m_data(nullptr), m_size(0)
+        {
+        }
+        fxstring_view(const value_type *str) : m_data(str), m_size(traits_type::length(str))
+        {
+        }
+        fxstring_view(const value_type *str, size_type count) : m_data(str), m_size(count)
+        {
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<khmz::detail::is_string_class_likely<T_STRING>::value>::type>
+        fxstring_view(const T_STRING& str) : m_data(str.data()), m_size(str.size())
+        {
+        }
+
+        bool empty() const { return !m_size; }
+        size_type size() const { return m_size; }
+        size_type length() const { return m_size; }
+        const_pointer data() const { return m_data; }
+        const_reference operator[](size_type index) const
+        {
+            assert(index < m_size);
+            return m_data[index];
+        }
+        const_reference front() const { return m_data[0]; }
+        const_reference back() const { return m_data[m_size - 1]; }
+        const_iterator begin() const { return m_data; }
+        const_iterator end() const { return m_data + m_size; }
+
+        void remove_prefix(size_type count)
+        {
+            assert(count <= m_size);
+            m_data += count;
+            m_size -= count;
+        }
+        void remove_suffix(size_type count)
+        {
+            assert(count <= m_size);
+            m_size -= count;
+        }
+        self_type substr(size_type pos = 0, size_type count = npos) const
+        {
+            if (pos > m_size)
+            {
+                assert(0);
+                throw std::out_of_range("khmz::fxstring_view::substr");
+            }
+            return self_type(m_data + pos, khmz::detail::_min(count, m_size - pos));
+        }
+
+        int compare(self_type str) const
+        {
+            int cmp = traits_type::compare(m_data, str.m_data, khmz::detail::_min(m_size, str.m_size));
+            if (cmp)
+                return cmp;
+            if (m_size < str.m_size)
+                return -1;
+            if (m_size > str.m_size)
+                return +1;
+            return 0;
+        }
+        bool starts_with(self_type str) const
+        {
+            return m_size >= str.m_size && traits_type::compare(m_data, str.m_data, str.m_size) == 0;
+        }
+        bool ends_with(self_type str) const
+        {
+            return m_size >= str.m_size &&
+                   traits_type::compare(m_data + m_size - str.m_size, str.m_data, str.m_size) == 0;
+        }
+        size_type find(value_type ch, size_type pos = 0) const
+        {
+            if (pos >= m_size)
+                return npos;
+            const value_type *found = traits_type::find(m_data + pos, m_size - pos, ch);
+            return found ? found - m_data : npos;
+        }
+        size_type find(self_type str, size_type pos = 0) const
+        {
+            if (pos > m_size || str.m_size > m_size - pos)
+                return npos;
+            if (!str.m_size)
+                return pos;
+            // The first character is located with traits_type::find, then the rest compared
+            const value_type *last = m_data + m_size - str.m_size;
+            for (const value_type *ptr = m_data + pos; ptr <= last; ++ptr)
+            {
+                ptr = traits_type::find(ptr, last - ptr + 1, str.m_data[0]);
+                if (!ptr)
+                    return npos;
+                if (traits_type::compare(ptr + 1, str.m_data + 1, str.m_size - 1) == 0)
+                    return ptr - m_data;
+            }
+            return npos;
+        }
+        size_type rfind(value_type ch, size_type pos = npos) const
+        {
+            if (!m_size)
+                return npos;
+            for (size_type ich = khmz::detail::_min(pos, m_size - 1); ich != npos; --ich)
+            {
+                if (traits_type::eq(m_data[ich], ch))
+                    return ich;
+            }
+            return npos;
+        }
+        size_type rfind(self_type str, size_type pos = npos) const
+        {
+            if (str.m_size > m_size)
+                return npos;
+            for (size_type ich = khmz::detail::_min(pos, m_size - str.m_size); ich != npos; --ich)
+            {
+                if (traits_type::compare(m_data + ich, str.m_data, str.m_size) == 0)
+                    return ich;
+            }
+            return npos;
+        }
+        size_type find_first_of(self_type set, size_type pos = 0) const
+        {
+            for (size_type ich = pos; ich < m_size; ++ich)
+            {
+                if (traits_type::find(set.m_data, set.m_size, m_data[ich]))
+                    return ich;
+            }
+            return npos;
+        }
+        size_type find_first_not_of(self_type set, size_type pos = 0) const
+        {
+            for (size_type ich = pos; ich < m_size; ++ich)
+            {
+                if (!traits_type::find(set.m_data, set.m_size, m_data[ich]))
+                    return ich;
+            }
+            return npos;
+        }
+        size_type find_last_of(self_type set, size_type pos = npos) const
+        {
+            if (!m_size)
+                return npos;
+            for (size_type ich = khmz::detail::_min(pos, m_size - 1); ich != npos; --ich)
+            {
+                if (traits_type::find(set.m_data, set.m_size, m_data[ich]))
+                    return ich;
+            }
+            return npos;
+        }
+        size_type find_last_not_of(self_type set, size_type pos = npos) const
+        {
+            if (!m_size)
+                return npos;
+            for (size_type ich = khmz::detail::_min(pos, m_size - 1); ich != npos; --ich)
+            {
+                if (!traits_type::find(set.m_data, set.m_size, m_data[ich]))
+                    return ich;
+            }
+            return npos;
+        }
+
+        friend bool operator==(self_type str1, self_type str2)
+        {
+            return str1.m_size == str2.m_size && str1.compare(str2) == 0;
+        }
+        friend bool operator!=(self_type str1, self_type str2)
+        {
+            return !(str1 == str2);
+        }
+        friend bool operator<(self_type str1, self_type str2)
+        {
+            return str1.compare(str2) < 0;
+        }
+
+    protected:
+        const value_type *m_data;
+        size_type m_size;
+    }; // fxstring_view
+
+    template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+    class fxstring;
+
+    //
+    // A mutable reference to an fxstring of any capacity: its buffer and
+    // buf_size(). Every fxstring<T_CHAR, N> converts to it, so a function
+    // that takes an fxstring_ref is not a template and works on all
+    // capacities. The modifying members of fxstring forward here, so their
+    // code exists once per character type rather than once per capacity.
+    //
+    template <typename T_CHAR, typename T_CHAR_TRAITS = std::char_traits<T_CHAR>>
+    class fxstring_ref
+    {
+    public:
+        using self_type = fxstring_ref<T_CHAR, T_CHAR_TRAITS>;
+        using value_type = T_CHAR;
+        using size_type = size_t;
+        using reference = value_type&;
+        using pointer = value_type *;
+        using const_pointer = const value_type *;
+        using traits_type = T_CHAR_TRAITS;
+        using view_type = fxstring_view<T_CHAR, T_CHAR_TRAITS>;
+
+        static constexpr size_type npos = -1;
+
+        fxstring_ref(pointer data, size_type buf_size) : m_data(data), m_buf_size(buf_size)
+        {
+            assert(buf_size > 0);
+        }
+        template <size_t t_buf_size>
+        fxstring_ref(fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str) : m_data(str.data()), m_buf_size(t_buf_size)
+        {
+        }
+
+        //
+        // Basic information
+        //
+        bool empty() const { return !m_data[0]; }
+        size_type size() const
+        {
+            const size_type len = _length();
+            FXSTRING_STATS_COUNT(size, m_buf_size, (len + 1) * sizeof(T_CHAR), 0, false);
+            assert(len < m_buf_size);
+            return len;
+        }
+        size_type length() const { return size(); }
+        size_type max_size() const { return m_buf_size - 1; }
+        size_type buf_size() const { return m_buf_size; }
+        pointer data() const { return m_data; }
+        const_pointer c_str() const { return m_data; }
+        view_type view() const { return view_type(m_data, size()); }
+        reference operator[](size_type index) const
+        {
+            assert(index <= max_size());
+            return m_data[index];
+        }
+        pointer begin() const { return m_data; }
+        pointer end() const { return m_data + size(); }
+        void clear() { m_data[0] = 0; }
+
+        //
+        // Modifiers. They truncate to max_size() like those of fxstring.
+        //
+        self_type& assign(size_type count, value_type ch)
+        {
+            FXSTRING_STATS_COUNT(assign, m_buf_size, 0, 0, count > max_size());
+            count = detail::_min(count, max_size());
+            traits_type::assign(m_data, count, ch);
+            m_data[count] = 0;
+            return *this;
+        }
+        self_type& assign(const value_type *str, size_type count)
+        {
+            FXSTRING_STATS_COUNT(assign, m_buf_size, 0, 0, count > max_size());
+            count = detail::_min(count, max_size());
+            traits_type::move(m_data, str, count);
+            m_data[count] = 0;
+            return *this;
+        }
+        self_type& assign(view_type str)
+        {
+            return assign(str.data(), str.size());
+        }
+        self_type& assign(utf_truncate_t, const value_type *str, size_type count)
+        {
+            assign(str, count);
+            if (count > max_size())
+                _utf_trim();
+            return *this;
+        }
+
+        self_type& append(const value_type *str, size_type count)
+        {
+            _append(size(), str, count);
+            return *this;
+        }
+        self_type& append(view_type str)
+        {
+            return append(str.data(), str.size());
+        }
+        self_type& append(size_type count, value_type ch)
+        {
+            const size_type len = size();
+            FXSTRING_STATS_COUNT(append, m_buf_size, 0, 0, count > max_size() - len);
+            count = detail::_min(count, max_size() - len);
+            traits_type::assign(m_data + len, count, ch);
+            m_data[len + count] = 0;
+            return *this;
+        }
+        self_type& append(utf_truncate_t, const value_type *str, size_type count)
+        {
+            const size_type len = size();
+            _append(len, str, count);
+            if (len + count > max_size())
+                _utf_trim();
+            return *this;
+        }
+        self_type& operator+=(view_type str)
+        {
+            return append(str);
+        }
+        self_type& operator+=(value_type ch)
+        {
+            return append(&ch, 1);
+        }
+        void push_back(value_type ch)
+        {
+            append(&ch, 1);
+        }
+        void pop_back()
+        {
+            const size_type len = size();
+            if (len > 0)
+                m_data[len - 1] = 0;
+        }
+
+        self_type& insert(size_type index, const value_type *str, size_type count)
+        {
+            index = _insert_prologue(index, count);
+            traits_type::copy(m_data + index, str, count);
+            return *this;
+        }
+        self_type& insert(size_type index, view_type str)
+        {
+            return insert(index, str.data(), str.size());
+        }
+        self_type& insert(size_type index, size_type count, value_type ch)
+        {
+            index = _insert_prologue(index, count);
+            traits_type::assign(m_data + index, count, ch);
+            return *this;
+        }
+        self_type& insert(utf_truncate_t, size_type index, const value_type *str, size_type count)
+        {
+            const bool truncated = size() + count > max_size();
+            insert(index, str, count);
+            if (truncated)
+                _utf_trim();
+            return *this;
+        }
+
+        self_type& erase(size_type index = 0)
+        {
+            FXSTRING_STATS_COUNT(erase, m_buf_size, 0, 0, false);
+            m_data[detail::_min(index, max_size())] = 0;
+            return *this;
+        }
+        self_type& erase(size_type index, size_type count)
+        {
+            const size_type len = size();
+            if (index >= len || count == 0)
+            {
+                FXSTRING_STATS_COUNT(erase, m_buf_size, 0, 0, false);
+                return *this;
+            }
+            count = detail::_min(count, len - index);
+            FXSTRING_STATS_COUNT(erase, m_buf_size, 0, (len - (index + count)) * sizeof(T_CHAR), false);
+            traits_type::move(m_data + index, m_data + index + count, len - (index + count));
+            m_data[len - count] = 0;
+            return *this;
+        }
+
+        // Replaces count characters at index with str
+        self_type& replace(size_type index, size_type count, const value_type *str, size_type str_len)
+        {
+            FXSTRING_STATS_COUNT(replace, m_buf_size, 0, 0, index + str_len > max_size());
+            if (count > str_len)
+            {
+                erase(index, count - str_len);
+            }
+            else if (count < str_len)
+            {
+                size_type diff_len = str_len - count;
+                _insert_prologue(index, diff_len);
+            }
+
+            index = detail::_min(index, max_size());
+            traits_type::copy(m_data + index, str, detail::_min(str_len, max_size() - index));
+            return *this;
+        }
+        self_type& replace(size_type index, size_type count, view_type str)
         {
-            return (value1 < value2) ? value1 : value2;
+            return replace(index, count, str.data(), str.size());
+        }
+
+        void resize(size_type count, value_type ch = value_type())
+        {
+            FXSTRING_STATS_COUNT(resize, m_buf_size, 0, 0, count > max_size());
+            count = detail::_min(count, max_size());
+            const size_type old_len = size();
+            if (old_len < count)
+                traits_type::assign(m_data + old_len, count - old_len, ch);
+            m_data[count] = 0;
+        }
+
+        // Printf. The result is truncated to max_size().
+        int printf(const value_type *format, ...)
+        {
+            va_list va;
+            va_start(va, format);
+            int len = vprintf(format, va);
+            va_end(va);
+            return len;
+        }
+        int vprintf(const value_type *format, va_list va)
+        {
+            int ret = detail::_vsnprintf(m_data, m_buf_size, format, va);
+            m_data[max_size()] = 0;
+            FXSTRING_STATS_COUNT(format, m_buf_size, 0, 0, ret < 0 || static_cast<size_type>(ret) > max_size());
+            return ret;
+        }
+
+        int compare(view_type str) const
+        {
+            return view().compare(str);
+        }
+
+    protected:
+        pointer m_data;
+        size_type m_buf_size;
+
+        // The length, without counting the scan
+        size_type _length() const
+        {
+            size_type ich;
+            for (ich = 0; ich < m_buf_size && m_data[ich]; ++ich)
+                ;
+            return ich;
+        }
+
+        void _append(size_type len, const value_type *str, size_type count)
+        {
+            FXSTRING_STATS_COUNT(append, m_buf_size, 0, 0, count > max_size() - len);
+            count = detail::_min(count, max_size() - len);
+            traits_type::copy(m_data + len, str, count);
+            m_data[len + count] = 0;
+        }
+
+        // Opens count characters at index, clipped to max_size()
+        size_type _insert_prologue(size_type index, size_type& count)
+        {
+            index = detail::_min(index, max_size());
+
+            const size_type end_index = index + count;
+            FXSTRING_STATS_COUNT(insert, m_buf_size, 0,
+                                 (end_index < max_size() ? max_size() - end_index : 0) * sizeof(T_CHAR),
+                                 _length() + count > max_size());
+            if (end_index < max_size())
+            {
+                const size_type move_count = max_size() - end_index;
+                traits_type::move(m_data + end_index, m_data + index, move_count);
+                m_data[end_index + move_count] = 0;
+            }
+            else
+            {
+                m_data[max_size()] = 0;
+            }
+
+            if (index + count > max_size())
+                count = max_size() - index;
+
+            return index;
         }
-    }
+
+        void _utf_trim()
+        {
+            m_data[detail::_utf_complete_length(m_data, max_size(),
+                std::integral_constant<size_t, sizeof(T_CHAR)>())] = 0;
+        }
+    }; // fxstring_ref
 
     template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS = std::char_traits<T_CHAR>>
     class fxstring
@@ -48,6 +697,8 @@ namespace khmz
         using values_type = value_type[t_buf_size];
         using iterator_category = std::random_access_iterator_tag;
         using traits_type = T_CHAR_TRAITS;
+        using view_type = fxstring_view<T_CHAR, T_CHAR_TRAITS>;
+        using ref_type = fxstring_ref<T_CHAR, T_CHAR_TRAITS>;
 
         //
         // Iterators
@@ -424,19 +1075,12 @@ namespace khmz
         values_type m_values;
 
         template <typename T>
-        struct is_string_class_likely
+        struct is_string_class_likely : khmz::detail::is_string_class_likely<T>
+        {
+        };
+        template <typename T>
+        struct is_string_expression : khmz::detail::is_string_expression<T>
         {
-            typedef char yes;
-            typedef short no;
-
-            template <typename U>
-            static auto test(const U *p) ->
-                decltype(std::declval<U>().data(), std::declval<U>().size(), yes());
-
-            template <typename>
-            static auto test(...) -> no;
-
-            static constexpr bool value = sizeof(decltype(test<T>(nullptr))) == sizeof(yes);
         };
 
         size_type _length(const T_CHAR *str) const
@@ -447,29 +1091,6 @@ namespace khmz
             return ich;
         }
 
-        size_type _insert_prologue(size_type index, size_type& count)
-        {
-            if (index > max_size())
-                index = max_size();
-
-            const size_type end_index = index + count;
-            if (end_index < max_size())
-            {
-                const size_type move_count = max_size() - end_index;
-                traits_type::move(&m_values[index + count], &m_values[index], move_count);
-                m_values[index + count + move_count] = 0;
-            }
-            else
-            {
-                m_values[max_size()] = 0;
-            }
-
-            if (index + count > max_size())
-                count = max_size() - index;
-
-            return index;
-        }
-
     public:
         static constexpr size_type npos = -1;
         static_assert(npos > 0, "npos must be positive.");
@@ -481,13 +1102,17 @@ namespace khmz
         size_type size() const
         {
             assert(is_terminated());
-            return _length(data());
+            const size_type len = _length(data());
+            FXSTRING_STATS_COUNT(size, t_buf_size, (len + 1) * sizeof(T_CHAR), 0, false);
+            return len;
         }
         size_type length() const { return size(); }
         size_type max_size() const { return t_buf_size - 1; }
         size_type buf_size() const { return t_buf_size; }
         pointer data() { return m_values; }
         const_pointer data() const { return m_values; }
+        view_type view() const { return view_type(data(), size()); }
+        ref_type ref() { return ref_type(m_values, t_buf_size); }
         void clear() { m_values[0] = 0; }
         const_pointer c_str() const
         {
@@ -581,6 +1206,13 @@ namespace khmz
         {
             assign(str, pos, count);
         }
+        template <typename T_EXPRESSION,
+                  typename = typename std::enable_if<is_string_expression<T_EXPRESSION>::value>::type,
+                  typename = void>
+        fxstring(const T_EXPRESSION& expr)
+        {
+            m_values[expr.write(data(), max_size())] = 0;
+        }
         fxstring(const value_type *str)
         {
             assign(str);
@@ -598,6 +1230,16 @@ namespace khmz
         {
             assign(init.begin(), init.end());
         }
+        fxstring(utf_truncate_t, const value_type *str)
+        {
+            assign(utf_truncate, str);
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
+        fxstring(utf_truncate_t, const T_STRING& str)
+        {
+            assign(utf_truncate, str.data(), str.size());
+        }
 
         //
         // Assignments
@@ -609,6 +1251,13 @@ namespace khmz
             assign(str);
             return *this;
         }
+        template <typename T_EXPRESSION,
+                  typename = typename std::enable_if<is_string_expression<T_EXPRESSION>::value>::type,
+                  typename = void>
+        self_type& operator=(const T_EXPRESSION& expr)
+        {
+            return assign(expr);
+        }
         self_type& operator=(const value_type *str)
         {
             return assign(str);
@@ -623,10 +1272,7 @@ namespace khmz
         }
         self_type& assign(size_type count, value_type ch)
         {
-            if (count > max_size())
-                count = max_size();
-            traits_type::assign(data(), count, ch);
-            m_values[count] = 0;
+            ref().assign(count, ch);
             return *this;
         }
         self_type& assign(const value_type *str)
@@ -635,19 +1281,12 @@ namespace khmz
         }
         self_type& assign(const value_type *str, size_type count)
         {
-            if (count > max_size())
-                count = max_size();
-            traits_type::copy(data(), str, count);
-            m_values[count] = 0;
+            ref().assign(str, count);
             return *this;
         }
         self_type& assign(const value_type *str, size_type pos, size_type count)
         {
-            if (count > max_size())
-                count = max_size();
-            traits_type::copy(data(), &str[pos], count);
-            m_values[count] = 0;
-            return *this;
+            return assign(str + pos, count);
         }
         template <typename InputIterator>
         self_type& assign(InputIterator first, InputIterator last)
@@ -664,6 +1303,17 @@ namespace khmz
         {
             return assign(init.begin(), init.end());
         }
+        template <typename T_EXPRESSION,
+                  typename = typename std::enable_if<is_string_expression<T_EXPRESSION>::value>::type,
+                  typename = void>
+        self_type& assign(const T_EXPRESSION& expr)
+        {
+            // The expression may read this string, as in str = "x" + str
+            if (expr.overlaps(data(), data() + t_buf_size))
+                return *this = self_type(expr);
+            m_values[expr.write(data(), max_size())] = 0;
+            return *this;
+        }
         template <typename T_STRING,
                   typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
         self_type& assign(const T_STRING& str, size_type pos = 0, size_type count = npos)
@@ -673,13 +1323,23 @@ namespace khmz
                 assert(0);
                 throw std::out_of_range("khmz::fxstring::assign");
             }
-            count = khmz::detail::_min(count, str.size() - pos);
-            if (count > max_size())
-                count = max_size();
-            traits_type::copy(data(), &str[pos], count);
-            m_values[count] = 0;
+            return assign(str.data() + pos, khmz::detail::_min(count, str.size() - pos));
+        }
+        self_type& assign(utf_truncate_t, const value_type *str)
+        {
+            return assign(utf_truncate, str, traits_type::length(str));
+        }
+        self_type& assign(utf_truncate_t, const value_type *str, size_type count)
+        {
+            ref().assign(utf_truncate, str, count);
             return *this;
         }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
+        self_type& assign(utf_truncate_t, const T_STRING& str)
+        {
+            return assign(utf_truncate, str.data(), str.size());
+        }
 
         //
         // Front and back
@@ -704,17 +1364,11 @@ namespace khmz
         }
         void push_back(value_type ch)
         {
-            size_type len = size();
-            if (len + 1 >= max_size())
-                return;
-            traits_type::assign(m_values[len++], ch);
-            m_values[len] = 0;
+            ref().push_back(ch);
         }
         void pop_back()
         {
-            size_type len = size();
-            if (len > 0)
-                m_values[len - 1] = 0;
+            ref().pop_back();
         }
 
         //
@@ -722,7 +1376,8 @@ namespace khmz
         //
         self_type& append(size_type count, value_type ch)
         {
-            return insert(end(), count, ch);
+            ref().append(count, ch);
+            return *this;
         }
         self_type& append(const value_type *str)
         {
@@ -730,11 +1385,7 @@ namespace khmz
         }
         self_type& append(const value_type *str, size_type count)
         {
-            size_type len = size();
-            if (len + count > max_size())
-                count = max_size() - len;
-            traits_type::copy(&m_values[len], str, count);
-            m_values[len + count] = 0;
+            ref().append(str, count);
             return *this;
         }
         self_type& append(value_type ch)
@@ -754,12 +1405,23 @@ namespace khmz
             for (i = size(); i < max_size() && first != last; ++i)
                 traits_type::assign(m_values[i], *first++);
             m_values[i] = 0;
+            return *this;
         }
         self_type& append(std::initializer_list<value_type> init)
         {
             self_type str(init);
             return append(str);
         }
+        template <typename T_EXPRESSION,
+                  typename = typename std::enable_if<is_string_expression<T_EXPRESSION>::value>::type,
+                  typename = void>
+        self_type& append(const T_EXPRESSION& expr)
+        {
+            // Only the characters before len can be read, so they are not overwritten
+            const size_type len = size();
+            m_values[len + expr.write(data() + len, max_size() - len)] = 0;
+            return *this;
+        }
         template <typename T_STRING,
                   typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
         self_type& append(const T_STRING& str, size_type pos)
@@ -784,6 +1446,13 @@ namespace khmz
         {
             return append(str);
         }
+        template <typename T_EXPRESSION,
+                  typename = typename std::enable_if<is_string_expression<T_EXPRESSION>::value>::type,
+                  typename = void>
+        self_type& operator+=(const T_EXPRESSION& expr)
+        {
+            return append(expr);
+        }
         self_type& operator+=(value_type ch)
         {
             return append(ch);
@@ -796,6 +1465,21 @@ namespace khmz
         {
             return append(init);
         }
+        self_type& append(utf_truncate_t, const value_type *str)
+        {
+            return append(utf_truncate, str, traits_type::length(str));
+        }
+        self_type& append(utf_truncate_t, const value_type *str, size_type count)
+        {
+            ref().append(utf_truncate, str, count);
+            return *this;
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
+        self_type& append(utf_truncate_t, const T_STRING& str)
+        {
+            return append(utf_truncate, str.data(), str.size());
+        }
 
         //
         // Comparison
@@ -804,20 +1488,11 @@ namespace khmz
                   typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
         int compare(const T_STRING& str) const
         {
-            return compare(str.data());
+            return view().compare(view_type(str.data(), str.size()));
         }
         int compare(const value_type *str) const
         {
-            size_type len = traits_type::length(str);
-            size_type count = khmz::detail::_min(len, size());
-            int cmp = traits_type::compare(data(), str, count);
-            if (cmp)
-                return cmp;
-            if (traits_type::lt(m_values[count], str[count]))
-                return -1;
-            if (traits_type::lt(str[count], m_values[count]))
-                return +1;
-            return 0;
+            return view().compare(view_type(str));
         }
 
         //
@@ -839,16 +1514,16 @@ namespace khmz
         //
         size_type copy(value_type *dest, size_type count, size_type pos = 0)
         {
-            if (pos > max_size())
+            const size_type len = size();
+            if (pos > len)
             {
                 assert(0);
                 throw std::out_of_range("khmz::fxstring::copy");
             }
 
-            if (count == npos)
-                count = size() - pos;
-
+            count = khmz::detail::_min(count, len - pos);
             traits_type::copy(dest, &m_values[pos], count);
+            return count;
         }
 
         //
@@ -856,21 +1531,7 @@ namespace khmz
         //
         void resize(size_type count, value_type ch = value_type())
         {
-            if (count > max_size())
-                count = max_size();
-
-            size_type old_len = size();
-            if (old_len == count)
-                return;
-
-            if (count < old_len)
-            {
-                m_values[count] = 0;
-                return;
-            }
-
-            traits_type::assign(&m_values[old_len], count - old_len, ch);
-            m_values[count] = 0;
+            ref().resize(count, ch);
         }
 
         //
@@ -883,20 +1544,12 @@ namespace khmz
         }
         self_type& erase(size_type index)
         {
-            if (index > max_size())
-                index = max_size();
-            m_values[index] = 0;
+            ref().erase(index);
             return *this;
         }
         self_type& erase(size_type index, size_type count)
         {
-            const size_type len = size();
-            if (index >= len || count == 0)
-                return *this;
-            count = khmz::detail::_min(count, len - index);
-            size_type remaining_count = len - (index + count);
-            traits_type::move(&m_values[index], &m_values[index + count], remaining_count);
-            m_values[len - count] = 0;
+            ref().erase(index, count);
             return *this;
         }
         iterator erase(const_iterator position)
@@ -911,212 +1564,93 @@ namespace khmz
         }
 
         //
-        // find(ch, ...) / rfind(ch, ...)
+        // Search, shared with fxstring_view
         //
         size_type find(value_type ch, size_type pos = 0) const
         {
-            return find_first_of(ch, pos);
+            return view().find(ch, pos);
         }
         size_type rfind(value_type ch, size_type pos = npos) const
         {
-            return find_last_of(ch, pos);
+            return view().rfind(ch, pos);
         }
-
-        //
-        // find(str, ...) / rfind(str, ...)
-        //
         size_type find(const value_type *str, size_type pos = 0) const
         {
-            assert(is_terminated());
-            assert(pos <= size());
-            if (!*str)
-                return pos;
-            size_type count = traits_type::length(&m_values[pos]);
-            size_type str_len = traits_type::length(str);
-            const T_CHAR *found;
-            for (const T_CHAR* ptr = &m_values[pos];; ptr = found + 1)
-            {
-                found = traits_type::find(ptr, count, *str);
-                if (!found)
-                    return npos;
-                if (traits_type::compare(found, str, str_len) == 0)
-                    return found - data();
-                count -= found - ptr;
-            }
+            return view().find(view_type(str), pos);
         }
         template <typename T_STRING,
                   typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
         size_type find(const T_STRING& str, size_type pos = 0) const
         {
-            return find(str.data(), pos);
+            return view().find(view_type(str.data(), str.size()), pos);
         }
         size_type rfind(const value_type *str, size_type pos = npos) const
         {
-            assert(is_terminated());
-            size_type str_len = traits_type::length(str);
-            if (pos == npos)
-            {
-                if (size() < str_len)
-                    return npos;
-                pos = size() - str_len;
-            }
-            while (pos != npos)
-            {
-                if (traits_type::compare(&m_values[pos], str, str_len) == 0)
-                    return pos;
-                --pos;
-            }
-            return pos;
+            return view().rfind(view_type(str), pos);
         }
         template <typename T_STRING,
                   typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
         size_type rfind(const T_STRING& str, size_type pos = 0) const
         {
-            return rfind(str.data(), pos);
+            return view().rfind(view_type(str.data(), str.size()), pos);
         }
 
-        //
-        // find_*_of(ch, ...)
-        //
         size_type find_first_of(value_type ch, size_type pos = 0) const
         {
-            assert(is_terminated());
-            if (pos >= size())
-                return npos;
-            for (size_type ich = pos; m_values[ich]; ++ich)
-            {
-                if (traits_type::eq(m_values[ich], ch))
-                    return ich;
-            }
-            return npos;
+            return view().find(ch, pos);
         }
         size_type find_first_not_of(value_type ch, size_type pos = 0) const
         {
-            assert(is_terminated());
-            if (pos >= size())
-                return npos;
-            for (size_type ich = pos; m_values[ich]; ++ich)
-            {
-                if (!traits_type::eq(m_values[ich], ch))
-                    return ich;
-            }
-            return npos;
+            return view().find_first_not_of(view_type(&ch, 1), pos);
         }
         size_type find_last_of(value_type ch, size_type pos = npos) const
         {
-            assert(is_terminated());
-            if (empty())
-                return npos;
-            if (pos == npos)
-                pos = size() - 1;
-            while (pos != npos)
-            {
-                if (traits_type::eq(m_values[pos], ch))
-                    return pos;
-                --pos;
-            }
-            return pos;
+            return view().rfind(ch, pos);
         }
         size_type find_last_not_of(value_type ch, size_type pos = npos) const
         {
-            assert(is_terminated());
-            if (empty())
-                return npos;
-            if (pos == npos)
-                pos = size() - 1;
-            while (pos != npos)
-            {
-                if (!traits_type::eq(m_values[pos], ch))
-                    return pos;
-                --pos;
-            }
-            return pos;
+            return view().find_last_not_of(view_type(&ch, 1), pos);
         }
 
-        //
-        // find_*_of(str, ...)
-        //
         size_type find_first_of(const value_type *str, size_type pos = 0) const
         {
-            assert(is_terminated());
-            if (pos >= size())
-                return npos;
-            const size_type str_len = traits_type::length(str);
-            for (size_type ich = pos; m_values[ich]; ++ich)
-            {
-                if (traits_type::find(str, str_len, m_values[ich]) != nullptr)
-                    return ich;
-            }
-            return npos;
+            return view().find_first_of(view_type(str), pos);
         }
         template <typename T_STRING,
                   typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
         size_type find_first_of(const T_STRING& str, size_type pos = 0) const
         {
-            return find_first_of(str.data(), pos);
+            return view().find_first_of(view_type(str.data(), str.size()), pos);
         }
         size_type find_first_not_of(const value_type *str, size_type pos = 0) const
         {
-            assert(is_terminated());
-            if (pos >= size())
-                return npos;
-            const size_type str_len = traits_type::length(str);
-            for (size_type ich = pos; m_values[ich]; ++ich)
-            {
-                if (traits_type::find(str, str_len, m_values[ich]) == nullptr)
-                    return ich;
-            }
-            return npos;
+            return view().find_first_not_of(view_type(str), pos);
         }
         template <typename T_STRING,
                   typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
         size_type find_first_not_of(const T_STRING& str, size_type pos = 0) const
         {
-            return find_first_not_of(str.data(), pos);
+            return view().find_first_not_of(view_type(str.data(), str.size()), pos);
         }
         size_type find_last_of(const value_type *str, size_type pos = npos) const
         {
-            assert(is_terminated());
-            if (empty())
-                return npos;
-            if (pos == npos)
-                pos = size() - 1;
-            const size_type str_len = traits_type::length(str);
-            while (pos != npos)
-            {
-                if (traits_type::find(str, str_len, m_values[pos]) != nullptr)
-                    break;
-                --pos;
-            }
-            return pos;
+            return view().find_last_of(view_type(str), pos);
         }
         template <typename T_STRING,
                   typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
         size_type find_last_of(const T_STRING& str, size_type pos = npos) const
         {
-            return find_last_of(str.data(), pos);
+            return view().find_last_of(view_type(str.data(), str.size()), pos);
         }
         size_type find_last_not_of(const value_type *str, size_type pos = npos) const
         {
-            assert(is_terminated());
-            if (empty())
-                return npos;
-            if (pos == npos)
-                pos = size() - 1;
-            const size_type str_len = traits_type::length(str);
-            while (pos != npos)
-            {
-                if (traits_type::find(str, str_len, m_values[pos]) == nullptr)
-                    break;
-                --pos;
-            }
-            return pos;
+            return view().find_last_not_of(view_type(str), pos);
         }
         template <typename T_STRING,
                   typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
         size_type find_last_not_of(const T_STRING& str, size_type pos = npos) const
         {
-            return find_last_not_of(str.data(), pos);
+            return view().find_last_not_of(view_type(str.data(), str.size()), pos);
         }
 
         //
@@ -1128,14 +1662,12 @@ namespace khmz
         }
         self_type& insert(size_type index, const value_type* str, size_type count)
         {
-            index = _insert_prologue(index, count);
-            traits_type::copy(&m_values[index], str, count);
+            ref().insert(index, str, count);
             return *this;
         }
         self_type& insert(size_type index, size_type count, value_type ch)
         {
-            index = _insert_prologue(index, count);
-            traits_type::assign(&m_values[index], count, ch);
+            ref().insert(index, count, ch);
             return *this;
         }
         template <typename T_STRING,
@@ -1155,9 +1687,8 @@ namespace khmz
         template <typename InputIterator>
         self_type& insert(const_iterator pos, InputIterator first, InputIterator last)
         {
-            size_type index = std::distance(cbegin(), pos);
-            size_type count = std::distance(first, last);
-            index = _insert_prologue(index, count);
+            size_type index = khmz::detail::_min<size_type>(std::distance(cbegin(), pos), max_size());
+            ref().insert(index, std::distance(first, last), value_type());
             while (index < max_size() && first != last)
                 traits_type::assign(m_values[index++], *first++);
             return *this;
@@ -1166,28 +1697,28 @@ namespace khmz
         {
             return insert(pos, init.begin(), init.end());
         }
+        self_type& insert(utf_truncate_t, size_type index, const value_type* str)
+        {
+            return insert(utf_truncate, index, str, traits_type::length(str));
+        }
+        self_type& insert(utf_truncate_t, size_type index, const value_type* str, size_type count)
+        {
+            ref().insert(utf_truncate, index, str, count);
+            return *this;
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
+        self_type& insert(utf_truncate_t, size_type index, const T_STRING& str)
+        {
+            return insert(utf_truncate, index, str.data(), str.size());
+        }
 
         //
         // Replace
         //
         self_type& replace(size_type index, size_type count, const value_type* str)
         {
-            size_type str_len = traits_type::length(str);
-
-            if (count > str_len)
-            {
-                erase(index, count - str_len);
-            }
-            else if (count < str_len)
-            {
-                size_type diff_len = str_len - count;
-                _insert_prologue(index, diff_len);
-            }
-
-            if (index + count > max_size())
-                count = max_size() - index;
-
-            traits_type::copy(&m_values[index], str, str_len);
+            ref().replace(index, count, str, traits_type::length(str));
             return *this;
         }
         self_type& replace(const_iterator first, const_iterator last, const value_type* str)
@@ -1198,17 +1729,19 @@ namespace khmz
                   typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
         self_type& replace(size_type index, size_type count, const T_STRING& str)
         {
-            return replace(index, count, str.data());
+            ref().replace(index, count, str.data(), str.size());
+            return *this;
         }
         template <typename T_STRING,
                   typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
         self_type& replace(const_iterator first, const_iterator last, const T_STRING& str)
         {
-            return replace(first, last, str.data());
+            return replace(first - cbegin(), last - first, str);
         }
 
         //
-        // Printf
+        // Printf. The result is truncated to max_size(). Returns what
+        // std::vsnprintf or std::vswprintf returns.
         //
         int printf(const T_CHAR *format, ...)
         {
@@ -1220,7 +1753,7 @@ namespace khmz
         }
         template <typename T_STRING,
                   typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
-        int printf(const T_STRING& format, ...)
+        int printf(T_STRING format, ...)
         {
             va_list va;
             va_start(va, format);
@@ -1228,13 +1761,9 @@ namespace khmz
             va_end(va);
             return len;
         }
-        int vprintf(const char *format, va_list va)
+        int vprintf(const value_type *format, va_list va)
         {
-            return _snprintf(data(), t_buf_size, format, va);
-        }
-        int vprintf(const wchar_t *format, va_list va)
-        {
-            return _snwprintf(data(), t_buf_size, format, va);
+            return ref().vprintf(format, va);
         }
 
         //
@@ -1254,6 +1783,18 @@ namespace khmz
     template <size_t t_buf_size>
     using fxstring_w = fxstring<wchar_t, t_buf_size>;
 
+    template <size_t t_buf_size>
+    using fxstring_u16 = fxstring<char16_t, t_buf_size>;
+
+    template <size_t t_buf_size>
+    using fxstring_u32 = fxstring<char32_t, t_buf_size>;
+
+    using fxstring_view_a = fxstring_view<char>;
+    using fxstring_view_w = fxstring_view<wchar_t>;
+
+    using fxstring_ref_a = fxstring_ref<char>;
+    using fxstring_ref_w = fxstring_ref<wchar_t>;
+
 #ifdef _UNICODE
     #define fxstring_t fxstring_w
 #else
@@ -1450,13 +1991,7 @@ namespace std
     {
         inline size_t operator()(const khmz::fxstring<T_CHAR, t_buf_size>& str) const
         {
-            size_t ret = str.max_size();
-            for (auto ch : str)
-            {
-                ret *= 3;
-                ret ^= ch;
-            }
-            return ret;
+            return khmz::detail::_hash(str.max_size(), str.data(), str.size());
         }
     };
 } // namespace std
@@ -0,0 +1,230 @@
+// fxstring_arena.h --- memory resources for strings that outgrow a fixed buffer
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include <cstdint>          // For std::uintptr_t
+#include <new>              // For operator new
+
+namespace khmz
+{
+    //
+    // Where variable-capacity strings get their storage. The interface of
+    // std::pmr::memory_resource, which C++11 lacks.
+    //
+    class fxstring_memory_resource
+    {
+    public:
+        virtual ~fxstring_memory_resource()
+        {
+        }
+
+        virtual void *allocate(size_t bytes, size_t alignment) = 0;
+        virtual void deallocate(void *p, size_t bytes, size_t alignment) = 0;
+        // Grows the allocation p in place if possible
+        virtual bool extend(void *p, size_t bytes, size_t new_bytes)
+        {
+            (void)p;
+            (void)bytes;
+            (void)new_bytes;
+            return false;
+        }
+    };
+
+    // operator new and delete
+    class fxstring_heap_resource : public fxstring_memory_resource
+    {
+    public:
+        void *allocate(size_t bytes, size_t) override
+        {
+            return ::operator new(bytes);
+        }
+        void deallocate(void *p, size_t, size_t) override
+        {
+            ::operator delete(p);
+        }
+    };
+
+    inline fxstring_memory_resource *fxstring_heap()
+    {
+        static fxstring_heap_resource s_heap;
+        return &s_heap;
+    }
+
+    //
+    // A monotonic arena. Allocation bumps a pointer; deallocation does
+    // nothing, and reset() releases everything at once. It starts with an
+    // optional caller-supplied buffer and then takes blocks from the
+    // upstream resource, each twice the previous one. The last allocation
+    // can be extended in place. Not thread-safe.
+    //
+    // For per-request strings (arena_fxstring in fxstring_hybrid.h), reset()
+    // the arena after each request, or let an fxstring_arena_scope rewind it
+    // to where the request started.
+    //
+    class fxstring_arena : public fxstring_memory_resource
+    {
+    public:
+        using size_type = size_t;
+
+        explicit fxstring_arena(size_type block_size = 4096, fxstring_memory_resource *upstream = fxstring_heap())
+            : m_upstream(upstream), m_initial(nullptr), m_initial_size(0), m_block_size(block_size),
+              m_next_block_size(block_size), m_blocks(nullptr), m_ptr(nullptr), m_end(nullptr), m_used(0)
+        {
+            assert(block_size);
+        }
+        fxstring_arena(void *buffer, size_type size, size_type block_size = 4096,
+                       fxstring_memory_resource *upstream = fxstring_heap())
+            : m_upstream(upstream), m_initial(static_cast<char *>(buffer)), m_initial_size(size),
+              m_block_size(block_size), m_next_block_size(block_size), m_blocks(nullptr),
+              m_ptr(m_initial), m_end(m_initial + size), m_used(0)
+        {
+            assert(block_size);
+        }
+        ~fxstring_arena()
+        {
+            _release();
+        }
+        fxstring_arena(const fxstring_arena&) = delete;
+        fxstring_arena& operator=(const fxstring_arena&) = delete;
+
+        void *allocate(size_type bytes, size_type alignment) override
+        {
+            char *p = _align(m_ptr, alignment);
+            if (!m_ptr || p > m_end || bytes > static_cast<size_type>(m_end - p))
+            {
+                _grow(bytes + alignment);
+                p = _align(m_ptr, alignment);
+            }
+            m_ptr = p + bytes;
+            m_used += bytes;
+            return p;
+        }
+        void deallocate(void *, size_type, size_type) override
+        {
+        }
+        bool extend(void *p, size_type bytes, size_type new_bytes) override
+        {
+            if (static_cast<char *>(p) + bytes != m_ptr || new_bytes - bytes > static_cast<size_type>(m_end - m_ptr))
+                return false;
+            m_ptr += new_bytes - bytes;
+            m_used += new_bytes - bytes;
+            return true;
+        }
+
+        // Releases all allocations and the blocks, and starts over at the buffer
+        void reset()
+        {
+            _release();
+            m_next_block_size = m_block_size;
+            m_ptr = m_initial;
+            m_end = m_initial + m_initial_size;
+            m_used = 0;
+        }
+
+        // The bytes allocated since construction or reset()
+        size_type used() const { return m_used; }
+
+    protected:
+        struct block_header
+        {
+            block_header *next;
+            size_type size;
+        };
+
+    public:
+        // A position to rewind to
+        struct marker
+        {
+            block_header *block;
+            char *ptr;
+            char *end;
+            size_type used;
+        };
+
+        marker mark() const
+        {
+            const marker ret = { m_blocks, m_ptr, m_end, m_used };
+            return ret;
+        }
+        // Releases the allocations made after mark, and the blocks they took
+        void rewind(const marker& mark)
+        {
+            while (m_blocks != mark.block)
+            {
+                block_header *next = m_blocks->next;
+                m_upstream->deallocate(m_blocks, m_blocks->size, alignof(block_header));
+                m_blocks = next;
+            }
+            m_ptr = mark.ptr;
+            m_end = mark.end;
+            m_used = mark.used;
+        }
+
+    protected:
+        fxstring_memory_resource *m_upstream;
+        char *m_initial;
+        size_type m_initial_size;
+        size_type m_block_size;
+        size_type m_next_block_size;
+        block_header *m_blocks;
+        char *m_ptr;
+        char *m_end;
+        size_type m_used;
+
+        static char *_align(char *p, size_type alignment)
+        {
+            const std::uintptr_t value = reinterpret_cast<std::uintptr_t>(p);
+            return p + ((alignment - value % alignment) % alignment);
+        }
+
+        void _grow(size_type min_size)
+        {
+            size_type size = m_next_block_size;
+            while (size < min_size + sizeof(block_header))
+                size *= 2;
+            m_next_block_size = size * 2;
+            block_header *block = static_cast<block_header *>(m_upstream->allocate(size, alignof(block_header)));
+            block->next = m_blocks;
+            block->size = size;
+            m_blocks = block;
+            m_ptr = reinterpret_cast<char *>(block + 1);
+            m_end = reinterpret_cast<char *>(block) + size;
+        }
+
+        void _release()
+        {
+            while (m_blocks)
+            {
+                block_header *next = m_blocks->next;
+                m_upstream->deallocate(m_blocks, m_blocks->size, alignof(block_header));
+                m_blocks = next;
+            }
+        }
+    }; // fxstring_arena
+
+    //
+    // Rewinds an arena on destruction to where it was on construction, so
+    // that per-request strings go away with the request.
+    //
+    class fxstring_arena_scope
+    {
+    public:
+        explicit fxstring_arena_scope(fxstring_arena& arena) : m_arena(arena), m_mark(arena.mark())
+        {
+        }
+        ~fxstring_arena_scope()
+        {
+            m_arena.rewind(m_mark);
+        }
+        fxstring_arena_scope(const fxstring_arena_scope&) = delete;
+        fxstring_arena_scope& operator=(const fxstring_arena_scope&) = delete;
+
+        fxstring_arena& arena() const { return m_arena; }
+
+    protected:
+        fxstring_arena& m_arena;
+        fxstring_arena::marker m_mark;
+    };
+} // namespace khmz
@@ -0,0 +1,333 @@
+// fxstring_atomic.h --- atomically published fxstrings
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include "fxstring_queue.h"
+#include <atomic>           // For std::atomic
+#include <cstdint>          // For std::uint64_t
+#include <cstring>          // For std::memcpy
+#include <thread>           // For std::this_thread::yield
+
+// Define FXSTRING_ATOMIC_CAS16 to use a 16-byte compare-and-swap for strings of 9 to 16 bytes.
+// GCC and Clang need -mcx16 for it on x86-64; without one, the seqlock is used.
+#if defined(FXSTRING_ATOMIC_CAS16) && \
+    (defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16) || (defined(_MSC_VER) && defined(_M_X64)))
+    #define FXSTRING_CAS16
+    #ifdef _MSC_VER
+        #include <intrin.h> // For _InterlockedCompareExchange128
+    #endif
+#endif
+
+namespace khmz
+{
+    namespace detail
+    {
+        // Busy waiting: pauses at first, then yields
+        inline void _spin_wait(unsigned& spins)
+        {
+            if (++spins < 64)
+            {
+#ifdef FXSTRING_SSE2
+                _mm_pause();
+#endif
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        //
+        // Storages of t_words 64-bit words. Each provides load, store and
+        // compare_exchange on whole word arrays; compare_exchange stores
+        // the current words into expected on failure.
+        //
+
+        //
+        // Seqlock. The writers take the lock by making the sequence odd; the
+        // readers copy the words and retry if the sequence changed meanwhile,
+        // so they never write shared memory. The words are relaxed atomics,
+        // so a reader racing a writer is well defined.
+        //
+        template <size_t t_words>
+        class _seqlock_storage
+        {
+        public:
+            static constexpr bool is_always_lock_free = false;
+
+            _seqlock_storage() : m_sequence(0)
+            {
+                for (size_t i = 0; i < t_words; ++i)
+                    m_words[i].store(0, std::memory_order_relaxed);
+            }
+
+            void load(std::uint64_t *words) const
+            {
+                for (unsigned spins = 0; ; _spin_wait(spins))
+                {
+                    const size_t sequence = m_sequence.load(std::memory_order_acquire);
+                    if (sequence & 1)
+                        continue;
+                    for (size_t i = 0; i < t_words; ++i)
+                        words[i] = m_words[i].load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (m_sequence.load(std::memory_order_relaxed) == sequence)
+                        return;
+                }
+            }
+            void store(const std::uint64_t *words)
+            {
+                const size_t sequence = _lock();
+                for (size_t i = 0; i < t_words; ++i)
+                    m_words[i].store(words[i], std::memory_order_relaxed);
+                m_sequence.store(sequence + 2, std::memory_order_release);
+            }
+            bool compare_exchange(std::uint64_t *expected, const std::uint64_t *desired)
+            {
+                const size_t sequence = _lock();
+                bool ret = true;
+                for (size_t i = 0; i < t_words && ret; ++i)
+                    ret = (m_words[i].load(std::memory_order_relaxed) == expected[i]);
+                for (size_t i = 0; i < t_words; ++i)
+                {
+                    if (ret)
+                        m_words[i].store(desired[i], std::memory_order_relaxed);
+                    else
+                        expected[i] = m_words[i].load(std::memory_order_relaxed);
+                }
+                m_sequence.store(sequence + 2, std::memory_order_release);
+                return ret;
+            }
+
+        protected:
+            alignas(_cache_line_size) std::atomic<size_t> m_sequence;
+            std::atomic<std::uint64_t> m_words[t_words];
+
+            // Returns the even sequence before locking
+            size_t _lock()
+            {
+                for (unsigned spins = 0; ; _spin_wait(spins))
+                {
+                    size_t sequence = m_sequence.load(std::memory_order_relaxed);
+                    if (!(sequence & 1) &&
+                        m_sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire,
+                                                         std::memory_order_relaxed))
+                    {
+                        // Orders the odd sequence before the stores of the words
+                        std::atomic_thread_fence(std::memory_order_release);
+                        return sequence;
+                    }
+                }
+            }
+        };
+
+        // One word, lock-free
+        class _word_storage
+        {
+        public:
+            static constexpr bool is_always_lock_free = (ATOMIC_LLONG_LOCK_FREE == 2);
+
+            _word_storage() : m_word(0)
+            {
+            }
+
+            void load(std::uint64_t *words) const
+            {
+                words[0] = m_word.load(std::memory_order_acquire);
+            }
+            void store(const std::uint64_t *words)
+            {
+                m_word.store(words[0], std::memory_order_release);
+            }
+            bool compare_exchange(std::uint64_t *expected, const std::uint64_t *desired)
+            {
+                return m_word.compare_exchange_strong(expected[0], desired[0], std::memory_order_acq_rel,
+                                                      std::memory_order_acquire);
+            }
+
+        protected:
+            alignas(_cache_line_size) std::atomic<std::uint64_t> m_word;
+        };
+
+#ifdef FXSTRING_CAS16
+        // Compares and swaps 16 bytes; stores the current words into expected on failure
+        inline bool _cas128(std::uint64_t *dest, std::uint64_t *expected, const std::uint64_t *desired)
+        {
+#ifdef _MSC_VER
+            return _InterlockedCompareExchange128(reinterpret_cast<volatile long long *>(dest),
+                                                  static_cast<long long>(desired[1]),
+                                                  static_cast<long long>(desired[0]),
+                                                  reinterpret_cast<long long *>(expected)) != 0;
+#else
+            unsigned __int128 old_value, new_value;
+            std::memcpy(&old_value, expected, 16);
+            std::memcpy(&new_value, desired, 16);
+            const unsigned __int128 value =
+                __sync_val_compare_and_swap(reinterpret_cast<unsigned __int128 *>(dest), old_value, new_value);
+            if (value == old_value)
+                return true;
+            std::memcpy(expected, &value, 16);
+            return false;
+#endif
+        }
+
+        //
+        // Two words, lock-free with a 16-byte compare-and-swap. Loads are
+        // compare-and-swaps too, so readers write the cache line and contend
+        // with each other: with many readers, they are several times slower
+        // than the seqlock. Hence opt-in, for compare_exchange-heavy use.
+        //
+        class _double_word_storage
+        {
+        public:
+            static constexpr bool is_always_lock_free = true;
+
+            _double_word_storage()
+            {
+                m_words[0] = m_words[1] = 0;
+            }
+
+            void load(std::uint64_t *words) const
+            {
+                // Replaces zero with zero, or fails and reads the words
+                words[0] = words[1] = 0;
+                _cas128(m_words, words, words);
+            }
+            void store(const std::uint64_t *words)
+            {
+                std::uint64_t expected[2] = { 0, 0 };
+                while (!_cas128(m_words, expected, words))
+                    ;
+            }
+            bool compare_exchange(std::uint64_t *expected, const std::uint64_t *desired)
+            {
+                return _cas128(m_words, expected, desired);
+            }
+
+        protected:
+            // Mutable, as loads compare and swap
+            alignas(_cache_line_size) mutable std::uint64_t m_words[2];
+        };
+#endif  // def FXSTRING_CAS16
+
+        template <size_t t_words>
+        struct _atomic_storage
+        {
+            using type = _seqlock_storage<t_words>;
+        };
+        template <>
+        struct _atomic_storage<1>
+        {
+            using type = _word_storage;
+        };
+#ifdef FXSTRING_CAS16
+        template <>
+        struct _atomic_storage<2>
+        {
+            using type = _double_word_storage;
+        };
+#endif
+    } // namespace detail
+
+    //
+    // An fxstring that one thread can publish while others read it, without
+    // a mutex. Strings of up to 8 bytes (with the terminator) are a single
+    // atomic word, which is lock-free. Larger strings are protected by a
+    // seqlock: loads never write shared memory, never block writers or each
+    // other, and retry while a store is in progress; stores and
+    // compare_exchange take the writer lock.
+    //
+    // With FXSTRING_ATOMIC_CAS16 defined, strings of up to 16 bytes use a
+    // 16-byte compare-and-swap instead, where the target has one, making
+    // compare_exchange lock-free at the cost of loads that write the cache
+    // line. is_always_lock_free tells which is in use.
+    //
+    // The characters after the terminator are always zero, so
+    // compare_exchange compares the strings by their words.
+    //
+    template <typename T_CHAR, size_t t_buf_size>
+    class atomic_fxstring
+    {
+    public:
+        using value_type = fxstring<T_CHAR, t_buf_size>;
+        using size_type = size_t;
+
+    protected:
+        static constexpr size_type s_bytes = t_buf_size * sizeof(T_CHAR);
+        static constexpr size_type s_words = (s_bytes + 7) / 8;
+        using storage_type = typename detail::_atomic_storage<s_words>::type;
+
+    public:
+        static constexpr bool is_always_lock_free = storage_type::is_always_lock_free;
+
+        atomic_fxstring()
+        {
+        }
+        atomic_fxstring(const value_type& str)
+        {
+            store(str);
+        }
+        atomic_fxstring(const atomic_fxstring&) = delete;
+        atomic_fxstring& operator=(const atomic_fxstring&) = delete;
+
+        bool is_lock_free() const { return is_always_lock_free; }
+
+        value_type load() const
+        {
+            std::uint64_t words[s_words];
+            m_storage.load(words);
+            value_type ret;
+            std::memcpy(ret.data(), words, s_bytes);
+            return ret;
+        }
+        void store(const value_type& str)
+        {
+            std::uint64_t words[s_words];
+            _to_words(words, str);
+            m_storage.store(words);
+        }
+
+        //
+        // Replaces the string with desired if it equals expected. Otherwise
+        // expected is set to the current string. Returns whether replaced.
+        //
+        bool compare_exchange(value_type& expected, const value_type& desired)
+        {
+            std::uint64_t expected_words[s_words], desired_words[s_words];
+            _to_words(expected_words, expected);
+            _to_words(desired_words, desired);
+            if (m_storage.compare_exchange(expected_words, desired_words))
+                return true;
+            std::memcpy(expected.data(), expected_words, s_bytes);
+            return false;
+        }
+
+        operator value_type() const { return load(); }
+        atomic_fxstring& operator=(const value_type& str)
+        {
+            store(str);
+            return *this;
+        }
+
+    protected:
+        storage_type m_storage;
+
+        // The characters up to the terminator, then zeros
+        static void _to_words(std::uint64_t *words, const value_type& str)
+        {
+            std::memset(words, 0, s_words * 8);
+            const T_CHAR *data = str.data();
+            size_type len = 0;
+            while (len < str.max_size() && data[len])
+                ++len;
+            std::memcpy(words, data, len * sizeof(T_CHAR));
+        }
+    }; // atomic_fxstring
+
+    template <size_t t_buf_size>
+    using atomic_fxstring_a = atomic_fxstring<char, t_buf_size>;
+    template <size_t t_buf_size>
+    using atomic_fxstring_w = atomic_fxstring<wchar_t, t_buf_size>;
+} // namespace khmz
@@ -0,0 +1,351 @@
+// fxstring_batch.h --- batch operations over arrays of fxstrings
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include <cstdint>          // For std::uint64_t
+
+namespace khmz
+{
+    //
+    // Predicates for select() and select_indexes()
+    //
+    template <typename T_CHAR>
+    struct fxstring_predicate
+    {
+        enum op_type
+        {
+            equal, not_equal, starts_with, less, less_equal, greater, greater_equal
+        };
+
+        op_type op;
+        fxstring_view<T_CHAR> key;
+    };
+
+    namespace pred
+    {
+#define FXSTRING_DEFINE_PREDICATE(name) \
+        template <typename T_CHAR> \
+        inline fxstring_predicate<T_CHAR> name(const T_CHAR *key) \
+        { \
+            fxstring_predicate<T_CHAR> ret = { fxstring_predicate<T_CHAR>::name, key }; \
+            return ret; \
+        } \
+        template <typename T_STRING, \
+                  typename = typename std::enable_if<detail::is_string_class_likely<T_STRING>::value>::type> \
+        inline fxstring_predicate<typename T_STRING::value_type> name(const T_STRING& key) \
+        { \
+            fxstring_predicate<typename T_STRING::value_type> ret = \
+                { fxstring_predicate<typename T_STRING::value_type>::name, key }; \
+            return ret; \
+        }
+
+        FXSTRING_DEFINE_PREDICATE(equal)
+        FXSTRING_DEFINE_PREDICATE(not_equal)
+        FXSTRING_DEFINE_PREDICATE(starts_with)
+        FXSTRING_DEFINE_PREDICATE(less)
+        FXSTRING_DEFINE_PREDICATE(less_equal)
+        FXSTRING_DEFINE_PREDICATE(greater)
+        FXSTRING_DEFINE_PREDICATE(greater_equal)
+#undef FXSTRING_DEFINE_PREDICATE
+    } // namespace pred
+
+    namespace detail
+    {
+        // The length of str, at most max_len
+        template <typename T_CHAR>
+        inline size_t _bounded_length(const T_CHAR *str, size_t max_len)
+        {
+            size_t i = 0;
+            while (i < max_len && str[i])
+                ++i;
+            return i;
+        }
+#ifdef FXSTRING_SSE2
+        inline size_t _bounded_length(const char *str, size_t max_len)
+        {
+            size_t i = 0;
+            const __m128i zero = _mm_setzero_si128();
+            for (; i + 16 <= max_len; i += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(str + i));
+                const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)));
+                if (mask)
+                    return i + _ctz64(mask);
+            }
+            while (i < max_len && str[i])
+                ++i;
+            return i;
+        }
+#endif
+
+        //
+        // Four interleaved hash chains of detail::_hash. The chains are
+        // independent, so the CPU overlaps their multiply-xor latencies.
+        //
+        template <typename T_CHAR, typename T_OUT>
+        inline void _hash_lanes4(size_t seed, const T_CHAR *const str[4], const size_t len[4], T_OUT *out)
+        {
+            size_t h0 = seed, h1 = seed, h2 = seed, h3 = seed;
+            const size_t common = _min(_min(len[0], len[1]), _min(len[2], len[3]));
+            for (size_t j = 0; j < common; ++j)
+            {
+                h0 = (h0 * 3) ^ static_cast<size_t>(str[0][j]);
+                h1 = (h1 * 3) ^ static_cast<size_t>(str[1][j]);
+                h2 = (h2 * 3) ^ static_cast<size_t>(str[2][j]);
+                h3 = (h3 * 3) ^ static_cast<size_t>(str[3][j]);
+            }
+            size_t hashes[4] = { h0, h1, h2, h3 };
+            for (size_t k = 0; k < 4; ++k)
+            {
+                for (size_t j = common; j < len[k]; ++j)
+                    hashes[k] = (hashes[k] * 3) ^ static_cast<size_t>(str[k][j]);
+                out[k] = static_cast<T_OUT>(hashes[k]);
+            }
+        }
+
+        // The number of leading bytes where a and b are equal, at most size
+        inline size_t _common_bytes(const unsigned char *a, const unsigned char *b, size_t size)
+        {
+            size_t i = 0;
+#ifdef FXSTRING_SSE2
+            for (; i + 16 <= size; i += 16)
+            {
+                __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+                __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+                const unsigned neq = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) & 0xFFFF;
+                if (neq)
+                    return i + _ctz64(neq);
+            }
+#endif
+            while (i < size && a[i] == b[i])
+                ++i;
+            return i;
+        }
+
+        //
+        // Evaluates a predicate on rows of the fixed stride. A row is compared
+        // with the key up to and including the key's terminator, so the length
+        // of the row is never computed.
+        //
+        template <typename T_CHAR, size_t t_buf_size>
+        class _batch_matcher
+        {
+        public:
+            using value_type = fxstring<T_CHAR, t_buf_size>;
+            using predicate_type = fxstring_predicate<T_CHAR>;
+            using traits_type = typename value_type::traits_type;
+
+            static constexpr size_t s_stride = sizeof(value_type);
+            static constexpr size_t s_key_size = (s_stride < 16) ? (16 / sizeof(T_CHAR)) : t_buf_size;
+
+            explicit _batch_matcher(const predicate_type& pred) : m_op(pred.op), m_never(false)
+            {
+                static_assert(sizeof(value_type) == t_buf_size * sizeof(T_CHAR), "fxstring must have no padding");
+
+                const size_t len = pred.key.size();
+                size_t count;
+                if (m_op == predicate_type::starts_with)
+                {
+                    m_never = (len >= t_buf_size);
+                    count = m_never ? 0 : len;
+                }
+                else if (len < t_buf_size)
+                {
+                    count = len + 1;
+                }
+                else
+                {
+                    // No row can be equal to the key
+                    m_never = (m_op == predicate_type::equal || m_op == predicate_type::not_equal);
+                    count = t_buf_size;
+                }
+                traits_type::assign(m_key, s_key_size, T_CHAR());
+                traits_type::copy(m_key, pred.key.data(), khmz::detail::_min(len, count));
+                m_key_bytes = count * sizeof(T_CHAR);
+                m_key_mask = (m_key_bytes >= 32) ? ~0u : ((1u << m_key_bytes) - 1);
+
+#ifdef FXSTRING_SSE2
+                unsigned char pattern[16];
+                for (size_t i = 0; i < 16; ++i)
+                    pattern[i] = _key_byte(i % s_stride);
+                m_pattern = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pattern));
+#endif
+            }
+
+            // Bit k is set where rows[k] matches, for count <= 64 rows
+            std::uint64_t match64(const value_type *rows, size_t count) const
+            {
+                if (m_never)
+                    return (m_op == predicate_type::not_equal) ? _all_bits(count) : 0;
+
+                const unsigned char *base = reinterpret_cast<const unsigned char *>(rows);
+                std::uint64_t bits = 0;
+                size_t k = 0;
+#ifdef FXSTRING_SSE2
+                if (16 % s_stride == 0)
+                {
+                    // Several rows per vector
+                    const size_t per_vector = 16 / s_stride;
+                    for (; k + per_vector <= count; k += per_vector)
+                    {
+                        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(base + k * s_stride));
+                        const unsigned eq = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, m_pattern)));
+                        for (size_t r = 0; r < per_vector; ++r)
+                        {
+                            const unsigned neq = ~(eq >> (r * s_stride)) & m_key_mask;
+                            const size_t common = neq ? _ctz64(neq) : m_key_bytes;
+                            if (_test(rows[k + r].data(), common))
+                                bits |= std::uint64_t(1) << (k + r);
+                        }
+                    }
+                }
+                else if (m_key_bytes <= 16)
+                {
+                    // One row per vector, while 16 bytes are readable
+                    __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i *>(m_key));
+                    for (; k < count && (count - k) * s_stride >= 16; ++k)
+                    {
+                        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(base + k * s_stride));
+                        const unsigned neq = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, key))) & m_key_mask;
+                        const size_t common = neq ? _ctz64(neq) : m_key_bytes;
+                        if (_test(rows[k].data(), common))
+                            bits |= std::uint64_t(1) << k;
+                    }
+                }
+#endif
+                for (; k < count; ++k)
+                {
+                    const size_t common = _common_bytes(base + k * s_stride,
+                        reinterpret_cast<const unsigned char *>(m_key), m_key_bytes);
+                    if (_test(rows[k].data(), common))
+                        bits |= std::uint64_t(1) << k;
+                }
+                return bits;
+            }
+
+        protected:
+            typename predicate_type::op_type m_op;
+            bool m_never;
+            size_t m_key_bytes;
+            unsigned m_key_mask;
+            T_CHAR m_key[s_key_size];
+#ifdef FXSTRING_SSE2
+            __m128i m_pattern;
+#endif
+
+            unsigned char _key_byte(size_t index) const
+            {
+                return reinterpret_cast<const unsigned char *>(m_key)[index];
+            }
+
+            static std::uint64_t _all_bits(size_t count)
+            {
+                return (count >= 64) ? ~std::uint64_t(0) : ((std::uint64_t(1) << count) - 1);
+            }
+
+            // common is the number of leading bytes equal to the key
+            bool _test(const T_CHAR *row, size_t common) const
+            {
+                const bool same = (common >= m_key_bytes);
+                switch (m_op)
+                {
+                case predicate_type::equal:
+                case predicate_type::starts_with:
+                    return same;
+                case predicate_type::not_equal:
+                    return !same;
+                default:
+                    break;
+                }
+
+                bool is_less = false, is_greater = false;
+                if (!same)
+                {
+                    const size_t index = common / sizeof(T_CHAR);
+                    is_less = traits_type::lt(row[index], m_key[index]);
+                    is_greater = !is_less;
+                }
+                switch (m_op)
+                {
+                case predicate_type::less:          return is_less;
+                case predicate_type::less_equal:    return !is_greater;
+                case predicate_type::greater:       return is_greater;
+                case predicate_type::greater_equal: return !is_less;
+                default:                            return false;
+                }
+            }
+        }; // _batch_matcher
+    } // namespace detail
+
+    //
+    // Selection into a bitmap of (count + 63) / 64 words. Bit (i % 64) of
+    // word (i / 64) is set when first[i] matches. Returns the number of matches.
+    //
+    template <typename T_CHAR, size_t t_buf_size>
+    inline size_t select(const fxstring<T_CHAR, t_buf_size> *first, size_t count,
+                         const fxstring_predicate<T_CHAR>& pred, std::uint64_t *bitmap)
+    {
+        detail::_batch_matcher<T_CHAR, t_buf_size> matcher(pred);
+        size_t ret = 0;
+        for (size_t i = 0; i < count; i += 64)
+        {
+            const std::uint64_t bits = matcher.match64(&first[i], khmz::detail::_min<size_t>(64, count - i));
+            bitmap[i / 64] = bits;
+            ret += detail::_popcount64(bits);
+        }
+        return ret;
+    }
+
+    //
+    // Selection into an index vector of up to count elements.
+    // Returns the number of matches.
+    //
+    template <typename T_CHAR, size_t t_buf_size>
+    inline size_t select_indexes(const fxstring<T_CHAR, t_buf_size> *first, size_t count,
+                                 const fxstring_predicate<T_CHAR>& pred, size_t *indexes)
+    {
+        detail::_batch_matcher<T_CHAR, t_buf_size> matcher(pred);
+        size_t ret = 0;
+        for (size_t i = 0; i < count; i += 64)
+        {
+            std::uint64_t bits = matcher.match64(&first[i], khmz::detail::_min<size_t>(64, count - i));
+            while (bits)
+            {
+                indexes[ret++] = i + detail::_ctz64(bits);
+                bits &= bits - 1;
+            }
+        }
+        return ret;
+    }
+
+    //
+    // Batch hashing. out[i] receives std::hash<fxstring>()(first[i]).
+    //
+    template <typename T_CHAR, size_t t_buf_size>
+    inline void hash_batch(const fxstring<T_CHAR, t_buf_size> *first, size_t count, std::uint64_t *out)
+    {
+        const size_t seed = t_buf_size - 1;
+        const size_t prefetch_distance = 8;
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            const T_CHAR *str[4];
+            size_t len[4];
+            for (size_t k = 0; k < 4; ++k)
+            {
+                if (i + k + prefetch_distance < count)
+                    detail::_prefetch(&first[i + k + prefetch_distance]);
+                str[k] = first[i + k].data();
+                len[k] = detail::_bounded_length(str[k], t_buf_size);
+            }
+            detail::_hash_lanes4(seed, str, len, &out[i]);
+        }
+        for (; i < count; ++i)
+        {
+            const T_CHAR *str = first[i].data();
+            out[i] = detail::_hash(seed, str, detail::_bounded_length(str, t_buf_size));
+        }
+    }
+} // namespace khmz
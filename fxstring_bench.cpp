@@ -0,0 +1,612 @@
+// fxstring_bench.cpp --- benchmarks for fxstring
+// License: MIT
+
+#include "fxstring.h"
+#include "fxstring_reader.h"
+#include "fxstring_queue.h"
+#include "fxstring_atomic.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <io.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+using namespace khmz;
+
+// Results are written here, so that the compiler keeps the work that produced them
+static volatile size_t g_bench_sink;
+
+//
+// Timing
+class bench_timer
+{
+public:
+    bench_timer() : m_start(std::chrono::steady_clock::now())
+    {
+    }
+    double seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+protected:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+static void bench_report(const char *name, double seconds, double bytes, size_t items, size_t check)
+{
+    std::printf("%-32s %10.1f MB/s %12zu lines (%zx)\n",
+                name, bytes / seconds / (1024.0 * 1024.0), items, check);
+}
+
+//
+// Line reader
+//
+static int bench_open(const char *path)
+{
+#ifdef _WIN32
+    return ::_open(path, _O_RDONLY | _O_BINARY);
+#else
+    return ::open(path, O_RDONLY);
+#endif
+}
+
+static void bench_close(int fd)
+{
+#ifdef _WIN32
+    ::_close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+static double bench_file_size(const char *path)
+{
+    std::FILE *fp = std::fopen(path, "rb");
+    if (!fp)
+        return 0;
+    std::fseek(fp, 0, SEEK_END);
+    const double ret = static_cast<double>(std::ftell(fp));
+    std::fclose(fp);
+    return ret;
+}
+
+// Log-like lines of 20 to 220 characters
+static bool bench_make_lines_file(const char *path, double megabytes)
+{
+    std::FILE *fp = std::fopen(path, "wb");
+    if (!fp)
+        return false;
+    const double total = megabytes * 1024 * 1024;
+    char line[256];
+    unsigned seed = 1;
+    for (double written = 0; written < total; )
+    {
+        seed = seed * 1103515245 + 12345;
+        const int len = 20 + static_cast<int>((seed >> 16) % 200);
+        const int n = std::snprintf(line, sizeof(line), "2024-01-01 00:00:00 [%08x] ", seed);
+        for (int i = n; i < len; ++i)
+            line[i] = static_cast<char>('a' + (i * 7 + seed) % 26);
+        line[len] = '\n';
+        std::fwrite(line, 1, len + 1, fp);
+        written += len + 1;
+    }
+    return std::fclose(fp) == 0;
+}
+
+static void bench_line_reader(const char *path)
+{
+    const double bytes = bench_file_size(path);
+    std::printf("line reader: %s (%.0f MB)\n", path, bytes / (1024.0 * 1024.0));
+
+    {
+        const int fd = bench_open(path);
+        if (fd < 0)
+            return;
+        bench_timer timer;
+        fxstring_line_reader reader(fd, fxstring_line_reader::truncate, 1023);
+        fxstring_view_a line;
+        size_t count = 0, check = 0;
+        while (reader.next(line))
+        {
+            ++count;
+            check += static_cast<unsigned char>(line.empty() ? 0 : line[0]);
+        }
+        bench_report("fxstring_line_reader (view)", timer.seconds(), bytes, count, check);
+        bench_close(fd);
+    }
+    {
+        std::FILE *fp = std::fopen(path, "rb");
+        if (!fp)
+            return;
+        bench_timer timer;
+        fxstring_line_reader reader(fp);
+        fxstring_a<1024> line;
+        size_t count = 0, check = 0;
+        while (reader.next(line))
+        {
+            ++count;
+            check += static_cast<unsigned char>(line[0]);
+        }
+        bench_report("fxstring_line_reader (fxstring)", timer.seconds(), bytes, count, check);
+        std::fclose(fp);
+    }
+    {
+        std::ifstream in(path, std::ios::binary);
+        bench_timer timer;
+        std::string str;
+        fxstring_a<1024> line;
+        size_t count = 0, check = 0;
+        while (std::getline(in, str))
+        {
+            line = str;
+            ++count;
+            check += static_cast<unsigned char>(line[0]);
+        }
+        bench_report("std::getline + copy", timer.seconds(), bytes, count, check);
+    }
+}
+
+//
+// Queues
+//
+using bench_message = fxstring_a<64>;
+
+// A mutex-protected queue of std::string, for comparison
+class bench_locked_queue
+{
+public:
+    bool try_push(const bench_message& str)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(str.c_str());
+        return true;
+    }
+    bool try_pop(bench_message& str)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queue.empty())
+            return false;
+        str = m_queue.front();
+        m_queue.pop_front();
+        return true;
+    }
+    size_t try_push(const bench_message *items, size_t count)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < count; ++i)
+            m_queue.push_back(items[i].c_str());
+        return count;
+    }
+    size_t try_pop(bench_message *items, size_t count)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t i = 0;
+        for (; i < count && !m_queue.empty(); ++i)
+        {
+            items[i] = m_queue.front();
+            m_queue.pop_front();
+        }
+        return i;
+    }
+
+protected:
+    std::mutex m_mutex;
+    std::deque<std::string> m_queue;
+};
+
+template <typename T_QUEUE>
+static void bench_queue_throughput(const char *name, T_QUEUE& queue, int producers, int consumers,
+                                   size_t batch, size_t count)
+{
+    const size_t per_producer = count / producers;
+    const size_t total = per_producer * producers;
+    std::atomic<size_t> received(0);
+    std::vector<std::thread> threads;
+    bench_timer timer;
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&queue, per_producer, batch]()
+        {
+            std::vector<bench_message> items(batch, bench_message("2024-01-01 request handled"));
+            for (size_t i = 0; i < per_producer; )
+            {
+                const size_t n = (batch == 1) ? queue.try_push(items[0])
+                                              : queue.try_push(items.data(), khmz::detail::_min(batch, per_producer - i));
+                if (!n)
+                    std::this_thread::yield();
+                i += n;
+            }
+        });
+    }
+    for (int c = 0; c < consumers; ++c)
+    {
+        threads.emplace_back([&queue, &received, total, batch]()
+        {
+            std::vector<bench_message> items(batch);
+            while (received.load(std::memory_order_relaxed) < total)
+            {
+                const size_t n = (batch == 1) ? queue.try_pop(items[0]) : queue.try_pop(items.data(), batch);
+                if (!n)
+                    std::this_thread::yield();
+                received.fetch_add(n, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    const double seconds = timer.seconds();
+    std::printf("%-32s %10.1f Mmsg/s %8.1f ns/msg\n", name, total / seconds / 1e6, seconds * 1e9 / total);
+}
+
+// Round trips between two threads over a pair of queues
+template <typename T_QUEUE>
+static void bench_queue_latency(const char *name, T_QUEUE& ping, T_QUEUE& pong, size_t count)
+{
+    std::thread echo([&ping, &pong, count]()
+    {
+        bench_message str;
+        for (size_t i = 0; i < count; ++i)
+        {
+            while (!ping.try_pop(str))
+                ;
+            while (!pong.try_push(str))
+                ;
+        }
+    });
+    bench_message str("ping");
+    bench_timer timer;
+    for (size_t i = 0; i < count; ++i)
+    {
+        while (!ping.try_push(str))
+            ;
+        while (!pong.try_pop(str))
+            ;
+    }
+    const double seconds = timer.seconds();
+    echo.join();
+    std::printf("%-32s %10.1f ns/round trip\n", name, seconds * 1e9 / count);
+}
+
+static void bench_queues(size_t count)
+{
+    std::printf("queues: %zu messages of %s\n", count, "fxstring_a<64>");
+    {
+        fxstring_spsc_queue<char, 64> queue(1024);
+        bench_queue_throughput("spsc 1:1", queue, 1, 1, 1, count);
+        bench_queue_throughput("spsc 1:1 batch 32", queue, 1, 1, 32, count);
+    }
+    {
+        fxstring_mpmc_queue<char, 64> queue(1024);
+        bench_queue_throughput("mpmc 1:1", queue, 1, 1, 1, count);
+        bench_queue_throughput("mpmc 1:1 batch 32", queue, 1, 1, 32, count);
+        bench_queue_throughput("mpmc 2:2", queue, 2, 2, 1, count);
+        bench_queue_throughput("mpmc 2:2 batch 32", queue, 2, 2, 32, count);
+    }
+    {
+        bench_locked_queue queue;
+        bench_queue_throughput("mutex + std::deque 1:1", queue, 1, 1, 1, count);
+        bench_queue_throughput("mutex + std::deque 2:2", queue, 2, 2, 1, count);
+    }
+    if (std::thread::hardware_concurrency() >= 2)
+    {
+        const size_t round_trips = count / 10;
+        fxstring_spsc_queue<char, 64> spsc_ping(1024), spsc_pong(1024);
+        bench_queue_latency("spsc latency", spsc_ping, spsc_pong, round_trips);
+        fxstring_mpmc_queue<char, 64> mpmc_ping(1024), mpmc_pong(1024);
+        bench_queue_latency("mpmc latency", mpmc_ping, mpmc_pong, round_trips);
+    }
+}
+
+//
+// Atomic strings
+//
+
+// A mutex-protected fxstring, for comparison
+template <size_t t_buf_size>
+class bench_locked_string
+{
+public:
+    using value_type = fxstring_a<t_buf_size>;
+
+    value_type load() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_value;
+    }
+    void store(const value_type& str)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_value = str;
+    }
+
+protected:
+    mutable std::mutex m_mutex;
+    value_type m_value;
+};
+
+// Readers load the string continuously while one writer stores a new value every 10 us
+template <typename T_STRING>
+static void bench_atomic_contention(const char *name, int readers, double seconds)
+{
+    using value_type = typename T_STRING::value_type;
+    T_STRING str;
+    const value_type values[2] = { value_type("leader-1"), value_type("leader-22") };
+    str.store(values[0]);
+    std::atomic<bool> done(false);
+    std::atomic<size_t> loads(0), stores(0);
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; ++r)
+    {
+        threads.emplace_back([&str, &done, &loads]()
+        {
+            size_t count = 0, sink = 0;
+            while (!done.load(std::memory_order_relaxed))
+            {
+                const value_type value = str.load();
+                sink += static_cast<unsigned char>(value[7]);
+                ++count;
+            }
+            loads.fetch_add(count, std::memory_order_relaxed);
+            g_bench_sink = sink;
+        });
+    }
+    threads.emplace_back([&str, &done, &stores, &values]()
+    {
+        size_t count = 0;
+        while (!done.load(std::memory_order_relaxed))
+        {
+            str.store(values[count & 1]);
+            ++count;
+            std::this_thread::sleep_for(std::chrono::microseconds(10));
+        }
+        stores.store(count, std::memory_order_relaxed);
+    });
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    done = true;
+    for (std::thread& thread : threads)
+        thread.join();
+    std::printf("%-32s %10.1f Mloads/s %8.1f ns/load %8zu stores\n", name,
+                loads / seconds / 1e6, seconds * 1e9 * readers / loads, stores.load());
+}
+
+static void bench_atomics(double seconds)
+{
+    const int readers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+    std::printf("atomic strings: %d readers, 1 writer, %.1f s each\n", readers, seconds);
+    bench_atomic_contention<atomic_fxstring_a<8>>("atomic_fxstring_a<8> (word)", readers, seconds);
+    bench_atomic_contention<atomic_fxstring_a<16>>(atomic_fxstring_a<16>::is_always_lock_free
+                                                       ? "atomic_fxstring_a<16> (cas16)"
+                                                       : "atomic_fxstring_a<16> (seqlock)", readers, seconds);
+    bench_atomic_contention<atomic_fxstring_a<64>>("atomic_fxstring_a<64> (seqlock)", readers, seconds);
+    bench_atomic_contention<bench_locked_string<64>>("mutex + fxstring_a<64>", readers, seconds);
+}
+
+//
+// Core operations, against std::string
+//
+
+// Makes the compiler assume *ptr is read, so that writing it is not optimized away
+template <typename T>
+static inline void bench_escape(T *ptr)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __asm__ __volatile__("" : : "g"(ptr) : "memory");
+#else
+    static T *volatile s_ptr;
+    s_ptr = ptr;
+#endif
+}
+
+// Runs func(i) for i = 0, 1, ... for at least seconds and returns the nanoseconds per call
+template <typename T_FUNC>
+static double bench_ns_per_op(T_FUNC func, double seconds)
+{
+    for (size_t iterations = 256; ; iterations *= 2)
+    {
+        bench_timer timer;
+        for (size_t i = 0; i < iterations; ++i)
+            func(i);
+        const double elapsed = timer.seconds();
+        if (elapsed >= seconds)
+            return elapsed * 1e9 / iterations;
+    }
+}
+
+// A text of len characters whose last one, '#', appears nowhere else
+static std::string bench_make_text(size_t len)
+{
+    std::string ret;
+    for (size_t i = 0; i + 1 < len; ++i)
+        ret += static_cast<char>('a' + (i * 7) % 26);
+    ret += '#';
+    return ret;
+}
+
+static int bench_format(std::string& str, size_t i, const char *text)
+{
+    char buf[512];
+    const int ret = std::snprintf(buf, sizeof(buf), "%zu:%s", i, text);
+    str.assign(buf);
+    return ret;
+}
+template <size_t t_buf_size>
+static int bench_format(fxstring_a<t_buf_size>& str, size_t i, const char *text)
+{
+    return str.printf("%zu:%s", i, text);
+}
+
+static const char *const s_bench_operations[] =
+{
+    "construct", "copy", "size", "append", "find", "find_first_of",
+    "compare", "hash", "insert", "replace", "format",
+};
+static const size_t s_bench_operation_count = sizeof(s_bench_operations) / sizeof(s_bench_operations[0]);
+
+// Times each operation of s_bench_operations on T_STRING holding text
+template <typename T_STRING>
+static void bench_string_operations(double *ns, const std::string& text, double seconds)
+{
+    const char *ptr = text.c_str();
+    const size_t len = text.size(), half = len / 2;
+    const char needle[3] = { text[len - 2], '#', 0 };
+    const T_STRING str(ptr), same(ptr);
+    // Read through volatile pointers, so that nothing is hoisted out of the loops
+    const T_STRING *volatile str_ptr = &str;
+    const T_STRING *volatile same_ptr = &same;
+    T_STRING work;
+    size_t sink = 0;
+
+    ns[0] = bench_ns_per_op([&](size_t) { T_STRING s(ptr); bench_escape(&s); }, seconds);
+    ns[1] = bench_ns_per_op([&](size_t) { T_STRING s(*str_ptr); bench_escape(&s); }, seconds);
+    ns[2] = bench_ns_per_op([&](size_t) { sink += str_ptr->size(); }, seconds);
+    ns[3] = bench_ns_per_op([&](size_t)
+    {
+        work.assign(ptr, half);
+        work.append(ptr + half, len - half);
+        bench_escape(&work);
+    }, seconds);
+    ns[4] = bench_ns_per_op([&](size_t) { sink += str_ptr->find(needle); }, seconds);
+    ns[5] = bench_ns_per_op([&](size_t) { sink += str_ptr->find_first_of("#%"); }, seconds);
+    ns[6] = bench_ns_per_op([&](size_t) { sink += str_ptr->compare(*same_ptr); }, seconds);
+    ns[7] = bench_ns_per_op([&](size_t) { sink += std::hash<T_STRING>()(*str_ptr); }, seconds);
+    ns[8] = bench_ns_per_op([&](size_t)
+    {
+        work.assign(ptr, len);
+        work.insert(half, "+-+-");
+        bench_escape(&work);
+    }, seconds);
+    ns[9] = bench_ns_per_op([&](size_t)
+    {
+        work.assign(ptr, len);
+        work.replace(1, 2, "+-+-");
+        bench_escape(&work);
+    }, seconds);
+    ns[10] = bench_ns_per_op([&](size_t i) { bench_format(work, i, ptr); bench_escape(&work); }, seconds);
+    g_bench_sink = sink;
+}
+
+template <size_t t_buf_size>
+static void bench_operations_capacity(std::FILE *table, std::FILE *json, bool& first, double seconds)
+{
+    static const int s_fills[] = { 25, 50, 100 };
+    for (int fill : s_fills)
+    {
+        const size_t len = std::max<size_t>(3, (t_buf_size - 1) * fill / 100);
+        const std::string text = bench_make_text(len);
+        double fx_ns[s_bench_operation_count], std_ns[s_bench_operation_count];
+        bench_string_operations<fxstring_a<t_buf_size>>(fx_ns, text, seconds);
+        bench_string_operations<std::string>(std_ns, text, seconds);
+        for (size_t i = 0; i < s_bench_operation_count; ++i)
+        {
+            std::fprintf(table, "%-14s %8zu %4d%% %6zu %10.2f %12.2f %8.2fx\n", s_bench_operations[i], t_buf_size,
+                         fill, len, fx_ns[i], std_ns[i], std_ns[i] / fx_ns[i]);
+            if (json)
+            {
+                std::fprintf(json, "%s\n    {\"operation\": \"%s\", \"capacity\": %zu, \"fill\": %d, "
+                             "\"length\": %zu, \"fxstring_ns\": %.3f, \"std_string_ns\": %.3f}",
+                             first ? "" : ",", s_bench_operations[i], t_buf_size, fill, len, fx_ns[i], std_ns[i]);
+                first = false;
+            }
+        }
+    }
+}
+
+//
+// Times the operations on fxstring_a<N> and on std::string with the same
+// contents, for several capacities N and fill ratios of max_size(). The
+// append, insert and replace timings include assigning the original text.
+// fxstring truncates where std::string grows. The results are written as
+// JSON too, to json_path or to stdout if it is "-"; the table then goes to
+// stderr, so that stdout is JSON only.
+//
+static bool bench_operations(double seconds, const char *json_path)
+{
+    std::FILE *json = nullptr;
+    if (json_path)
+    {
+        json = (std::strcmp(json_path, "-") == 0) ? stdout : std::fopen(json_path, "w");
+        if (!json)
+        {
+            std::perror(json_path);
+            return false;
+        }
+    }
+    std::FILE *table = (json == stdout) ? stderr : stdout;
+    std::fprintf(table, "core operations: ns/op of fxstring_a<N> and std::string\n");
+    std::fprintf(table, "%-14s %8s %5s %6s %10s %12s %9s\n", "operation", "capacity", "fill", "length",
+                 "fxstring", "std::string", "speedup");
+    bool first = true;
+    if (json)
+        std::fprintf(json, "{\"benchmark\": \"fxstring operations\", \"unit\": \"ns/op\", \"results\": [");
+    bench_operations_capacity<16>(table, json, first, seconds);
+    bench_operations_capacity<64>(table, json, first, seconds);
+    bench_operations_capacity<256>(table, json, first, seconds);
+    if (json)
+    {
+        std::fprintf(json, "\n]}\n");
+        if (json != stdout)
+            std::fclose(json);
+    }
+    return true;
+}
+
+//
+// Usage: fxstring_bench [reader [FILE | SIZE_MB] | queue [COUNT] | atomic [SECONDS] |
+//                        ops [SECONDS [JSON_FILE | -]]]
+//
+int main(int argc, char **argv)
+{
+    const char *section = (argc > 1) ? argv[1] : "all";
+    const bool all = std::strcmp(section, "all") == 0;
+
+    if (all || std::strcmp(section, "reader") == 0)
+    {
+        const char *arg = (argc > 2) ? argv[2] : "256";
+        char *end;
+        const double megabytes = std::strtod(arg, &end);
+        if (*end == 0 && megabytes > 0)
+        {
+            const char *path = "fxstring_bench_lines.tmp";
+            if (!bench_make_lines_file(path, megabytes))
+                return EXIT_FAILURE;
+            bench_line_reader(path);
+            std::remove(path);
+        }
+        else
+        {
+            bench_line_reader(arg);
+        }
+    }
+    if (all || std::strcmp(section, "queue") == 0)
+    {
+        const size_t count = (!all && argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 10000000;
+        bench_queues(count);
+    }
+    if (all || std::strcmp(section, "atomic") == 0)
+    {
+        const double seconds = (!all && argc > 2) ? std::strtod(argv[2], nullptr) : 1.0;
+        bench_atomics(seconds);
+    }
+    if (all || std::strcmp(section, "ops") == 0)
+    {
+        const double seconds = (!all && argc > 2) ? std::strtod(argv[2], nullptr) : 0.02;
+        if (!bench_operations(seconds, (!all && argc > 3) ? argv[3] : nullptr))
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
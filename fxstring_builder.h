@@ -0,0 +1,191 @@
+// fxstring_builder.h --- appending to an fxstring through a write cursor
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include <cstdarg>          // For va_list
+#include <type_traits>      // For std::is_integral
+
+namespace khmz
+{
+    //
+    // A builder bound to an fxstring. It keeps the write position, so
+    // appending never rescans the string, and it writes the terminator once,
+    // in finish(); the string must not be used until then. The destructor
+    // calls finish() too.
+    //
+    // Output past max_size() is dropped and sets truncated(). The builder is
+    // a container for std::back_inserter, so it works as the output
+    // iterator of std::copy and the like.
+    //
+    template <typename T_CHAR, size_t t_buf_size>
+    class fxstring_builder
+    {
+    public:
+        using string_type = fxstring<T_CHAR, t_buf_size>;
+        using value_type = T_CHAR;
+        using size_type = size_t;
+        using traits_type = typename string_type::traits_type;
+
+        // Builds str from the start, or after its current contents if append is set
+        explicit fxstring_builder(string_type& str, bool append = false)
+            : m_str(str), m_dest(str.data()), m_len(append ? str.size() : 0), m_truncated(false)
+        {
+        }
+        ~fxstring_builder()
+        {
+            finish();
+        }
+        fxstring_builder(const fxstring_builder&) = delete;
+        fxstring_builder& operator=(const fxstring_builder&) = delete;
+
+        size_type size() const { return m_len; }
+        size_type length() const { return m_len; }
+        size_type max_size() const { return t_buf_size - 1; }
+        size_type remaining() const { return max_size() - m_len; }
+        bool truncated() const { return m_truncated; }
+
+        //
+        // Appending
+        //
+        fxstring_builder& append(const T_CHAR *str, size_type count)
+        {
+            if (count > remaining())
+            {
+                count = remaining();
+                m_truncated = true;
+            }
+            traits_type::copy(m_dest + m_len, str, count);
+            m_len += count;
+            return *this;
+        }
+        fxstring_builder& append(const T_CHAR *str)
+        {
+            return append(str, traits_type::length(str));
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<detail::is_string_class_likely<T_STRING>::value>::type>
+        fxstring_builder& append(const T_STRING& str)
+        {
+            return append(str.data(), str.size());
+        }
+        template <typename T_EXPRESSION,
+                  typename = typename std::enable_if<detail::is_string_expression<T_EXPRESSION>::value>::type,
+                  typename = void>
+        fxstring_builder& append(const T_EXPRESSION& expr)
+        {
+            const size_type n = expr.write(m_dest + m_len, remaining());
+            m_truncated |= (n < expr.size());
+            m_len += n;
+            return *this;
+        }
+        fxstring_builder& append(T_CHAR ch)
+        {
+            if (m_len < max_size())
+                m_dest[m_len++] = ch;
+            else
+                m_truncated = true;
+            return *this;
+        }
+        void push_back(T_CHAR ch)
+        {
+            append(ch);
+        }
+        fxstring_builder& operator+=(const T_CHAR *str)
+        {
+            return append(str);
+        }
+        fxstring_builder& operator+=(T_CHAR ch)
+        {
+            return append(ch);
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<detail::is_string_class_likely<T_STRING>::value ||
+                                                     detail::is_string_expression<T_STRING>::value>::type>
+        fxstring_builder& operator+=(const T_STRING& str)
+        {
+            return append(str);
+        }
+
+        // Appends count copies of ch
+        fxstring_builder& fill(size_type count, T_CHAR ch)
+        {
+            if (count > remaining())
+            {
+                count = remaining();
+                m_truncated = true;
+            }
+            traits_type::assign(m_dest + m_len, count, ch);
+            m_len += count;
+            return *this;
+        }
+
+        // Appends an integer in base 2 to 36, with lowercase digits
+        template <typename T_INT,
+                  typename = typename std::enable_if<std::is_integral<T_INT>::value>::type>
+        fxstring_builder& append_int(T_INT value, int base = 10)
+        {
+            assert(2 <= base && base <= 36);
+            using unsigned_type = typename std::make_unsigned<T_INT>::type;
+            // Negated as unsigned, so that the minimum value works
+            const bool negative = value < 0;
+            unsigned_type n = negative ? unsigned_type(0) - static_cast<unsigned_type>(value)
+                                       : static_cast<unsigned_type>(value);
+            T_CHAR digits[sizeof(T_INT) * 8 + 1];
+            size_type i = sizeof(digits) / sizeof(T_CHAR);
+            do
+            {
+                const unsigned digit = static_cast<unsigned>(n % static_cast<unsigned_type>(base));
+                digits[--i] = static_cast<T_CHAR>(digit < 10 ? '0' + digit : 'a' + digit - 10);
+                n /= static_cast<unsigned_type>(base);
+            } while (n);
+            if (negative)
+                digits[--i] = T_CHAR('-');
+            return append(digits + i, sizeof(digits) / sizeof(T_CHAR) - i);
+        }
+
+        //
+        // Appends printf-style output, formatted in place. Returns what
+        // vsnprintf (or vswprintf) returns.
+        //
+        int append_format(const T_CHAR *format, ...)
+        {
+            va_list va;
+            va_start(va, format);
+            const int ret = append_vformat(format, va);
+            va_end(va);
+            return ret;
+        }
+        int append_vformat(const T_CHAR *format, va_list va)
+        {
+            const size_type room = remaining();
+            m_dest[m_len] = 0;
+            const int ret = detail::_vsnprintf(m_dest + m_len, room + 1, format, va);
+            if (ret >= 0 && static_cast<size_type>(ret) <= room)
+            {
+                m_len += ret;
+                return ret;
+            }
+            // vswprintf returns -1 when truncated, so the written length is found by scanning
+            m_dest[max_size()] = 0;
+            while (m_dest[m_len])
+                ++m_len;
+            m_truncated = true;
+            return ret;
+        }
+
+        // Writes the terminator and returns the string
+        string_type& finish()
+        {
+            m_dest[m_len] = 0;
+            return m_str;
+        }
+
+    protected:
+        string_type& m_str;
+        T_CHAR *m_dest;
+        size_type m_len;
+        bool m_truncated;
+    }; // fxstring_builder
+} // namespace khmz
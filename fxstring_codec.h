@@ -0,0 +1,375 @@
+// fxstring_codec.h --- hex and base64 encoding/decoding for fxstring
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include <cstdint>          // For std::uint32_t
+
+namespace khmz
+{
+    //
+    // Encoded and decoded lengths
+    //
+    constexpr size_t hex_length(size_t size)
+    {
+        return size * 2;
+    }
+    constexpr size_t base64_length(size_t size)
+    {
+        return (size + 2) / 3 * 4;
+    }
+    // len is the length without padding
+    constexpr size_t base64_decoded_length(size_t len)
+    {
+        return len / 4 * 3 + ((len % 4) ? (len % 4) - 1 : 0);
+    }
+
+    namespace detail
+    {
+        static const char _hex_digits[] = "0123456789abcdef";
+        static const char _base64_digits[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        inline int _hex_value(char ch)
+        {
+            if ('0' <= ch && ch <= '9')
+                return ch - '0';
+            if ('a' <= ch && ch <= 'f')
+                return ch - 'a' + 10;
+            if ('A' <= ch && ch <= 'F')
+                return ch - 'A' + 10;
+            return -1;
+        }
+
+        inline size_t _base64_unpadded_length(const char *src, size_t len)
+        {
+            if (len >= 1 && src[len - 1] == '=')
+                --len;
+            if (len >= 1 && src[len - 1] == '=')
+                --len;
+            return len;
+        }
+
+        inline int _base64_value(char ch)
+        {
+            if ('A' <= ch && ch <= 'Z')
+                return ch - 'A';
+            if ('a' <= ch && ch <= 'z')
+                return ch - 'a' + 26;
+            if ('0' <= ch && ch <= '9')
+                return ch - '0' + 52;
+            if (ch == '+')
+                return 62;
+            if (ch == '/')
+                return 63;
+            return -1;
+        }
+
+#ifdef FXSTRING_SSE2
+        // 0xFF where lo <= ch <= hi
+        inline __m128i _sse2_in_range(__m128i v, char lo, char hi)
+        {
+            __m128i d = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+            __m128i limit = _mm_set1_epi8(static_cast<char>(hi - lo));
+            return _mm_cmpeq_epi8(_mm_min_epu8(d, limit), d);
+        }
+
+        // 16 bytes to 32 hex digits
+        inline void _hex_encode16(char *dest, const unsigned char *src)
+        {
+            const __m128i low4 = _mm_set1_epi8(0x0F);
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low4);
+            __m128i lo = _mm_and_si128(v, low4);
+
+            const __m128i nine = _mm_set1_epi8(9);
+            const __m128i zero = _mm_set1_epi8('0');
+            const __m128i gap = _mm_set1_epi8('a' - '0' - 10);
+            hi = _mm_add_epi8(_mm_add_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), gap));
+            lo = _mm_add_epi8(_mm_add_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), gap));
+
+            __m128i *p = reinterpret_cast<__m128i *>(dest);
+            _mm_storeu_si128(p + 0, _mm_unpacklo_epi8(hi, lo));
+            _mm_storeu_si128(p + 1, _mm_unpackhi_epi8(hi, lo));
+        }
+
+        // 16 hex digits to their values. Returns false on invalid digits.
+        inline bool _hex_values16(__m128i& v)
+        {
+            __m128i digit = _sse2_in_range(v, '0', '9');
+            __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+            __m128i alpha = _sse2_in_range(lower, 'a', 'f');
+            if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xFFFF)
+                return false;
+            __m128i d = _mm_and_si128(digit, _mm_sub_epi8(v, _mm_set1_epi8('0')));
+            __m128i a = _mm_and_si128(alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10)));
+            v = _mm_or_si128(d, a);
+            return true;
+        }
+
+        // 32 hex digits to 16 bytes
+        inline bool _hex_decode32(unsigned char *dest, const char *src)
+        {
+            const __m128i *p = reinterpret_cast<const __m128i *>(src);
+            __m128i a = _mm_loadu_si128(p + 0), b = _mm_loadu_si128(p + 1);
+            if (!_hex_values16(a) || !_hex_values16(b))
+                return false;
+            // Each 16-bit lane holds (high nibble, low nibble)
+            const __m128i low8 = _mm_set1_epi16(0xFF);
+            a = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(a, low8), 4), _mm_srli_epi16(a, 8));
+            b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(b, low8), 4), _mm_srli_epi16(b, 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest), _mm_packus_epi16(a, b));
+            return true;
+        }
+
+        inline std::uint32_t _load_be24(const unsigned char *src)
+        {
+            return (std::uint32_t(src[0]) << 16) | (std::uint32_t(src[1]) << 8) | src[2];
+        }
+
+        // 12 bytes to 16 base64 digits
+        inline void _base64_encode12(char *dest, const unsigned char *src)
+        {
+            __m128i x = _mm_set_epi32(static_cast<int>(_load_be24(src + 9)),
+                                      static_cast<int>(_load_be24(src + 6)),
+                                      static_cast<int>(_load_be24(src + 3)),
+                                      static_cast<int>(_load_be24(src + 0)));
+            // Spread each 24-bit lane into four 6-bit indexes, in output order
+            __m128i idx = _mm_and_si128(_mm_srli_epi32(x, 18), _mm_set1_epi32(0x3F));
+            idx = _mm_or_si128(idx, _mm_and_si128(_mm_srli_epi32(x, 4), _mm_set1_epi32(0x3F00)));
+            idx = _mm_or_si128(idx, _mm_and_si128(_mm_slli_epi32(x, 10), _mm_set1_epi32(0x3F0000)));
+            idx = _mm_or_si128(idx, _mm_and_si128(_mm_slli_epi32(x, 24), _mm_set1_epi32(0x3F000000)));
+
+            // Map indexes to the alphabet by adding a per-range offset
+            __m128i v = _mm_add_epi8(idx, _mm_set1_epi8('A'));
+            v = _mm_add_epi8(v, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(25)),
+                                              _mm_set1_epi8('a' - 26 - 'A')));
+            v = _mm_add_epi8(v, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(51)),
+                                              _mm_set1_epi8('0' - 52 - ('a' - 26))));
+            v = _mm_add_epi8(v, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(61)),
+                                              _mm_set1_epi8('+' - 62 - ('0' - 52))));
+            v = _mm_add_epi8(v, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(62)),
+                                              _mm_set1_epi8('/' - 63 - ('+' - 62))));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest), v);
+        }
+
+        // 16 base64 digits to 12 bytes
+        inline bool _base64_decode16(unsigned char *dest, const char *src)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+            __m128i upper = _sse2_in_range(v, 'A', 'Z');
+            __m128i lower = _sse2_in_range(v, 'a', 'z');
+            __m128i digit = _sse2_in_range(v, '0', '9');
+            __m128i plus = _mm_cmpeq_epi8(v, _mm_set1_epi8('+'));
+            __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+            __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+            if (_mm_movemask_epi8(valid) != 0xFFFF)
+                return false;
+
+            __m128i offset = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+            offset = _mm_or_si128(offset, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+            offset = _mm_or_si128(offset, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+            offset = _mm_or_si128(offset, _mm_and_si128(plus, _mm_set1_epi8(62 - '+')));
+            offset = _mm_or_si128(offset, _mm_and_si128(slash, _mm_set1_epi8(63 - '/')));
+            v = _mm_add_epi8(v, offset);
+
+            // Gather four 6-bit values of each lane into a 24-bit value
+            __m128i x = _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x3F)), 18);
+            x = _mm_or_si128(x, _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x3F00)), 4));
+            x = _mm_or_si128(x, _mm_srli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x3F0000)), 10));
+            x = _mm_or_si128(x, _mm_srli_epi32(v, 24));
+
+            std::uint32_t lanes[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), x);
+            for (int i = 0; i < 4; ++i)
+            {
+                dest[3 * i + 0] = static_cast<unsigned char>(lanes[i] >> 16);
+                dest[3 * i + 1] = static_cast<unsigned char>(lanes[i] >> 8);
+                dest[3 * i + 2] = static_cast<unsigned char>(lanes[i]);
+            }
+            return true;
+        }
+#endif  // def FXSTRING_SSE2
+    } // namespace detail
+
+    //
+    // Hex encoding. Writes hex_length(size) lowercase digits without a terminator.
+    //
+    inline size_t hex_encode(char *dest, const void *data, size_t size)
+    {
+        const unsigned char *src = static_cast<const unsigned char *>(data);
+        const unsigned char *end = src + size;
+#ifdef FXSTRING_SSE2
+        for (; end - src >= 16; src += 16, dest += 32)
+            detail::_hex_encode16(dest, src);
+#endif
+        for (; src != end; ++src)
+        {
+            *dest++ = detail::_hex_digits[*src >> 4];
+            *dest++ = detail::_hex_digits[*src & 0x0F];
+        }
+        return hex_length(size);
+    }
+
+    //
+    // Hex decoding. Accepts both cases. Returns false if len is odd or
+    // src contains non-hex digits.
+    //
+    inline bool hex_decode(void *dest, size_t& size, const char *src, size_t len)
+    {
+        if (len % 2)
+            return false;
+        unsigned char *out = static_cast<unsigned char *>(dest);
+        size = len / 2;
+        size_t i = 0;
+#ifdef FXSTRING_SSE2
+        for (; i + 16 <= size; i += 16)
+        {
+            if (!detail::_hex_decode32(&out[i], &src[2 * i]))
+                break;
+        }
+#endif
+        for (; i < size; ++i)
+        {
+            const int hi = detail::_hex_value(src[2 * i]), lo = detail::_hex_value(src[2 * i + 1]);
+            if (hi < 0 || lo < 0)
+                return false;
+            out[i] = static_cast<unsigned char>((hi << 4) | lo);
+        }
+        return true;
+    }
+
+    //
+    // Base64 encoding (RFC 4648, padded). Writes base64_length(size) digits
+    // without a terminator.
+    //
+    inline size_t base64_encode(char *dest, const void *data, size_t size)
+    {
+        const unsigned char *src = static_cast<const unsigned char *>(data);
+        size_t i = 0, j = 0;
+#ifdef FXSTRING_SSE2
+        for (; i + 12 <= size; i += 12, j += 16)
+            detail::_base64_encode12(&dest[j], &src[i]);
+#endif
+        for (; i + 3 <= size; i += 3, j += 4)
+        {
+            const std::uint32_t x = (std::uint32_t(src[i]) << 16) | (std::uint32_t(src[i + 1]) << 8) | src[i + 2];
+            dest[j + 0] = detail::_base64_digits[(x >> 18) & 0x3F];
+            dest[j + 1] = detail::_base64_digits[(x >> 12) & 0x3F];
+            dest[j + 2] = detail::_base64_digits[(x >> 6) & 0x3F];
+            dest[j + 3] = detail::_base64_digits[x & 0x3F];
+        }
+        if (i < size)
+        {
+            const std::uint32_t x = (std::uint32_t(src[i]) << 16) |
+                                    ((i + 1 < size) ? (std::uint32_t(src[i + 1]) << 8) : 0);
+            dest[j + 0] = detail::_base64_digits[(x >> 18) & 0x3F];
+            dest[j + 1] = detail::_base64_digits[(x >> 12) & 0x3F];
+            dest[j + 2] = (i + 1 < size) ? detail::_base64_digits[(x >> 6) & 0x3F] : '=';
+            dest[j + 3] = '=';
+            j += 4;
+        }
+        return j;
+    }
+
+    //
+    // Base64 decoding. Padding is optional, but if present it must complete
+    // the last quantum, and the unused bits of the last digit must be zero.
+    // Returns false on invalid input.
+    //
+    inline bool base64_decode(void *dest, size_t& size, const char *src, size_t len)
+    {
+        const size_t padded_len = len;
+        len = detail::_base64_unpadded_length(src, len);
+        if (len % 4 == 1 || (len != padded_len && padded_len % 4 != 0))
+            return false;
+
+        unsigned char *out = static_cast<unsigned char *>(dest);
+        size_t i = 0, j = 0;
+#ifdef FXSTRING_SSE2
+        for (; i + 16 <= len; i += 16, j += 12)
+        {
+            if (!detail::_base64_decode16(&out[j], &src[i]))
+                break;
+        }
+#endif
+        while (i < len)
+        {
+            const size_t count = khmz::detail::_min<size_t>(4, len - i);
+            std::uint32_t x = 0;
+            for (size_t k = 0; k < 4; ++k)
+            {
+                int value = 0;
+                if (k < count)
+                {
+                    value = detail::_base64_value(src[i + k]);
+                    if (value < 0)
+                        return false;
+                }
+                x = (x << 6) | static_cast<std::uint32_t>(value);
+            }
+            // A partial quantum leaves bits below its last byte, which must be zero
+            if ((count == 2 && (x & 0xFF00)) || (count == 3 && (x & 0xFF)))
+                return false;
+            out[j++] = static_cast<unsigned char>(x >> 16);
+            if (count > 2)
+                out[j++] = static_cast<unsigned char>(x >> 8);
+            if (count > 3)
+                out[j++] = static_cast<unsigned char>(x);
+            i += count;
+        }
+        size = j;
+        return true;
+    }
+
+    //
+    // Encoding into fxstring. The capacity is checked at compile time.
+    //
+    template <size_t t_buf_size, size_t t_size>
+    inline void hex_encode(fxstring<char, t_buf_size>& dest, const unsigned char (&data)[t_size])
+    {
+        static_assert(t_buf_size > hex_length(t_size), "khmz::hex_encode: the destination is too small");
+        dest[hex_encode(dest.data(), data, t_size)] = 0;
+    }
+    template <size_t t_size>
+    inline fxstring<char, hex_length(t_size) + 1> hex_encode(const unsigned char (&data)[t_size])
+    {
+        fxstring<char, hex_length(t_size) + 1> ret;
+        hex_encode(ret, data);
+        return ret;
+    }
+    template <size_t t_buf_size, size_t t_size>
+    inline void base64_encode(fxstring<char, t_buf_size>& dest, const unsigned char (&data)[t_size])
+    {
+        static_assert(t_buf_size > base64_length(t_size), "khmz::base64_encode: the destination is too small");
+        dest[base64_encode(dest.data(), data, t_size)] = 0;
+    }
+    template <size_t t_size>
+    inline fxstring<char, base64_length(t_size) + 1> base64_encode(const unsigned char (&data)[t_size])
+    {
+        fxstring<char, base64_length(t_size) + 1> ret;
+        base64_encode(ret, data);
+        return ret;
+    }
+
+    //
+    // Decoding from fxstring. The decoded size must be exactly t_size.
+    //
+    template <size_t t_size, size_t t_buf_size>
+    inline bool hex_decode(unsigned char (&dest)[t_size], const fxstring<char, t_buf_size>& src)
+    {
+        static_assert(t_buf_size > hex_length(t_size), "khmz::hex_decode: the source can't hold the input");
+        const size_t len = src.size();
+        size_t size;
+        return len == hex_length(t_size) && hex_decode(dest, size, src.data(), len);
+    }
+    template <size_t t_size, size_t t_buf_size>
+    inline bool base64_decode(unsigned char (&dest)[t_size], const fxstring<char, t_buf_size>& src)
+    {
+        static_assert(t_buf_size > base64_length(t_size), "khmz::base64_decode: the source can't hold the input");
+        const size_t len = detail::_base64_unpadded_length(src.data(), src.size());
+        size_t size;
+        return base64_decoded_length(len) == t_size && base64_decode(dest, size, src.data(), len);
+    }
+} // namespace khmz
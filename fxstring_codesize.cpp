@@ -0,0 +1,69 @@
+// fxstring_codesize.cpp --- code size of fxstring across many capacities
+// License: MIT
+
+//
+// Instantiates the modifying members of fxstring for 40 capacities, as a
+// program that uses that many string types does. Compare the text size of
+// the object file between versions:
+//
+//     g++ -std=c++11 -O2 -c fxstring_codesize.cpp && size fxstring_codesize.o
+//
+// Or configure CMake with -DFXSTRING_CODESIZE=ON and run size on the object.
+//
+
+#include "fxstring.h"
+
+using namespace khmz;
+
+template <size_t t_buf_size>
+void codesize_exercise(const char *text, const std::string& other, fxstring_a<t_buf_size>& str)
+{
+    str.assign(text);
+    str.assign(8, 'x');
+    str.assign(other, 1, 4);
+    str.append(text);
+    str.append(other);
+    str.append(3, '-');
+    str += 'y';
+    str.push_back('z');
+    str.pop_back();
+    str.insert(2, text);
+    str.insert(1, 2, '+');
+    str.insert(str.cbegin() + 1, other.begin(), other.end());
+    str.replace(1, 3, text);
+    str.replace(0, 1, other);
+    str.erase(1, 2);
+    str.resize(6, '.');
+    str.assign(utf_truncate, text);
+    str.append(utf_truncate, other);
+    str.insert(utf_truncate, 1, text);
+    str.printf("%s:%d", text, 42);
+}
+
+template <size_t... t_buf_sizes>
+struct codesize_table
+{
+};
+
+using codesize_function = void (*)(const char *, const std::string&, void *);
+
+template <size_t t_buf_size>
+void codesize_entry(const char *text, const std::string& other, void *str)
+{
+    codesize_exercise(text, other, *static_cast<fxstring_a<t_buf_size> *>(str));
+}
+
+template <size_t... t_buf_sizes>
+const codesize_function *codesize_functions(codesize_table<t_buf_sizes...>)
+{
+    static const codesize_function s_functions[] = { &codesize_entry<t_buf_sizes>... };
+    return s_functions;
+}
+
+const codesize_function *fxstring_codesize_functions()
+{
+    return codesize_functions(codesize_table<8, 12, 16, 20, 24, 28, 32, 40, 48, 56,
+                                             64, 72, 80, 96, 100, 112, 120, 128, 144, 160,
+                                             192, 200, 224, 240, 256, 260, 288, 300, 320, 384,
+                                             400, 448, 500, 512, 640, 768, 1000, 1024, 2048, 4096>());
+}
@@ -0,0 +1,372 @@
+// fxstring_column.h --- columnar container of fxstrings
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include "fxstring_batch.h"
+#include <vector>           // For std::vector
+#include <cstdint>          // For std::uint32_t, std::uint64_t
+#include <limits>           // For std::numeric_limits
+
+namespace khmz
+{
+    namespace detail
+    {
+        // Bit k is set where lengths[k] == len, for count <= 64 lengths
+        inline std::uint64_t _match_lengths(const std::uint32_t *lengths, size_t count, std::uint32_t len)
+        {
+            std::uint64_t bits = 0;
+            size_t k = 0;
+#ifdef FXSTRING_SSE2
+            const __m128i key = _mm_set1_epi32(static_cast<int>(len));
+            for (; k + 4 <= count; k += 4)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&lengths[k]));
+                const int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, key)));
+                bits |= std::uint64_t(mask) << k;
+            }
+#endif
+            for (; k < count; ++k)
+            {
+                if (lengths[k] == len)
+                    bits |= std::uint64_t(1) << k;
+            }
+            return bits;
+        }
+
+        // Bit k is set where lengths[k] >= len, for count <= 64 lengths
+        inline std::uint64_t _match_min_lengths(const std::uint32_t *lengths, size_t count, std::uint32_t len)
+        {
+            if (!len)
+                return (count == 64) ? ~std::uint64_t(0) : ((std::uint64_t(1) << count) - 1);
+            std::uint64_t bits = 0;
+            size_t k = 0;
+#ifdef FXSTRING_SSE2
+            const __m128i key = _mm_set1_epi32(static_cast<int>(len - 1));
+            for (; k + 4 <= count; k += 4)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&lengths[k]));
+                const int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, key)));
+                bits |= std::uint64_t(mask) << k;
+            }
+#endif
+            for (; k < count; ++k)
+            {
+                if (lengths[k] >= len)
+                    bits |= std::uint64_t(1) << k;
+            }
+            return bits;
+        }
+
+        //
+        // ASCII case conversion over count characters
+        //
+        template <typename T_CHAR>
+        inline void _ascii_convert_case(T_CHAR *str, size_t count, T_CHAR first, T_CHAR last)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (first <= str[i] && str[i] <= last)
+                    str[i] ^= 0x20;
+            }
+        }
+#ifdef FXSTRING_SSE2
+        inline void _ascii_convert_case(char *str, size_t count, char first, char last)
+        {
+            const __m128i lo = _mm_set1_epi8(static_cast<char>(first - 1));
+            const __m128i hi = _mm_set1_epi8(static_cast<char>(last + 1));
+            const __m128i flip = _mm_set1_epi8(0x20);
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16)
+            {
+                __m128i *p = reinterpret_cast<__m128i *>(&str[i]);
+                __m128i v = _mm_loadu_si128(p);
+                __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+                _mm_storeu_si128(p, _mm_xor_si128(v, _mm_and_si128(in_range, flip)));
+            }
+            for (; i < count; ++i)
+            {
+                if (first <= str[i] && str[i] <= last)
+                    str[i] ^= 0x20;
+            }
+        }
+#endif
+    } // namespace detail
+
+    //
+    // Structure-of-arrays storage of fxstrings: the buffers are stored
+    // contiguously, with a separate length column and an optional hash column.
+    //
+    template <typename T_CHAR, size_t t_buf_size>
+    class fxstring_column
+    {
+    public:
+        static_assert(t_buf_size <= std::numeric_limits<std::uint32_t>::max(),
+                      "template parameter `t_buf_size` is too large");
+        static_assert(sizeof(fxstring<T_CHAR, t_buf_size>) == t_buf_size * sizeof(T_CHAR),
+                      "fxstring must have no padding");
+
+        //
+        // Types
+        //
+        using self_type = fxstring_column<T_CHAR, t_buf_size>;
+        using value_type = fxstring<T_CHAR, t_buf_size>;
+        using view_type = fxstring_view<T_CHAR>;
+        using size_type = size_t;
+        using length_type = std::uint32_t;
+        using hash_type = size_t;
+        using traits_type = typename value_type::traits_type;
+
+        explicit fxstring_column(bool with_hashes = false) : m_with_hashes(with_hashes)
+        {
+        }
+
+        //
+        // Basic information
+        //
+        bool empty() const { return m_values.empty(); }
+        size_type size() const { return m_values.size(); }
+        bool has_hashes() const { return m_with_hashes; }
+        void clear()
+        {
+            m_values.clear();
+            m_lengths.clear();
+            m_hashes.clear();
+        }
+        void reserve(size_type count)
+        {
+            m_values.reserve(count);
+            m_lengths.reserve(count);
+            if (m_with_hashes)
+                m_hashes.reserve(count);
+        }
+        // The number of 64-bit words of a bitmap for the batch operations
+        size_type bitmap_size() const
+        {
+            return (size() + 63) / 64;
+        }
+
+        //
+        // Element access
+        //
+        view_type operator[](size_type index) const
+        {
+            assert(index < size());
+            return view_type(m_values[index].data(), m_lengths[index]);
+        }
+        const value_type& value(size_type index) const
+        {
+            assert(index < size());
+            return m_values[index];
+        }
+        size_type length(size_type index) const
+        {
+            assert(index < size());
+            return m_lengths[index];
+        }
+        hash_type hash(size_type index) const
+        {
+            assert(index < size());
+            if (m_with_hashes)
+                return m_hashes[index];
+            return _hash_at(index);
+        }
+        const value_type *data() const { return m_values.data(); }
+        const length_type *lengths() const { return m_lengths.data(); }
+        const hash_type *hashes() const { return m_with_hashes ? m_hashes.data() : nullptr; }
+
+        //
+        // Appending
+        //
+        void push_back(const T_CHAR *str, size_type count)
+        {
+            m_values.push_back(value_type(str, count));
+            _push_back_length(khmz::detail::_min(count, m_values.back().max_size()));
+        }
+        void push_back(const T_CHAR *str)
+        {
+            push_back(str, traits_type::length(str));
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<detail::is_string_class_likely<T_STRING>::value>::type>
+        void push_back(const T_STRING& str)
+        {
+            push_back(str.data(), str.size());
+        }
+        template <typename InputIterator>
+        void append(InputIterator first, InputIterator last)
+        {
+            for (; first != last; ++first)
+                push_back(*first);
+        }
+        void append(const value_type *first, size_type count)
+        {
+            reserve(size() + count);
+            for (size_type i = 0; i < count; ++i)
+            {
+                m_values.push_back(first[i]);
+                _push_back_length(m_values.back().size());
+            }
+        }
+        void set(size_type index, const T_CHAR *str, size_type count)
+        {
+            assert(index < size());
+            m_values[index].assign(str, count);
+            m_lengths[index] = static_cast<length_type>(khmz::detail::_min(count, m_values[index].max_size()));
+            if (m_with_hashes)
+                m_hashes[index] = _hash_at(index);
+        }
+        void set(size_type index, const T_CHAR *str)
+        {
+            set(index, str, traits_type::length(str));
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<detail::is_string_class_likely<T_STRING>::value>::type>
+        void set(size_type index, const T_STRING& str)
+        {
+            set(index, str.data(), str.size());
+        }
+
+        //
+        // Batch operations. The results are written to bitmap, which must have
+        // bitmap_size() words. Bit (i % 64) of word (i / 64) is set when row i
+        // matches. Returns the number of matching rows.
+        //
+        size_type equal(view_type str, std::uint64_t *bitmap) const
+        {
+            if (str.size() > s_max_size)
+            {
+                for (size_type word = 0; word < bitmap_size(); ++word)
+                    bitmap[word] = 0;
+                return 0;
+            }
+            const length_type len = static_cast<length_type>(str.size());
+            const hash_type hash_value = detail::_hash(s_max_size, str.data(), str.size());
+            size_type ret = 0;
+            for (size_type word = 0; word < bitmap_size(); ++word)
+            {
+                const size_type base = word * 64;
+                const size_type count = khmz::detail::_min<size_type>(64, size() - base);
+                std::uint64_t bits = detail::_match_lengths(&m_lengths[base], count, len);
+                std::uint64_t result = 0;
+                while (bits)
+                {
+                    const unsigned k = detail::_ctz64(bits);
+                    bits &= bits - 1;
+                    if (m_with_hashes && m_hashes[base + k] != hash_value)
+                        continue;
+                    if (traits_type::compare(m_values[base + k].data(), str.data(), len) == 0)
+                        result |= std::uint64_t(1) << k;
+                }
+                bitmap[word] = result;
+                ret += detail::_popcount64(result);
+            }
+            return ret;
+        }
+        size_type starts_with(view_type prefix, std::uint64_t *bitmap) const
+        {
+            const length_type len = static_cast<length_type>(
+                khmz::detail::_min<size_type>(prefix.size(), std::numeric_limits<length_type>::max()));
+            size_type ret = 0;
+            for (size_type word = 0; word < bitmap_size(); ++word)
+            {
+                const size_type base = word * 64;
+                const size_type count = khmz::detail::_min<size_type>(64, size() - base);
+                std::uint64_t bits = detail::_match_min_lengths(&m_lengths[base], count, len);
+                std::uint64_t result = 0;
+                while (bits)
+                {
+                    const unsigned k = detail::_ctz64(bits);
+                    bits &= bits - 1;
+                    if (traits_type::compare(m_values[base + k].data(), prefix.data(), len) == 0)
+                        result |= std::uint64_t(1) << k;
+                }
+                bitmap[word] = result;
+                ret += detail::_popcount64(result);
+            }
+            return ret;
+        }
+
+        // Computes the hashes of all rows into out, which must have size() elements.
+        // The values equal std::hash<value_type>.
+        void hash_all(hash_type *out) const
+        {
+            if (m_with_hashes)
+            {
+                for (size_type i = 0; i < size(); ++i)
+                    out[i] = m_hashes[i];
+                return;
+            }
+            _hash_rows(out, 0, size());
+        }
+
+        // Converts all rows to ASCII upper or lower case
+        void to_upper()
+        {
+            _convert_case(T_CHAR('a'), T_CHAR('z'));
+        }
+        void to_lower()
+        {
+            _convert_case(T_CHAR('A'), T_CHAR('Z'));
+        }
+
+    protected:
+        std::vector<value_type> m_values;
+        std::vector<length_type> m_lengths;
+        std::vector<hash_type> m_hashes;
+        bool m_with_hashes;
+
+        static constexpr size_type s_max_size = t_buf_size - 1;
+        // The distance of prefetching, in rows
+        static constexpr size_type s_prefetch_distance = 8;
+
+        hash_type _hash_at(size_type index) const
+        {
+            return detail::_hash(s_max_size, m_values[index].data(), m_lengths[index]);
+        }
+
+        void _push_back_length(size_type len)
+        {
+            m_lengths.push_back(static_cast<length_type>(len));
+            if (m_with_hashes)
+                m_hashes.push_back(_hash_at(size() - 1));
+        }
+
+        void _hash_rows(hash_type *out, size_type first, size_type last) const
+        {
+            size_type i = first;
+            for (; i + 4 <= last; i += 4)
+            {
+                const T_CHAR *str[4];
+                size_t len[4];
+                for (size_type k = 0; k < 4; ++k)
+                {
+                    if (i + k + s_prefetch_distance < last)
+                        detail::_prefetch(&m_values[i + k + s_prefetch_distance]);
+                    str[k] = m_values[i + k].data();
+                    len[k] = m_lengths[i + k];
+                }
+                detail::_hash_lanes4(s_max_size, str, len, &out[i - first]);
+            }
+            for (; i < last; ++i)
+                out[i - first] = _hash_at(i);
+        }
+
+        void _convert_case(T_CHAR first, T_CHAR last)
+        {
+            // The buffers are contiguous, so the whole column is converted at once.
+            // Characters after the terminators are converted too, which is harmless.
+            if (!empty())
+                detail::_ascii_convert_case(reinterpret_cast<T_CHAR *>(m_values.data()), size() * t_buf_size, first, last);
+            if (m_with_hashes)
+                _hash_rows(m_hashes.data(), 0, size());
+        }
+    }; // fxstring_column
+
+    template <size_t t_buf_size>
+    using fxstring_column_a = fxstring_column<char, t_buf_size>;
+
+    template <size_t t_buf_size>
+    using fxstring_column_w = fxstring_column<wchar_t, t_buf_size>;
+} // namespace khmz
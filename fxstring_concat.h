@@ -0,0 +1,308 @@
+// fxstring_concat.h --- concatenation of fxstrings: lazy operator+ and concat()
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include <string>           // For std::basic_string
+
+namespace khmz
+{
+    template <typename T_CHAR, typename T_LEFT, typename T_RIGHT>
+    class fxstring_concat;
+
+    namespace detail
+    {
+        //
+        // The operands of an expression. Each is measured once, when the
+        // expression is built.
+        //
+        template <typename T_CHAR>
+        struct _concat_piece
+        {
+            const T_CHAR *str;
+            size_t len;
+
+            size_t size() const { return len; }
+            size_t write(T_CHAR *dest, size_t max_size) const
+            {
+                const size_t n = _min(len, max_size);
+                std::char_traits<T_CHAR>::copy(dest, str, n);
+                return n;
+            }
+            bool overlaps(const T_CHAR *first, const T_CHAR *last) const
+            {
+                return len && str < last && first < str + len;
+            }
+        };
+
+        template <typename T_CHAR>
+        struct _concat_char
+        {
+            T_CHAR ch;
+
+            size_t size() const { return 1; }
+            size_t write(T_CHAR *dest, size_t max_size) const
+            {
+                if (!max_size)
+                    return 0;
+                *dest = ch;
+                return 1;
+            }
+            bool overlaps(const T_CHAR *, const T_CHAR *) const { return false; }
+        };
+
+        //
+        // _concat_root: the types that enable operator+, so that it never
+        // applies to std::string or C strings alone
+        //
+        template <typename T>
+        struct _concat_root
+        {
+        };
+        template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+        struct _concat_root<fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>>
+        {
+            using char_type = T_CHAR;
+        };
+        template <typename T_CHAR, typename T_CHAR_TRAITS>
+        struct _concat_root<fxstring_view<T_CHAR, T_CHAR_TRAITS>>
+        {
+            using char_type = T_CHAR;
+        };
+        template <typename T_CHAR, typename T_LEFT, typename T_RIGHT>
+        struct _concat_root<fxstring_concat<T_CHAR, T_LEFT, T_RIGHT>>
+        {
+            using char_type = T_CHAR;
+        };
+
+        // The character type of left + right, if either is a root
+        template <typename T_LEFT, typename T_RIGHT, typename = void>
+        struct _concat_char_type : _concat_root<T_RIGHT>
+        {
+        };
+        template <typename T_LEFT, typename T_RIGHT>
+        struct _concat_char_type<T_LEFT, T_RIGHT, decltype(typename _concat_root<T_LEFT>::char_type(), void())>
+            : _concat_root<T_LEFT>
+        {
+        };
+
+        //
+        // _concat_operand: converts an operand into its expression node
+        //
+        template <typename T, typename T_CHAR, typename = void>
+        struct _concat_operand
+        {
+        };
+        template <typename T_CHAR>
+        struct _concat_operand<T_CHAR, T_CHAR>
+        {
+            using type = _concat_char<T_CHAR>;
+            static type make(T_CHAR ch) { return type{ ch }; }
+        };
+        template <typename T_CHAR>
+        struct _concat_operand<const T_CHAR *, T_CHAR>
+        {
+            using type = _concat_piece<T_CHAR>;
+            static type make(const T_CHAR *str) { return type{ str, std::char_traits<T_CHAR>::length(str) }; }
+        };
+        template <typename T_CHAR>
+        struct _concat_operand<T_CHAR *, T_CHAR> : _concat_operand<const T_CHAR *, T_CHAR>
+        {
+        };
+        template <typename T_CHAR, size_t t_size>
+        struct _concat_operand<T_CHAR[t_size], T_CHAR> : _concat_operand<const T_CHAR *, T_CHAR>
+        {
+        };
+        template <typename T_CHAR, size_t t_size>
+        struct _concat_operand<const T_CHAR[t_size], T_CHAR> : _concat_operand<const T_CHAR *, T_CHAR>
+        {
+        };
+        template <typename T_STRING, typename T_CHAR>
+        struct _concat_operand<T_STRING, T_CHAR,
+                               typename std::enable_if<is_string_class_likely<T_STRING>::value &&
+                                                       std::is_same<typename T_STRING::value_type, T_CHAR>::value>::type>
+        {
+            using type = _concat_piece<T_CHAR>;
+            static type make(const T_STRING& str) { return type{ str.data(), static_cast<size_t>(str.size()) }; }
+        };
+        template <typename T_LEFT, typename T_RIGHT, typename T_CHAR>
+        struct _concat_operand<fxstring_concat<T_CHAR, T_LEFT, T_RIGHT>, T_CHAR>
+        {
+            using type = fxstring_concat<T_CHAR, T_LEFT, T_RIGHT>;
+            static const type& make(const type& expr) { return expr; }
+        };
+    } // namespace detail
+
+    //
+    // A lazy concatenation, built by operator+ on fxstrings, fxstring_views,
+    // C strings, std::strings and characters where at least one operand is
+    // an fxstring or fxstring_view. Nothing is copied until the expression
+    // is assigned to an fxstring or converted to a std::basic_string; then
+    // the total length is known up front and each piece is copied once,
+    // straight into the destination, truncated to its max_size().
+    //
+    // The expression refers to its operands, so it must be used within the
+    // full expression that builds it, not stored with auto.
+    //
+    template <typename T_CHAR, typename T_LEFT, typename T_RIGHT>
+    class fxstring_concat
+    {
+    public:
+        using value_type = T_CHAR;
+        using size_type = size_t;
+        using string_expression_tag = void;
+
+        fxstring_concat(const T_LEFT& left, const T_RIGHT& right) : m_left(left), m_right(right)
+        {
+        }
+
+        size_type size() const { return m_left.size() + m_right.size(); }
+        size_type length() const { return size(); }
+
+        // Writes at most max_size characters without the terminator and returns their count
+        size_type write(T_CHAR *dest, size_type max_size) const
+        {
+            const size_type n = m_left.write(dest, max_size);
+            return n + m_right.write(dest + n, max_size - n);
+        }
+        bool overlaps(const T_CHAR *first, const T_CHAR *last) const
+        {
+            return m_left.overlaps(first, last) || m_right.overlaps(first, last);
+        }
+
+        template <typename T_CHAR_TRAITS, typename T_ALLOCATOR>
+        operator std::basic_string<T_CHAR, T_CHAR_TRAITS, T_ALLOCATOR>() const
+        {
+            std::basic_string<T_CHAR, T_CHAR_TRAITS, T_ALLOCATOR> ret(size(), T_CHAR());
+            if (!ret.empty())
+                write(&ret[0], ret.size());
+            return ret;
+        }
+        std::basic_string<T_CHAR> str() const
+        {
+            return *this;
+        }
+
+    protected:
+        T_LEFT m_left;
+        T_RIGHT m_right;
+    }; // fxstring_concat
+
+    template <typename T_LEFT, typename T_RIGHT,
+              typename T_CHAR = typename detail::_concat_char_type<T_LEFT, T_RIGHT>::char_type,
+              typename T_LEFT_OPERAND = detail::_concat_operand<T_LEFT, T_CHAR>,
+              typename T_RIGHT_OPERAND = detail::_concat_operand<T_RIGHT, T_CHAR>>
+    inline fxstring_concat<T_CHAR, typename T_LEFT_OPERAND::type, typename T_RIGHT_OPERAND::type>
+    operator+(const T_LEFT& left, const T_RIGHT& right)
+    {
+        return fxstring_concat<T_CHAR, typename T_LEFT_OPERAND::type, typename T_RIGHT_OPERAND::type>(
+            T_LEFT_OPERAND::make(left), T_RIGHT_OPERAND::make(right));
+    }
+    namespace detail
+    {
+        //
+        // _concat_capacity: the most characters an operand of concat holds
+        //
+        template <typename T, typename T_CHAR>
+        struct _concat_capacity
+        {
+            static_assert(!std::is_same<T, T>::value,
+                          "concat operands must be fxstrings, character arrays or characters of one type");
+            static constexpr size_t value = 0;
+        };
+        template <typename T_CHAR>
+        struct _concat_capacity<T_CHAR, T_CHAR>
+        {
+            static constexpr size_t value = 1;
+        };
+        template <typename T_CHAR, size_t t_size>
+        struct _concat_capacity<T_CHAR[t_size], T_CHAR>
+        {
+            static constexpr size_t value = t_size - 1;
+        };
+        template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+        struct _concat_capacity<fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_CHAR>
+        {
+            static constexpr size_t value = t_buf_size - 1;
+        };
+
+        template <typename T_CHAR, typename... T_ARGS>
+        struct _concat_capacity_sum
+        {
+            static constexpr size_t value = 0;
+        };
+        template <typename T_CHAR, typename T_FIRST, typename... T_ARGS>
+        struct _concat_capacity_sum<T_CHAR, T_FIRST, T_ARGS...>
+        {
+            static constexpr size_t value =
+                _concat_capacity<T_FIRST, T_CHAR>::value + _concat_capacity_sum<T_CHAR, T_ARGS...>::value;
+        };
+
+        // The character type of the first fxstring or array among the operands
+        template <typename... T_ARGS>
+        struct _concat_char_of
+        {
+        };
+        template <typename T_FIRST, typename... T_ARGS>
+        struct _concat_char_of<T_FIRST, T_ARGS...> : _concat_char_of<T_ARGS...>
+        {
+        };
+        template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS, typename... T_ARGS>
+        struct _concat_char_of<fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_ARGS...>
+        {
+            using type = T_CHAR;
+        };
+        template <typename T_CHAR, size_t t_size, typename... T_ARGS>
+        struct _concat_char_of<T_CHAR[t_size], T_ARGS...>
+        {
+            using type = T_CHAR;
+        };
+
+        //
+        // Copies an operand to dest and advances it. The capacities were
+        // summed, so there is always room.
+        //
+        template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+        inline void _concat_copy(T_CHAR *& dest, const fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str)
+        {
+            const size_t len = str.size();
+            T_CHAR_TRAITS::copy(dest, str.data(), len);
+            dest += len;
+        }
+        template <typename T_CHAR, size_t t_size>
+        inline void _concat_copy(T_CHAR *& dest, const T_CHAR (&str)[t_size])
+        {
+            size_t len = 0;
+            while (len < t_size - 1 && str[len])
+                ++len;
+            std::char_traits<T_CHAR>::copy(dest, str, len);
+            dest += len;
+        }
+        template <typename T_CHAR>
+        inline void _concat_copy(T_CHAR *& dest, T_CHAR ch)
+        {
+            *dest++ = ch;
+        }
+    } // namespace detail
+
+    //
+    // concat(a, b, ...): the concatenation of fxstrings, character arrays
+    // (string literals) and characters, as an fxstring whose capacity is
+    // the sum of the operands' capacities, computed at compile time. The
+    // result never truncates, so there are no runtime capacity checks:
+    // concat(fxstring_a<16>, ':', fxstring_a<32>) is an fxstring_a<48>.
+    //
+    template <typename... T_ARGS,
+              typename T_CHAR = typename detail::_concat_char_of<T_ARGS...>::type>
+    inline fxstring<T_CHAR, detail::_concat_capacity_sum<T_CHAR, T_ARGS...>::value + 1>
+    concat(const T_ARGS&... args)
+    {
+        fxstring<T_CHAR, detail::_concat_capacity_sum<T_CHAR, T_ARGS...>::value + 1> ret;
+        T_CHAR *dest = ret.data();
+        const int expand[] = { 0, (detail::_concat_copy(dest, args), 0)... };
+        (void)expand;
+        *dest = 0;
+        return ret;
+    }
+} // namespace khmz
@@ -0,0 +1,261 @@
+// fxstring_csv.h --- CSV/TSV parser writing fields into fxstrings
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include <cstdint>          // For std::uint64_t
+#include <cstring>          // For std::memcpy
+
+namespace khmz
+{
+    namespace detail
+    {
+        // Bit k is the XOR of bits 0..k of x
+        inline std::uint64_t _prefix_xor(std::uint64_t x)
+        {
+            x ^= x << 1;
+            x ^= x << 2;
+            x ^= x << 4;
+            x ^= x << 8;
+            x ^= x << 16;
+            x ^= x << 32;
+            return x;
+        }
+
+        // Bit k is set where block[k] == ch, for a 64-byte block
+        inline std::uint64_t _match64(const char *block, char ch)
+        {
+#ifdef FXSTRING_SSE2
+            const __m128i key = _mm_set1_epi8(ch);
+            const __m128i *p = reinterpret_cast<const __m128i *>(block);
+            std::uint64_t ret = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                const __m128i v = _mm_cmpeq_epi8(_mm_loadu_si128(p + i), key);
+                ret |= std::uint64_t(static_cast<unsigned>(_mm_movemask_epi8(v))) << (16 * i);
+            }
+            return ret;
+#else
+            std::uint64_t ret = 0;
+            for (int i = 0; i < 64; ++i)
+            {
+                if (block[i] == ch)
+                    ret |= std::uint64_t(1) << i;
+            }
+            return ret;
+#endif
+        }
+
+        // A destination field: a buffer of max_size characters plus the terminator
+        struct _csv_target
+        {
+            char *data;
+            size_t max_size;
+
+            _csv_target() : data(nullptr), max_size(0)
+            {
+            }
+            template <size_t t_buf_size>
+            _csv_target(fxstring<char, t_buf_size>& str) : data(str.data()), max_size(str.max_size())
+            {
+            }
+        };
+    } // namespace detail
+
+    //
+    // Parses CSV (RFC 4180) or TSV records from a memory buffer. Delimiters,
+    // quotes and newlines are located 64 bytes at a time as bitmasks, and
+    // the quoted regions are masked out with a prefix XOR of the quote bits,
+    // so a field is copied at most once, straight into its destination.
+    //
+    // Records end with "\n" or "\r\n". Quoted fields may contain delimiters,
+    // newlines and doubled quotes. A quote of '\0' disables quoting (TSV).
+    //
+    class fxstring_csv_parser
+    {
+    public:
+        using size_type = size_t;
+
+        fxstring_csv_parser(const char *data, size_type size, char delimiter = ',', char quote = '"')
+            : m_data(data), m_size(size), m_delimiter(delimiter), m_quote(quote),
+              m_pos(0), m_block(0), m_bits(0), m_in_quote(0), m_started(false),
+              m_rows(0), m_fields(0), m_truncated(0), m_any_truncated(false)
+        {
+        }
+
+        //
+        // Reads the next record into fields. Missing fields are set empty and
+        // extra fields are ignored; fields() tells the actual count. Returns
+        // false at the end of input.
+        //
+        template <size_t... t_buf_sizes>
+        bool next_row(fxstring<char, t_buf_sizes>&... fields)
+        {
+            detail::_csv_target targets[] = { detail::_csv_target(fields)..., detail::_csv_target() };
+            return _next_row(targets, sizeof...(t_buf_sizes));
+        }
+        // Reads the next record and ignores its fields
+        bool skip_row()
+        {
+            return _next_row(nullptr, 0);
+        }
+
+        //
+        // The last record
+        //
+        // The number of fields
+        size_type fields() const { return m_fields; }
+        // Bit i is set if field i (< 64) was truncated
+        std::uint64_t truncated_mask() const { return m_truncated; }
+        // Whether any field was truncated
+        bool truncated() const { return m_any_truncated; }
+        bool truncated(size_type index) const
+        {
+            return index < 64 && ((m_truncated >> index) & 1);
+        }
+
+        // The number of records read
+        size_type rows() const { return m_rows; }
+        // The offset of the next record
+        size_type position() const { return m_pos; }
+        bool eof() const { return m_pos >= m_size; }
+
+    protected:
+        const char *m_data;
+        size_type m_size;
+        char m_delimiter;
+        char m_quote;
+        size_type m_pos;
+        size_type m_block;          // The offset of the classified block
+        std::uint64_t m_bits;       // Its unread delimiters and newlines
+        std::uint64_t m_in_quote;   // All ones if the previous block ended in quotes
+        bool m_started;
+        size_type m_rows;
+        size_type m_fields;
+        std::uint64_t m_truncated;
+        bool m_any_truncated;
+
+        void _classify(const char *block)
+        {
+            std::uint64_t structural = detail::_match64(block, m_delimiter) | detail::_match64(block, '\n');
+            if (m_quote)
+            {
+                const std::uint64_t in_quote = detail::_prefix_xor(detail::_match64(block, m_quote)) ^ m_in_quote;
+                structural &= ~in_quote;
+                m_in_quote = std::uint64_t(0) - (in_quote >> 63);
+            }
+            m_bits = structural;
+        }
+
+        // The offset of the next delimiter or newline, or m_size
+        size_type _next_structural()
+        {
+            for (;;)
+            {
+                if (m_bits)
+                {
+                    const size_type ret = m_block + detail::_ctz64(m_bits);
+                    m_bits &= m_bits - 1;
+                    return ret;
+                }
+                if (m_started)
+                    m_block += 64;
+                m_started = true;
+                if (m_block >= m_size)
+                {
+                    m_block = m_size;
+                    return m_size;
+                }
+                if (m_size - m_block >= 64)
+                {
+                    _classify(m_data + m_block);
+                }
+                else
+                {
+                    // The last block. The bits past the end are cleared.
+                    char block[64] = { 0 };
+                    std::memcpy(block, m_data + m_block, m_size - m_block);
+                    _classify(block);
+                    m_bits &= (std::uint64_t(1) << (m_size - m_block)) - 1;
+                }
+            }
+        }
+
+        // Copies the field [first, last) into target. Returns false if truncated.
+        bool _store(const detail::_csv_target& target, size_type first, size_type last)
+        {
+            const char *src = m_data + first;
+            size_type len = last - first;
+            if (!m_quote || !len || src[0] != m_quote)
+            {
+                const size_type n = khmz::detail::_min(len, target.max_size);
+                std::memcpy(target.data, src, n);
+                target.data[n] = 0;
+                return n == len;
+            }
+
+            // Removes the quotes and unescapes the doubled ones
+            size_type n = 0;
+            bool ret = true;
+            for (size_type i = 1; i < len; ++i)
+            {
+                if (src[i] == m_quote)
+                {
+                    if (i + 1 >= len || src[i + 1] != m_quote)
+                        continue;
+                    ++i;
+                }
+                if (n == target.max_size)
+                {
+                    ret = false;
+                    break;
+                }
+                target.data[n++] = src[i];
+            }
+            target.data[n] = 0;
+            return ret;
+        }
+
+        bool _next_row(const detail::_csv_target *targets, size_type count)
+        {
+            m_fields = 0;
+            m_truncated = 0;
+            m_any_truncated = false;
+            if (m_pos >= m_size)
+            {
+                for (size_type i = 0; i < count; ++i)
+                    targets[i].data[0] = 0;
+                return false;
+            }
+
+            size_type first = m_pos;
+            for (;;)
+            {
+                const size_type pos = _next_structural();
+                const bool end_of_row = (pos == m_size || m_data[pos] == '\n');
+                size_type last = pos;
+                if (end_of_row && pos != m_size && last > first && m_data[last - 1] == '\r')
+                    --last;
+                if (m_fields < count && !_store(targets[m_fields], first, last))
+                {
+                    m_any_truncated = true;
+                    if (m_fields < 64)
+                        m_truncated |= std::uint64_t(1) << m_fields;
+                }
+                ++m_fields;
+                if (end_of_row)
+                {
+                    m_pos = (pos == m_size) ? m_size : pos + 1;
+                    break;
+                }
+                first = pos + 1;
+            }
+
+            for (size_type i = m_fields; i < count; ++i)
+                targets[i].data[0] = 0;
+            ++m_rows;
+            return true;
+        }
+    }; // fxstring_csv_parser
+} // namespace khmz
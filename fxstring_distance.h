@@ -0,0 +1,259 @@
+// fxstring_distance.h --- bit-parallel edit distance of fxstrings
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include "fxstring_column.h"
+#include <algorithm>        // For std::lower_bound
+#include <cstdint>          // For std::uint32_t, std::uint64_t
+#include <cstring>          // For std::memset
+#include <type_traits>      // For std::make_unsigned
+#include <vector>           // For std::vector
+
+namespace khmz
+{
+    namespace detail
+    {
+        //
+        // One text character through a block of 64 pattern rows of Myers'
+        // algorithm, as extended to blocks by Hyyrö. pv and mv are the
+        // positive and negative vertical deltas of the block's column; hin
+        // is the horizontal delta (-1, 0 or +1) entering the block's top row.
+        // Returns the horizontal delta leaving row bit.
+        //
+        inline int _myers_step(std::uint64_t eq, std::uint64_t& pv, std::uint64_t& mv, int hin, unsigned bit)
+        {
+            const std::uint64_t xv = eq | mv;
+            if (hin < 0)
+                eq |= 1;
+            const std::uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            std::uint64_t ph = mv | ~(xh | pv);
+            std::uint64_t mh = pv & xh;
+            const int hout = static_cast<int>((ph >> bit) & 1) - static_cast<int>((mh >> bit) & 1);
+            ph <<= 1;
+            mh <<= 1;
+            if (hin < 0)
+                mh |= 1;
+            else if (hin > 0)
+                ph |= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+            return hout;
+        }
+    } // namespace detail
+
+    //
+    // A query string prepared for Levenshtein distances against many texts.
+    // Each pattern row is one bit, so a query of an fxstring with buf_size
+    // t_buf_size fits in (max_size() + 63) / 64 words that are sized at
+    // compile time: one word up to fxstring_a<65>. A text character costs
+    // a few word operations per word, rather than a row of the O(m * n)
+    // table.
+    //
+    // Queries longer than max_size() are truncated, as fxstring does.
+    //
+    template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS = std::char_traits<T_CHAR>>
+    class fxstring_distance
+    {
+    public:
+        using value_type = T_CHAR;
+        using size_type = size_t;
+        using view_type = fxstring_view<T_CHAR, T_CHAR_TRAITS>;
+        using string_type = fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>;
+
+        static constexpr size_type s_max_size = t_buf_size - 1;
+        static constexpr size_type s_words = (s_max_size + 63) / 64 + (s_max_size == 0);
+
+        fxstring_distance()
+        {
+            assign(view_type());
+        }
+        explicit fxstring_distance(view_type query)
+        {
+            assign(query);
+        }
+        explicit fxstring_distance(const string_type& query)
+        {
+            assign(query.view());
+        }
+
+        void assign(view_type query)
+        {
+            m_size = khmz::detail::_min(query.size(), s_max_size);
+            std::memset(m_byte_eq, 0, sizeof(m_byte_eq));
+            m_wide_codes.clear();
+            m_wide_eq.clear();
+            for (size_type i = 0; i < m_size; ++i)
+            {
+                const std::uint64_t code = _code(query[i]);
+                std::uint64_t *eq;
+                if (code < 256)
+                {
+                    eq = m_byte_eq[code];
+                }
+                else
+                {
+                    std::vector<std::uint64_t>::iterator it =
+                        std::lower_bound(m_wide_codes.begin(), m_wide_codes.end(), code);
+                    const size_type index = it - m_wide_codes.begin();
+                    if (it == m_wide_codes.end() || *it != code)
+                    {
+                        m_wide_codes.insert(it, code);
+                        m_wide_eq.insert(m_wide_eq.begin() + index * s_words, s_words, std::uint64_t(0));
+                    }
+                    eq = &m_wide_eq[index * s_words];
+                }
+                eq[i / 64] |= std::uint64_t(1) << (i % 64);
+            }
+        }
+
+        size_type size() const { return m_size; }
+
+        // The Levenshtein distance between the query and text
+        size_type distance(view_type text) const
+        {
+            size_type ret;
+            _run(text, s_unbounded, ret);
+            return ret;
+        }
+
+        // Whether the distance is at most max_distance. Stops as soon as the
+        // rest of text cannot bring the distance down to it.
+        bool within(view_type text, size_type max_distance) const
+        {
+            size_type ignored;
+            return _run(text, max_distance, ignored);
+        }
+        // Also returns the distance, if within
+        bool within(view_type text, size_type max_distance, size_type& distance) const
+        {
+            return _run(text, max_distance, distance);
+        }
+
+        //
+        // Batches over columns, whose lengths are read first: a row whose
+        // length differs from the query's by more than max_distance is not
+        // compared. bitmap has column.bitmap_size() words, as the batch
+        // operations of fxstring_column. Returns the number of rows within.
+        //
+        template <size_t t_column_buf_size>
+        size_type within(const fxstring_column<T_CHAR, t_column_buf_size>& column, size_type max_distance,
+                         std::uint64_t *bitmap) const
+        {
+            const size_type lo = (m_size > max_distance) ? m_size - max_distance : 0;
+            const size_type hi = m_size + max_distance;
+            size_type ret = 0;
+            for (size_type word = 0; word < column.bitmap_size(); ++word)
+            {
+                const size_type base = word * 64;
+                const size_type count = khmz::detail::_min<size_type>(64, column.size() - base);
+                const std::uint32_t *lengths = column.lengths() + base;
+                std::uint64_t result = 0;
+                for (size_type k = 0; k < count; ++k)
+                {
+                    if (lengths[k] < lo || lengths[k] > hi)
+                        continue;
+                    if (within(view_type(column.data()[base + k].data(), lengths[k]), max_distance))
+                        result |= std::uint64_t(1) << k;
+                }
+                bitmap[word] = result;
+                ret += detail::_popcount64(result);
+            }
+            return ret;
+        }
+        // The distances of all rows into out, which has column.size() elements
+        template <size_t t_column_buf_size>
+        void distance(const fxstring_column<T_CHAR, t_column_buf_size>& column, std::uint32_t *out) const
+        {
+            for (size_type i = 0; i < column.size(); ++i)
+                out[i] = static_cast<std::uint32_t>(distance(column[i]));
+        }
+
+    protected:
+        static constexpr size_type s_unbounded = -1;
+
+        size_type m_size;
+        std::uint64_t m_byte_eq[256][s_words];      // The rows of each character below 256
+        std::vector<std::uint64_t> m_wide_codes;    // Sorted, for the characters above
+        std::vector<std::uint64_t> m_wide_eq;       // s_words per code
+
+        static std::uint64_t _code(T_CHAR ch)
+        {
+            return static_cast<std::uint64_t>(static_cast<typename std::make_unsigned<T_CHAR>::type>(ch));
+        }
+
+        const std::uint64_t *_eq(T_CHAR ch) const
+        {
+            static const std::uint64_t s_none[s_words] = {};
+            const std::uint64_t code = _code(ch);
+            if (code < 256)
+                return m_byte_eq[code];
+            std::vector<std::uint64_t>::const_iterator it =
+                std::lower_bound(m_wide_codes.begin(), m_wide_codes.end(), code);
+            if (it == m_wide_codes.end() || *it != code)
+                return s_none;
+            return &m_wide_eq[(it - m_wide_codes.begin()) * s_words];
+        }
+
+        // Computes the distance into ret, unless it exceeds max_distance
+        bool _run(view_type text, size_type max_distance, size_type& ret) const
+        {
+            const size_type n = text.size();
+            const size_type gap = (n > m_size) ? n - m_size : m_size - n;
+            if (gap > max_distance)
+                return false;
+            if (!m_size)
+            {
+                ret = n;
+                return true;
+            }
+
+            const size_type blocks = (m_size + 63) / 64;
+            const unsigned last_bit = static_cast<unsigned>((m_size - 1) % 64);
+            std::uint64_t pv[s_words], mv[s_words];
+            for (size_type w = 0; w < blocks; ++w)
+            {
+                pv[w] = ~std::uint64_t(0);
+                mv[w] = 0;
+            }
+
+            size_type score = m_size;
+            for (size_type j = 0; j < n; ++j)
+            {
+                const std::uint64_t *eq = _eq(text[j]);
+                int hin = 1;    // The top row is D[0][j] = j
+                for (size_type w = 0; w + 1 < blocks; ++w)
+                    hin = detail::_myers_step(eq[w], pv[w], mv[w], hin, 63);
+                score += detail::_myers_step(eq[blocks - 1], pv[blocks - 1], mv[blocks - 1], hin, last_bit);
+                // Each remaining character lowers the distance by one at most
+                if (score > max_distance && score - max_distance > n - j - 1)
+                    return false;
+            }
+            ret = score;
+            return score <= max_distance;
+        }
+    }; // fxstring_distance
+
+    template <size_t t_buf_size>
+    using fxstring_distance_a = fxstring_distance<char, t_buf_size>;
+    template <size_t t_buf_size>
+    using fxstring_distance_w = fxstring_distance<wchar_t, t_buf_size>;
+
+    //
+    // One-off distances; prepare an fxstring_distance to compare one query
+    // against many strings
+    //
+    template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+    inline size_t edit_distance(const fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str,
+                                typename fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>::view_type other)
+    {
+        return fxstring_distance<T_CHAR, t_buf_size, T_CHAR_TRAITS>(str).distance(other);
+    }
+    template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+    inline bool edit_distance_within(const fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str,
+                                     typename fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>::view_type other, size_t max_distance)
+    {
+        return fxstring_distance<T_CHAR, t_buf_size, T_CHAR_TRAITS>(str).within(other, max_distance);
+    }
+} // namespace khmz
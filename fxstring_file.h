@@ -0,0 +1,380 @@
+// fxstring_file.h --- memory-mapped file format for arrays of fxstrings
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include <cstdint>          // For std::uint32_t, std::uint64_t
+#include <cstring>          // For std::memcmp, std::memcpy
+#include <cstdio>           // For std::FILE, std::fopen, ...
+#include <string>           // For std::string
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>      // For open
+    #include <sys/mman.h>   // For mmap, munmap
+    #include <sys/stat.h>   // For fstat
+    #include <unistd.h>     // For close
+#endif
+
+namespace khmz
+{
+    //
+    // The file header. The records follow at data_offset, each of them
+    // buf_size characters long, in the byte order of the writer.
+    //
+    struct fxstring_file_header
+    {
+        char magic[8];              // "FXSTRARR"
+        std::uint32_t version;      // fxstring_file_header::current_version
+        std::uint32_t byte_order;   // 0x01020304 as written by the writer
+        std::uint32_t char_kind;    // 1: char, 2: wchar_t, 3: char16_t, 4: char32_t
+        std::uint32_t char_size;    // sizeof(T_CHAR)
+        std::uint64_t buf_size;     // t_buf_size
+        std::uint64_t count;        // The number of records
+        std::uint64_t data_offset;  // The offset of the first record
+
+        static constexpr std::uint32_t current_version = 1;
+        static constexpr std::uint32_t native_byte_order = 0x01020304;
+        static constexpr std::uint64_t alignment = 64;
+    };
+
+    namespace detail
+    {
+        static const char _file_magic[8] = { 'F', 'X', 'S', 'T', 'R', 'A', 'R', 'R' };
+
+        template <typename T_CHAR> struct _char_kind;
+        template <> struct _char_kind<char>     { static constexpr std::uint32_t value = 1; };
+        template <> struct _char_kind<wchar_t>  { static constexpr std::uint32_t value = 2; };
+        template <> struct _char_kind<char16_t> { static constexpr std::uint32_t value = 3; };
+        template <> struct _char_kind<char32_t> { static constexpr std::uint32_t value = 4; };
+
+        template <typename T_CHAR, size_t t_buf_size>
+        inline fxstring_file_header _make_file_header(std::uint64_t count)
+        {
+            fxstring_file_header header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, _file_magic, sizeof(header.magic));
+            header.version = fxstring_file_header::current_version;
+            header.byte_order = fxstring_file_header::native_byte_order;
+            header.char_kind = _char_kind<T_CHAR>::value;
+            header.char_size = sizeof(T_CHAR);
+            header.buf_size = t_buf_size;
+            header.count = count;
+            header.data_offset = fxstring_file_header::alignment;
+            return header;
+        }
+    } // namespace detail
+
+    //
+    // Writer
+    //
+    template <typename T_CHAR, size_t t_buf_size>
+    class fxstring_file_writer
+    {
+    public:
+        using value_type = fxstring<T_CHAR, t_buf_size>;
+        using size_type = size_t;
+
+        fxstring_file_writer() : m_fp(nullptr), m_count(0), m_failed(false)
+        {
+        }
+        explicit fxstring_file_writer(const char *path) : m_fp(nullptr), m_count(0), m_failed(false)
+        {
+            open(path);
+        }
+        ~fxstring_file_writer()
+        {
+            close();
+        }
+        fxstring_file_writer(const fxstring_file_writer&) = delete;
+        fxstring_file_writer& operator=(const fxstring_file_writer&) = delete;
+
+        bool is_open() const { return m_fp != nullptr; }
+        size_type size() const { return m_count; }
+
+        bool open(const char *path)
+        {
+            close();
+            m_failed = false;
+            m_fp = std::fopen(path, "wb");
+            if (!m_fp)
+                return false;
+            m_path = path;
+            m_count = 0;
+            // A placeholder until close()
+            const fxstring_file_header header = detail::_make_file_header<T_CHAR, t_buf_size>(0);
+            unsigned char head[fxstring_file_header::alignment] = { 0 };
+            std::memcpy(head, &header, sizeof(header));
+            if (std::fwrite(head, sizeof(head), 1, m_fp) != 1)
+            {
+                _finish(false);
+                return false;
+            }
+            return true;
+        }
+
+        bool write(const value_type& str)
+        {
+            return write(&str, 1);
+        }
+        bool write(const value_type *first, size_type count)
+        {
+            if (!m_fp)
+                return false;
+            // The characters after the terminator are zeroed
+            value_type buf[s_chunk_size];
+            while (count)
+            {
+                const size_type n = khmz::detail::_min(count, s_chunk_size);
+                for (size_type i = 0; i < n; ++i)
+                {
+                    const size_type len = first[i].size();
+                    buf[i] = first[i];
+                    value_type::traits_type::assign(&buf[i][len], t_buf_size - len, T_CHAR());
+                }
+                if (std::fwrite(buf, sizeof(value_type), n, m_fp) != n)
+                {
+                    _finish(false);
+                    return false;
+                }
+                m_count += n;
+                first += n;
+                count -= n;
+            }
+            return true;
+        }
+
+        // Writes the final header. Returns false on errors, including those
+        // of earlier writes; the partial file is then removed.
+        bool close()
+        {
+            if (!m_fp)
+                return !m_failed;
+            const fxstring_file_header header = detail::_make_file_header<T_CHAR, t_buf_size>(m_count);
+            return _finish(std::fseek(m_fp, 0, SEEK_SET) == 0 &&
+                           std::fwrite(&header, sizeof(header), 1, m_fp) == 1);
+        }
+
+    protected:
+        static constexpr size_type s_chunk_size = (t_buf_size * sizeof(T_CHAR) >= 4096) ? 1 : (4096 / (t_buf_size * sizeof(T_CHAR)));
+
+        std::FILE *m_fp;
+        size_type m_count;
+        bool m_failed;
+        std::string m_path;
+
+        // Closes the file. On failure, the file is removed, as its header
+        // would claim fewer records than were written; only regular files
+        // are removed, not devices or pipes.
+        bool _finish(bool ok)
+        {
+            const bool regular = _is_regular_file();
+            ok = (std::fclose(m_fp) == 0) && ok;
+            m_fp = nullptr;
+            if (!ok)
+            {
+                m_failed = true;
+                if (regular)
+                    std::remove(m_path.c_str());
+            }
+            return ok;
+        }
+        bool _is_regular_file() const
+        {
+#ifdef _WIN32
+            return true;
+#else
+            struct stat st;
+            return ::fstat(fileno(m_fp), &st) == 0 && S_ISREG(st.st_mode);
+#endif
+        }
+    }; // fxstring_file_writer
+
+    template <typename T_CHAR, size_t t_buf_size>
+    inline bool write_fxstring_file(const char *path, const fxstring<T_CHAR, t_buf_size> *first, size_t count)
+    {
+        fxstring_file_writer<T_CHAR, t_buf_size> writer;
+        return writer.open(path) && writer.write(first, count) && writer.close();
+    }
+
+    //
+    // Memory-mapped reader. The records are a random-access range of
+    // const fxstring& pointing into the mapping; pages are loaded on demand.
+    //
+    template <typename T_CHAR, size_t t_buf_size>
+    class fxstring_file_reader
+    {
+    public:
+        using value_type = fxstring<T_CHAR, t_buf_size>;
+        using size_type = size_t;
+        using const_reference = const value_type&;
+        using const_iterator = const value_type *;
+
+        fxstring_file_reader() : m_base(nullptr), m_mapped_size(0), m_data(nullptr), m_count(0)
+        {
+        }
+        explicit fxstring_file_reader(const char *path, bool verify = false)
+            : m_base(nullptr), m_mapped_size(0), m_data(nullptr), m_count(0)
+        {
+            open(path, verify);
+        }
+        ~fxstring_file_reader()
+        {
+            close();
+        }
+        fxstring_file_reader(const fxstring_file_reader&) = delete;
+        fxstring_file_reader& operator=(const fxstring_file_reader&) = delete;
+        fxstring_file_reader(fxstring_file_reader&& other)
+            : m_base(other.m_base), m_mapped_size(other.m_mapped_size), m_data(other.m_data), m_count(other.m_count)
+        {
+            other.m_base = nullptr;
+            other.m_mapped_size = 0;
+            other.m_data = nullptr;
+            other.m_count = 0;
+        }
+
+        // Maps the file and checks its header. If verify is true, all records
+        // are also checked to be terminated, which touches every page.
+        bool open(const char *path, bool verify = false)
+        {
+            close();
+            if (!_map(path))
+                return false;
+
+            fxstring_file_header header;
+            if (m_mapped_size < sizeof(header))
+            {
+                close();
+                return false;
+            }
+            std::memcpy(&header, m_base, sizeof(header));
+            const fxstring_file_header expected = detail::_make_file_header<T_CHAR, t_buf_size>(header.count);
+            if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+                header.version != expected.version ||
+                header.byte_order != expected.byte_order ||
+                header.char_kind != expected.char_kind ||
+                header.char_size != expected.char_size ||
+                header.buf_size != expected.buf_size ||
+                header.data_offset % alignof(value_type) != 0 ||
+                header.data_offset > m_mapped_size ||
+                header.count > (m_mapped_size - header.data_offset) / sizeof(value_type))
+            {
+                close();
+                return false;
+            }
+
+            m_data = reinterpret_cast<const value_type *>(static_cast<const char *>(m_base) + header.data_offset);
+            m_count = static_cast<size_type>(header.count);
+            if (verify && !_verify())
+            {
+                close();
+                return false;
+            }
+            return true;
+        }
+
+        void close()
+        {
+            if (m_base)
+                _unmap();
+            m_base = nullptr;
+            m_mapped_size = 0;
+            m_data = nullptr;
+            m_count = 0;
+        }
+
+        bool is_open() const { return m_base != nullptr; }
+        bool empty() const { return !m_count; }
+        size_type size() const { return m_count; }
+        const value_type *data() const { return m_data; }
+        const_iterator begin() const { return m_data; }
+        const_iterator end() const { return m_data + m_count; }
+        const_reference operator[](size_type index) const
+        {
+            assert(index < m_count);
+            return m_data[index];
+        }
+        const_reference at(size_type index) const
+        {
+            if (index >= m_count)
+            {
+                assert(0);
+                throw std::out_of_range("khmz::fxstring_file_reader::at");
+            }
+            return m_data[index];
+        }
+
+    protected:
+        const void *m_base;
+        size_type m_mapped_size;
+        const value_type *m_data;
+        size_type m_count;
+
+        bool _verify() const
+        {
+            for (size_type i = 0; i < m_count; ++i)
+            {
+                if (!m_data[i].is_terminated())
+                    return false;
+            }
+            return true;
+        }
+
+#ifdef _WIN32
+        bool _map(const char *path)
+        {
+            HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                        FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return false;
+            LARGE_INTEGER file_size;
+            if (!::GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+            {
+                ::CloseHandle(file);
+                return false;
+            }
+            HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            ::CloseHandle(file);
+            if (!mapping)
+                return false;
+            m_base = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            ::CloseHandle(mapping);
+            m_mapped_size = static_cast<size_type>(file_size.QuadPart);
+            return m_base != nullptr;
+        }
+        void _unmap()
+        {
+            ::UnmapViewOfFile(m_base);
+        }
+#else
+        bool _map(const char *path)
+        {
+            const int fd = ::open(path, O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (::fstat(fd, &st) != 0 || st.st_size <= 0)
+            {
+                ::close(fd);
+                return false;
+            }
+            void *base = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (base == MAP_FAILED)
+                return false;
+            m_base = base;
+            m_mapped_size = static_cast<size_type>(st.st_size);
+            return true;
+        }
+        void _unmap()
+        {
+            ::munmap(const_cast<void *>(m_base), m_mapped_size);
+        }
+#endif
+    }; // fxstring_file_reader
+} // namespace khmz
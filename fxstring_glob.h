@@ -0,0 +1,428 @@
+// fxstring_glob.h --- compiled glob patterns for fxstrings
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include "fxstring_batch.h"
+#include "fxstring_column.h"
+#include <cstdint>          // For std::uint64_t
+#include <cstring>          // For std::memcmp
+#include <string>           // For std::basic_string
+#include <type_traits>      // For std::make_unsigned
+#include <utility>          // For std::pair
+#include <vector>           // For std::vector
+
+namespace khmz
+{
+    namespace detail
+    {
+        //
+        // The first occurrence of needle (count > 0 characters) in
+        // [str, str + len), or nullptr
+        //
+        template <typename T_CHAR, typename T_CHAR_TRAITS>
+        inline const T_CHAR *_glob_find_literal(const T_CHAR *str, size_t len, const T_CHAR *needle, size_t count,
+                                                T_CHAR_TRAITS)
+        {
+            const size_t found = fxstring_view<T_CHAR, T_CHAR_TRAITS>(str, len).find(
+                fxstring_view<T_CHAR, T_CHAR_TRAITS>(needle, count));
+            return (found == size_t(-1)) ? nullptr : str + found;
+        }
+#ifdef FXSTRING_SSE2
+        //
+        // Compares the first and the last characters of the needle at 16
+        // positions at once, and the rest only where both are equal
+        //
+        inline const char *_glob_find_literal(const char *str, size_t len, const char *needle, size_t count,
+                                              std::char_traits<char>)
+        {
+            if (count > len)
+                return nullptr;
+            if (count == 1)
+                return std::char_traits<char>::find(str, len, needle[0]);
+            const __m128i first = _mm_set1_epi8(needle[0]);
+            const __m128i last = _mm_set1_epi8(needle[count - 1]);
+            size_t i = 0;
+            for (; i + count - 1 + 16 <= len; i += 16)
+            {
+                const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(str + i));
+                const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(str + i + count - 1));
+                unsigned mask = static_cast<unsigned>(
+                    _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v0, first), _mm_cmpeq_epi8(v1, last))));
+                while (mask)
+                {
+                    const size_t k = i + _ctz64(mask);
+                    if (std::memcmp(str + k + 1, needle + 1, count - 2) == 0)
+                        return str + k;
+                    mask &= mask - 1;
+                }
+            }
+            const size_t found = fxstring_view<char>(str + i, len - i).find(fxstring_view<char>(needle, count));
+            return (found == size_t(-1)) ? nullptr : str + i + found;
+        }
+#endif
+    } // namespace detail
+
+    //
+    // A glob pattern, compiled once and matched against whole strings.
+    //
+    //     *        any sequence of characters, including none
+    //     ?        any single character
+    //     [abc]    one of the characters; ranges such as [a-z] are allowed,
+    //              and ] is a member if first
+    //     [!abc]   any character but these; [^abc] too
+    //     \x       the character x itself
+    //
+    // An unterminated [ and a trailing \ are literal. The pattern is split
+    // at the stars into segments of single-character tokens. The segments
+    // before the first star and after the last one are anchored at the
+    // ends; those between are placed at their earliest match, left to
+    // right, which is correct for stars and never backtracks, so matching
+    // takes O(length * pattern) time at worst. Each floating segment is
+    // searched for by its longest literal run, with SSE2 for char.
+    //
+    template <typename T_CHAR, typename T_CHAR_TRAITS = std::char_traits<T_CHAR>>
+    class fxstring_glob
+    {
+    public:
+        using value_type = T_CHAR;
+        using size_type = size_t;
+        using traits_type = T_CHAR_TRAITS;
+        using view_type = fxstring_view<T_CHAR, T_CHAR_TRAITS>;
+        using string_type = std::basic_string<T_CHAR, T_CHAR_TRAITS>;
+
+        fxstring_glob() : m_min_length(0), m_star(false)
+        {
+            compile(view_type());
+        }
+        explicit fxstring_glob(view_type pattern) : m_min_length(0), m_star(false)
+        {
+            compile(pattern);
+        }
+
+        void compile(view_type pattern)
+        {
+            m_pattern.assign(pattern.data(), pattern.size());
+            m_tokens.clear();
+            m_sets.clear();
+            m_segments.clear();
+            m_literals.clear();
+            m_star = false;
+
+            segment seg = { 0, 0, 0, 0, 0 };
+            for (size_type i = 0; i < pattern.size(); )
+            {
+                const T_CHAR ch = pattern[i];
+                if (ch == T_CHAR('*'))
+                {
+                    m_star = true;
+                    _end_segment(seg);
+                    seg.first = m_tokens.size();
+                    while (i < pattern.size() && pattern[i] == T_CHAR('*'))
+                        ++i;
+                    continue;
+                }
+                token tok = { token::literal, ch, 0 };
+                if (ch == T_CHAR('?'))
+                {
+                    tok.kind = token::any;
+                    ++i;
+                }
+                else if (ch == T_CHAR('[') && _parse_set(pattern, i, tok))
+                {
+                }
+                else if (ch == T_CHAR('\\') && i + 1 < pattern.size())
+                {
+                    tok.ch = pattern[i + 1];
+                    i += 2;
+                }
+                else
+                {
+                    ++i;
+                }
+                m_tokens.push_back(tok);
+            }
+            _end_segment(seg);
+            m_min_length = m_tokens.size();
+        }
+
+        const string_type& pattern() const { return m_pattern; }
+        // The length that matching strings have at least, or exactly if !has_star()
+        size_type min_length() const { return m_min_length; }
+        bool has_star() const { return m_star; }
+
+        bool match(view_type str) const
+        {
+            const T_CHAR *s = str.data();
+            const size_type len = str.size();
+            if (len < m_min_length || (!m_star && len != m_min_length))
+                return false;
+            const segment& prefix = m_segments.front();
+            if (!_match_at(prefix, s))
+                return false;
+            if (!m_star)
+                return true;
+            const segment& suffix = m_segments.back();
+            const size_type end = len - suffix.count;
+            if (!_match_at(suffix, s + end))
+                return false;
+            size_type pos = prefix.count;
+            for (size_type k = 1; k + 1 < m_segments.size(); ++k)
+            {
+                const segment& seg = m_segments[k];
+                const size_type found = _find(seg, s, pos, end);
+                if (found == size_type(-1))
+                    return false;
+                pos = found + seg.count;
+            }
+            return true;
+        }
+        bool operator()(view_type str) const
+        {
+            return match(str);
+        }
+
+        //
+        // Batch matching into a bitmap of (count + 63) / 64 words, as select()
+        // in fxstring_batch.h. Bit (i % 64) of word (i / 64) is set when row i
+        // matches. Returns the number of matches.
+        //
+        template <size_t t_buf_size>
+        size_type match(const fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS> *first, size_type count,
+                        std::uint64_t *bitmap) const
+        {
+            size_type ret = 0;
+            for (size_type base = 0; base < count; base += 64)
+            {
+                const size_type n = khmz::detail::_min<size_type>(64, count - base);
+                std::uint64_t bits = 0;
+                for (size_type k = 0; k < n; ++k)
+                {
+                    const T_CHAR *row = first[base + k].data();
+                    if (match(view_type(row, detail::_bounded_length(row, t_buf_size - 1))))
+                        bits |= std::uint64_t(1) << k;
+                }
+                bitmap[base / 64] = bits;
+                ret += detail::_popcount64(bits);
+            }
+            return ret;
+        }
+        // Rows are filtered by the length column first; bitmap has column.bitmap_size() words
+        template <size_t t_buf_size>
+        size_type match(const fxstring_column<T_CHAR, t_buf_size>& column, std::uint64_t *bitmap) const
+        {
+            const std::uint32_t len = static_cast<std::uint32_t>(
+                khmz::detail::_min<size_type>(m_min_length, t_buf_size));
+            size_type ret = 0;
+            for (size_type word = 0; word < column.bitmap_size(); ++word)
+            {
+                const size_type base = word * 64;
+                const size_type count = khmz::detail::_min<size_type>(64, column.size() - base);
+                std::uint64_t bits = m_star ? detail::_match_min_lengths(column.lengths() + base, count, len)
+                                            : detail::_match_lengths(column.lengths() + base, count, len);
+                std::uint64_t result = 0;
+                while (bits)
+                {
+                    const unsigned k = detail::_ctz64(bits);
+                    bits &= bits - 1;
+                    if (match(view_type(column.data()[base + k].data(), column.lengths()[base + k])))
+                        result |= std::uint64_t(1) << k;
+                }
+                bitmap[word] = result;
+                ret += detail::_popcount64(result);
+            }
+            return ret;
+        }
+
+    protected:
+        struct token
+        {
+            enum kind_type : unsigned char { literal, any, set };
+            kind_type kind;
+            T_CHAR ch;
+            size_type set_index;
+        };
+        // A bitmap of the characters below 256, and ranges for the rest
+        struct char_set
+        {
+            std::uint64_t bits[4];
+            std::vector<std::pair<T_CHAR, T_CHAR>> ranges;
+            bool negated;
+
+            bool contains(T_CHAR ch) const
+            {
+                bool ret = false;
+                if (_code(ch) < 256)
+                {
+                    const unsigned code = static_cast<unsigned>(_code(ch));
+                    ret = (bits[code / 64] >> (code % 64)) & 1;
+                }
+                else
+                {
+                    for (const std::pair<T_CHAR, T_CHAR>& range : ranges)
+                        ret |= (_code(range.first) <= _code(ch) && _code(ch) <= _code(range.second));
+                }
+                return ret != negated;
+            }
+            void add(T_CHAR lo, T_CHAR hi)
+            {
+                for (std::uint64_t code = _code(lo); code <= _code(hi) && code < 256; ++code)
+                    bits[code / 64] |= std::uint64_t(1) << (code % 64);
+                if (_code(hi) >= 256)
+                    ranges.push_back(std::make_pair(lo, hi));
+            }
+        };
+        //
+        // Tokens [first, first + count) between stars. The longest run of
+        // literals starts at token run_offset, and its characters are
+        // copied to m_literals at literal_offset.
+        //
+        struct segment
+        {
+            size_type first;
+            size_type count;
+            size_type run_offset;
+            size_type literal_offset;
+            size_type literal_length;
+        };
+
+        string_type m_pattern;
+        std::vector<token> m_tokens;
+        std::vector<char_set> m_sets;
+        std::vector<segment> m_segments;
+        string_type m_literals;
+        size_type m_min_length;
+        bool m_star;
+
+        static std::uint64_t _code(T_CHAR ch)
+        {
+            return static_cast<std::uint64_t>(static_cast<typename std::make_unsigned<T_CHAR>::type>(ch));
+        }
+
+        // Parses [...] at pattern[i]; returns false if unterminated
+        bool _parse_set(view_type pattern, size_type& i, token& tok)
+        {
+            char_set set;
+            set.bits[0] = set.bits[1] = set.bits[2] = set.bits[3] = 0;
+            size_type j = i + 1;
+            set.negated = (j < pattern.size() && (pattern[j] == T_CHAR('!') || pattern[j] == T_CHAR('^')));
+            if (set.negated)
+                ++j;
+            const size_type members = j;
+            for (; j < pattern.size(); ++j)
+            {
+                T_CHAR lo = pattern[j];
+                if (lo == T_CHAR(']') && j > members)
+                    break;
+                if (lo == T_CHAR('\\') && j + 1 < pattern.size())
+                    lo = pattern[++j];
+                T_CHAR hi = lo;
+                if (j + 2 < pattern.size() && pattern[j + 1] == T_CHAR('-') && pattern[j + 2] != T_CHAR(']'))
+                {
+                    j += 2;
+                    hi = pattern[j];
+                    if (hi == T_CHAR('\\') && j + 1 < pattern.size())
+                        hi = pattern[++j];
+                }
+                if (_code(lo) <= _code(hi))
+                    set.add(lo, hi);
+            }
+            if (j >= pattern.size())
+                return false;
+            tok.kind = token::set;
+            tok.set_index = m_sets.size();
+            m_sets.push_back(set);
+            i = j + 1;
+            return true;
+        }
+
+        // Closes the segment of the tokens since seg.first, finding its longest literal run
+        void _end_segment(segment& seg)
+        {
+            seg.count = m_tokens.size() - seg.first;
+            size_type best = 0, best_length = 0;
+            for (size_type k = 0; k < seg.count; )
+            {
+                size_type run = 0;
+                while (k + run < seg.count && m_tokens[seg.first + k + run].kind == token::literal)
+                    ++run;
+                if (run > best_length)
+                {
+                    best = k;
+                    best_length = run;
+                }
+                k += run ? run : 1;
+            }
+            seg.run_offset = best;
+            seg.literal_offset = m_literals.size();
+            seg.literal_length = best_length;
+            for (size_type k = 0; k < best_length; ++k)
+                m_literals += m_tokens[seg.first + best + k].ch;
+            m_segments.push_back(seg);
+        }
+
+        bool _match_token(const token& tok, T_CHAR ch) const
+        {
+            switch (tok.kind)
+            {
+            case token::literal:
+                return traits_type::eq(tok.ch, ch);
+            case token::any:
+                return true;
+            default:
+                return m_sets[tok.set_index].contains(ch);
+            }
+        }
+        bool _match_at(const segment& seg, const T_CHAR *s) const
+        {
+            const token *tokens = m_tokens.data() + seg.first;
+            for (size_type k = 0; k < seg.count; ++k)
+            {
+                if (!_match_token(tokens[k], s[k]))
+                    return false;
+            }
+            return true;
+        }
+
+        // The earliest start in [pos, end - seg.count] where seg matches s, or npos
+        size_type _find(const segment& seg, const T_CHAR *s, size_type pos, size_type end) const
+        {
+            if (end < pos || end - pos < seg.count)
+                return size_type(-1);
+            const size_type last = end - seg.count;
+            if (!seg.literal_length)
+            {
+                for (size_type start = pos; start <= last; ++start)
+                {
+                    if (_match_at(seg, s + start))
+                        return start;
+                }
+                return size_type(-1);
+            }
+            const size_type run = seg.run_offset;
+            const T_CHAR *literal = m_literals.data() + seg.literal_offset;
+            const T_CHAR *from = s + pos + run;
+            const T_CHAR *limit = s + last + run + seg.literal_length;
+            while (const T_CHAR *found = detail::_glob_find_literal(from, limit - from, literal,
+                                                                   seg.literal_length, T_CHAR_TRAITS()))
+            {
+                const size_type start = (found - s) - run;
+                if (_match_at(seg, s + start))
+                    return start;
+                from = found + 1;
+            }
+            return size_type(-1);
+        }
+    }; // fxstring_glob
+
+    using fxstring_glob_a = fxstring_glob<char>;
+    using fxstring_glob_w = fxstring_glob<wchar_t>;
+
+    // Matches str against pattern, compiling it for one use
+    template <typename T_CHAR>
+    inline bool glob_match(const T_CHAR *pattern, typename fxstring_glob<T_CHAR>::view_type str)
+    {
+        return fxstring_glob<T_CHAR>(pattern).match(str);
+    }
+} // namespace khmz
@@ -0,0 +1,776 @@
+// fxstring_hybrid.h --- fxstrings that spill to the heap or an arena, and arena strings
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include "fxstring_arena.h"
+#include <atomic>           // For std::atomic
+#include <cstdarg>          // For va_list, va_copy
+#include <string>           // For std::basic_string
+
+namespace khmz
+{
+    //
+    // Spill counters, shared by all hybrid_fxstrings
+    //
+    struct fxstring_spill_counters
+    {
+        size_t spills;          // Strings that outgrew their inline buffer
+        size_t reallocations;   // External buffers that grew again
+        size_t bytes;           // Bytes taken from the memory resources
+    };
+
+    namespace detail
+    {
+        struct _spill_stats
+        {
+            std::atomic<size_t> spills;
+            std::atomic<size_t> reallocations;
+            std::atomic<size_t> bytes;
+        };
+
+        inline _spill_stats& _spill_stats_instance()
+        {
+            static _spill_stats s_stats = { { 0 }, { 0 }, { 0 } };
+            return s_stats;
+        }
+    } // namespace detail
+
+    inline fxstring_spill_counters spill_counters()
+    {
+        const detail::_spill_stats& stats = detail::_spill_stats_instance();
+        const fxstring_spill_counters ret = {
+            stats.spills.load(std::memory_order_relaxed),
+            stats.reallocations.load(std::memory_order_relaxed),
+            stats.bytes.load(std::memory_order_relaxed),
+        };
+        return ret;
+    }
+    inline void reset_spill_counters()
+    {
+        detail::_spill_stats& stats = detail::_spill_stats_instance();
+        stats.spills.store(0, std::memory_order_relaxed);
+        stats.reallocations.store(0, std::memory_order_relaxed);
+        stats.bytes.store(0, std::memory_order_relaxed);
+    }
+
+    //
+    // A string with an inline buffer of t_buf_size characters, like
+    // fxstring, that moves to a buffer from a memory resource (the heap by
+    // default, or an fxstring_arena) when a value doesn't fit, instead of
+    // truncating. The length is stored, so size() doesn't scan.
+    //
+    // The resource must outlive the string. Copies use the resource of
+    // the source; the spill_counters() count the spills of all strings
+    // with an inline buffer.
+    //
+    template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS = std::char_traits<T_CHAR>>
+    class hybrid_fxstring
+    {
+    public:
+        using self_type = hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>;
+        using value_type = T_CHAR;
+        using size_type = size_t;
+        using difference_type = std::ptrdiff_t;
+        using reference = value_type&;
+        using const_reference = const value_type&;
+        using pointer = value_type *;
+        using const_pointer = const value_type *;
+        using iterator = value_type *;
+        using const_iterator = const value_type *;
+        using traits_type = T_CHAR_TRAITS;
+        using view_type = fxstring_view<T_CHAR, T_CHAR_TRAITS>;
+
+        static constexpr size_type npos = -1;
+
+        //
+        // Constructors
+        //
+        explicit hybrid_fxstring(fxstring_memory_resource *resource = fxstring_heap())
+            : m_data(m_inline), m_size(0), m_capacity(t_buf_size - 1), m_resource(resource)
+        {
+            m_inline[0] = 0;
+        }
+        hybrid_fxstring(const value_type *str, fxstring_memory_resource *resource = fxstring_heap())
+            : hybrid_fxstring(resource)
+        {
+            assign(str);
+        }
+        hybrid_fxstring(const value_type *str, size_type count,
+                        fxstring_memory_resource *resource = fxstring_heap())
+            : hybrid_fxstring(resource)
+        {
+            assign(str, count);
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<khmz::detail::is_string_class_likely<T_STRING>::value>::type>
+        hybrid_fxstring(const T_STRING& str, fxstring_memory_resource *resource = fxstring_heap())
+            : hybrid_fxstring(resource)
+        {
+            assign(str.data(), str.size());
+        }
+        hybrid_fxstring(const self_type& str) : hybrid_fxstring(str.m_resource)
+        {
+            assign(str.data(), str.size());
+        }
+        hybrid_fxstring(self_type&& str) : hybrid_fxstring(str.m_resource)
+        {
+            _move(str);
+        }
+        ~hybrid_fxstring()
+        {
+            _free();
+        }
+
+        //
+        // Assignments
+        //
+        self_type& operator=(const self_type& str)
+        {
+            return assign(str.data(), str.size());
+        }
+        self_type& operator=(self_type&& str)
+        {
+            if (this != &str)
+            {
+                if (m_resource == str.m_resource)
+                {
+                    _free();
+                    _move(str);
+                }
+                else
+                {
+                    assign(str.data(), str.size());
+                }
+            }
+            return *this;
+        }
+        self_type& operator=(const value_type *str)
+        {
+            return assign(str);
+        }
+        self_type& operator=(value_type ch)
+        {
+            return assign(&ch, 1);
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<khmz::detail::is_string_class_likely<T_STRING>::value>::type>
+        self_type& operator=(const T_STRING& str)
+        {
+            return assign(str.data(), str.size());
+        }
+
+        self_type& assign(const value_type *str, size_type count)
+        {
+            if (count > m_capacity)
+                str = _grow(count, _contains(str) ? m_size : 0, str);
+            traits_type::move(m_data, str, count);
+            _set_size(count);
+            return *this;
+        }
+        self_type& assign(const value_type *str)
+        {
+            return assign(str, traits_type::length(str));
+        }
+        self_type& assign(size_type count, value_type ch)
+        {
+            if (count > m_capacity)
+                _grow(count, 0);
+            traits_type::assign(m_data, count, ch);
+            _set_size(count);
+            return *this;
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<khmz::detail::is_string_class_likely<T_STRING>::value>::type>
+        self_type& assign(const T_STRING& str)
+        {
+            return assign(str.data(), str.size());
+        }
+
+        //
+        // Capacity
+        //
+        bool empty() const { return !m_size; }
+        size_type size() const { return m_size; }
+        size_type length() const { return m_size; }
+        size_type capacity() const { return m_capacity; }
+        size_type max_size() const { return npos / sizeof(value_type) - 1; }
+        static constexpr size_type inline_capacity() { return t_buf_size - 1; }
+        // Whether the string has moved out of its inline buffer
+        bool spilled() const { return m_data != m_inline; }
+        fxstring_memory_resource *resource() const { return m_resource; }
+
+        void reserve(size_type count)
+        {
+            if (count > m_capacity)
+                _grow(count, m_size);
+        }
+        void clear()
+        {
+            _set_size(0);
+        }
+        void resize(size_type count, value_type ch = value_type())
+        {
+            if (count > m_size)
+            {
+                reserve(count);
+                traits_type::assign(m_data + m_size, count - m_size, ch);
+            }
+            _set_size(count);
+        }
+
+        //
+        // Element access
+        //
+        pointer data() { return m_data; }
+        const_pointer data() const { return m_data; }
+        const_pointer c_str() const { return m_data; }
+        reference operator[](size_type index)
+        {
+            assert(index <= m_size);
+            return m_data[index];
+        }
+        const_reference operator[](size_type index) const
+        {
+            assert(index <= m_size);
+            return m_data[index];
+        }
+        reference at(size_type index)
+        {
+            if (index >= m_size)
+                throw std::out_of_range("khmz::hybrid_fxstring::at");
+            return m_data[index];
+        }
+        const_reference at(size_type index) const
+        {
+            if (index >= m_size)
+                throw std::out_of_range("khmz::hybrid_fxstring::at");
+            return m_data[index];
+        }
+        reference front() { return m_data[0]; }
+        const_reference front() const { return m_data[0]; }
+        reference back() { return m_data[m_size - 1]; }
+        const_reference back() const { return m_data[m_size - 1]; }
+
+              iterator begin()        { return m_data; }
+        const_iterator begin()  const { return m_data; }
+              iterator end()          { return m_data + m_size; }
+        const_iterator end()    const { return m_data + m_size; }
+        const_iterator cbegin() const { return begin(); }
+        const_iterator cend()   const { return end(); }
+
+        view_type view() const { return view_type(m_data, m_size); }
+        operator view_type() const { return view(); }
+
+        //
+        // Appending
+        //
+        self_type& append(const value_type *str, size_type count)
+        {
+            if (m_size + count > m_capacity)
+                str = _grow(m_size + count, m_size, str);
+            traits_type::move(m_data + m_size, str, count);
+            _set_size(m_size + count);
+            return *this;
+        }
+        self_type& append(const value_type *str)
+        {
+            return append(str, traits_type::length(str));
+        }
+        self_type& append(size_type count, value_type ch)
+        {
+            reserve(m_size + count);
+            traits_type::assign(m_data + m_size, count, ch);
+            _set_size(m_size + count);
+            return *this;
+        }
+        self_type& append(value_type ch)
+        {
+            return append(1, ch);
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<khmz::detail::is_string_class_likely<T_STRING>::value>::type>
+        self_type& append(const T_STRING& str)
+        {
+            return append(str.data(), str.size());
+        }
+        self_type& operator+=(const value_type *str)
+        {
+            return append(str);
+        }
+        self_type& operator+=(value_type ch)
+        {
+            return append(ch);
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<khmz::detail::is_string_class_likely<T_STRING>::value>::type>
+        self_type& operator+=(const T_STRING& str)
+        {
+            return append(str);
+        }
+        void push_back(value_type ch)
+        {
+            append(1, ch);
+        }
+        void pop_back()
+        {
+            assert(m_size);
+            _set_size(m_size - 1);
+        }
+
+        //
+        // Insertion, erasure and replacement, growing instead of truncating.
+        // An index past size() throws std::out_of_range, as in fxstring.
+        //
+        self_type& insert(size_type index, const value_type *str, size_type count)
+        {
+            return _replace(index, 0, str, count, "khmz::hybrid_fxstring::insert");
+        }
+        self_type& insert(size_type index, const value_type *str)
+        {
+            return insert(index, str, traits_type::length(str));
+        }
+        self_type& insert(size_type index, size_type count, value_type ch)
+        {
+            _open(index, 0, count, "khmz::hybrid_fxstring::insert");
+            traits_type::assign(m_data + index, count, ch);
+            return *this;
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<khmz::detail::is_string_class_likely<T_STRING>::value>::type>
+        self_type& insert(size_type index, const T_STRING& str)
+        {
+            return insert(index, str.data(), str.size());
+        }
+        self_type& insert(const_iterator pos, value_type ch)
+        {
+            return insert(pos - cbegin(), 1, ch);
+        }
+
+        self_type& erase(size_type index = 0, size_type count = npos)
+        {
+            _open(index, count, 0, "khmz::hybrid_fxstring::erase");
+            return *this;
+        }
+        iterator erase(const_iterator position)
+        {
+            return erase(position, position + 1);
+        }
+        iterator erase(const_iterator first, const_iterator last)
+        {
+            const size_type index = first - cbegin();
+            erase(index, last - first);
+            return begin() + index;
+        }
+
+        self_type& replace(size_type index, size_type count, const value_type *str, size_type str_len)
+        {
+            return _replace(index, count, str, str_len, "khmz::hybrid_fxstring::replace");
+        }
+        self_type& replace(size_type index, size_type count, const value_type *str)
+        {
+            return replace(index, count, str, traits_type::length(str));
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<khmz::detail::is_string_class_likely<T_STRING>::value>::type>
+        self_type& replace(size_type index, size_type count, const T_STRING& str)
+        {
+            return replace(index, count, str.data(), str.size());
+        }
+        self_type& replace(const_iterator first, const_iterator last, const value_type *str)
+        {
+            return replace(first - cbegin(), last - first, str);
+        }
+        template <typename T_STRING,
+                  typename = typename std::enable_if<khmz::detail::is_string_class_likely<T_STRING>::value>::type>
+        self_type& replace(const_iterator first, const_iterator last, const T_STRING& str)
+        {
+            return replace(first - cbegin(), last - first, str.data(), str.size());
+        }
+
+        //
+        // Swapping. Each string keeps its resource; the buffers are exchanged
+        // when the resources are the same, and the values copied otherwise.
+        //
+        void swap(self_type& str)
+        {
+            if (this == &str)
+                return;
+            self_type tmp(std::move(*this));
+            *this = std::move(str);
+            str = std::move(tmp);
+        }
+
+        //
+        // Formatting. The output is formatted into the current buffer and,
+        // if it did not fit, again after growing to the reported length.
+        //
+        int printf(const value_type *format, ...)
+        {
+            va_list va;
+            va_start(va, format);
+            const int ret = vprintf(format, va);
+            va_end(va);
+            return ret;
+        }
+        int vprintf(const value_type *format, va_list va)
+        {
+            for (;;)
+            {
+                va_list args;
+                va_copy(args, va);
+                const int ret = detail::_vsnprintf(m_data, m_capacity + 1, format, args);
+                va_end(args);
+                if (ret >= 0 && static_cast<size_type>(ret) <= m_capacity)
+                {
+                    _set_size(ret);
+                    return ret;
+                }
+                // vsnprintf tells the length. vswprintf only fails, as it does on
+                // errors, so it is retried with doubled capacity up to a limit.
+                if (ret < 0 && m_capacity >= s_max_wide_format)
+                {
+                    _set_size(0);
+                    return ret;
+                }
+                _grow(ret >= 0 ? static_cast<size_type>(ret) : m_capacity * 2 + 1, 0);
+            }
+        }
+
+        //
+        // Comparison and search, as fxstring_view
+        //
+        int compare(view_type str) const { return view().compare(str); }
+        bool starts_with(view_type str) const { return view().starts_with(str); }
+        bool ends_with(view_type str) const { return view().ends_with(str); }
+        size_type find(value_type ch, size_type pos = 0) const { return view().find(ch, pos); }
+        size_type find(view_type str, size_type pos = 0) const { return view().find(str, pos); }
+        size_type rfind(value_type ch, size_type pos = npos) const { return view().rfind(ch, pos); }
+        size_type rfind(view_type str, size_type pos = npos) const { return view().rfind(str, pos); }
+        size_type find_first_of(value_type ch, size_type pos = 0) const
+        {
+            return view().find(ch, pos);
+        }
+        size_type find_first_not_of(value_type ch, size_type pos = 0) const
+        {
+            return view().find_first_not_of(view_type(&ch, 1), pos);
+        }
+        size_type find_last_of(value_type ch, size_type pos = npos) const
+        {
+            return view().rfind(ch, pos);
+        }
+        size_type find_last_not_of(value_type ch, size_type pos = npos) const
+        {
+            return view().find_last_not_of(view_type(&ch, 1), pos);
+        }
+        size_type find_first_of(view_type set, size_type pos = 0) const
+        {
+            return view().find_first_of(set, pos);
+        }
+        size_type find_first_not_of(view_type set, size_type pos = 0) const
+        {
+            return view().find_first_not_of(set, pos);
+        }
+        size_type find_last_of(view_type set, size_type pos = npos) const
+        {
+            return view().find_last_of(set, pos);
+        }
+        size_type find_last_not_of(view_type set, size_type pos = npos) const
+        {
+            return view().find_last_not_of(set, pos);
+        }
+        std::basic_string<T_CHAR> substr(size_type pos = 0, size_type count = npos) const
+        {
+            const view_type ret = view().substr(pos, count);
+            return std::basic_string<T_CHAR>(ret.data(), ret.size());
+        }
+
+
+    protected:
+        value_type *m_data;
+        size_type m_size;
+        size_type m_capacity;
+        fxstring_memory_resource *m_resource;
+        value_type m_inline[t_buf_size];
+
+        void _set_size(size_type count)
+        {
+            m_size = count;
+            m_data[count] = 0;
+        }
+
+        static constexpr size_type s_max_wide_format = 1 << 20;
+
+        bool _contains(const value_type *str) const
+        {
+            return m_data <= str && str <= m_data + m_capacity;
+        }
+
+        // Replaces count characters at index with len characters of str
+        self_type& _replace(size_type index, size_type count, const value_type *str, size_type len,
+                            const char *name)
+        {
+            if (_contains(str))
+            {
+                // The gap would move the characters of str
+                const std::basic_string<T_CHAR, T_CHAR_TRAITS> copy(str, len);
+                return _replace(index, count, copy.data(), len, name);
+            }
+            _open(index, count, len, name);
+            traits_type::copy(m_data + index, str, len);
+            return *this;
+        }
+        // Replaces count characters at index with a gap of len characters, growing as needed
+        void _open(size_type index, size_type count, size_type len, const char *name)
+        {
+            if (index > m_size)
+                throw std::out_of_range(name);
+            count = khmz::detail::_min(count, m_size - index);
+            const size_type new_size = m_size - count + len;
+            if (new_size > m_capacity)
+                _grow(new_size, m_size);
+            traits_type::move(m_data + index + len, m_data + index + count, m_size - index - count);
+            _set_size(new_size);
+        }
+
+        //
+        // Moves to a buffer of at least count characters, keeping the first
+        // keep characters. Returns str, moved along if it pointed into the
+        // old buffer.
+        //
+        const value_type *_grow(size_type count, size_type keep, const value_type *str = nullptr)
+        {
+            const size_type capacity = (count > m_capacity * 2) ? count : m_capacity * 2;
+            // Strings without an inline buffer, as arena_fxstring, don't spill and aren't counted
+            const bool counted = (t_buf_size > 1);
+            detail::_spill_stats& stats = detail::_spill_stats_instance();
+            if (counted)
+                (spilled() ? stats.reallocations : stats.spills).fetch_add(1, std::memory_order_relaxed);
+            if (spilled() && m_resource->extend(m_data, (m_capacity + 1) * sizeof(value_type),
+                                                (capacity + 1) * sizeof(value_type)))
+            {
+                if (counted)
+                    stats.bytes.fetch_add((capacity - m_capacity) * sizeof(value_type), std::memory_order_relaxed);
+                m_capacity = capacity;
+                return str;
+            }
+            value_type *data = static_cast<value_type *>(
+                m_resource->allocate((capacity + 1) * sizeof(value_type), alignof(value_type)));
+            if (counted)
+                stats.bytes.fetch_add((capacity + 1) * sizeof(value_type), std::memory_order_relaxed);
+
+            traits_type::copy(data, m_data, keep);
+            if (_contains(str))
+                str = data + (str - m_data);
+            _free();
+            m_data = data;
+            m_capacity = capacity;
+            return str;
+        }
+        void _free()
+        {
+            if (spilled())
+                m_resource->deallocate(m_data, (m_capacity + 1) * sizeof(value_type), alignof(value_type));
+            m_data = m_inline;
+            m_capacity = t_buf_size - 1;
+        }
+
+        void _move(self_type& str)
+        {
+            if (str.spilled())
+            {
+                m_data = str.m_data;
+                m_size = str.m_size;
+                m_capacity = str.m_capacity;
+                str.m_data = str.m_inline;
+                str.m_capacity = t_buf_size - 1;
+                str._set_size(0);
+            }
+            else
+            {
+                m_data = m_inline;
+                m_capacity = t_buf_size - 1;
+                assign(str.data(), str.size());
+            }
+        }
+    }; // hybrid_fxstring
+
+    //
+    // Comparison with anything that converts to fxstring_view
+    //
+    namespace detail
+    {
+        // Whether T is or derives from a hybrid_fxstring
+        template <typename T>
+        struct _is_hybrid
+        {
+            template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+            static std::true_type test(const hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS> *);
+            static std::false_type test(...);
+
+            static constexpr bool value = decltype(test(static_cast<const T *>(nullptr)))::value;
+        };
+
+        template <typename T_HYBRID, typename T_OTHER>
+        struct _hybrid_comparable
+            : std::enable_if<std::is_convertible<const T_OTHER&, typename T_HYBRID::view_type>::value, bool>
+        {
+        };
+        // Excludes hybrid_fxstrings as the left operand, which the other overload takes
+        template <typename T_HYBRID, typename T_OTHER>
+        struct _hybrid_comparable_reversed
+            : std::enable_if<std::is_convertible<const T_OTHER&, typename T_HYBRID::view_type>::value &&
+                             !_is_hybrid<T_OTHER>::value, bool>
+        {
+        };
+    } // namespace detail
+
+    template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS, typename T_OTHER>
+    inline typename detail::_hybrid_comparable<hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_OTHER>::type
+    operator==(const hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str1, const T_OTHER& str2)
+    {
+        return str1.view() == fxstring_view<T_CHAR, T_CHAR_TRAITS>(str2);
+    }
+    template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS, typename T_OTHER>
+    inline typename detail::_hybrid_comparable<hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_OTHER>::type
+    operator!=(const hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str1, const T_OTHER& str2)
+    {
+        return str1.view() != fxstring_view<T_CHAR, T_CHAR_TRAITS>(str2);
+    }
+    template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS, typename T_OTHER>
+    inline typename detail::_hybrid_comparable<hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_OTHER>::type
+    operator<(const hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str1, const T_OTHER& str2)
+    {
+        return str1.view() < fxstring_view<T_CHAR, T_CHAR_TRAITS>(str2);
+    }
+    template <typename T_OTHER, typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+    inline typename detail::_hybrid_comparable_reversed<hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_OTHER>::type
+    operator==(const T_OTHER& str1, const hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str2)
+    {
+        return fxstring_view<T_CHAR, T_CHAR_TRAITS>(str1) == str2.view();
+    }
+    template <typename T_OTHER, typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+    inline typename detail::_hybrid_comparable_reversed<hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_OTHER>::type
+    operator!=(const T_OTHER& str1, const hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str2)
+    {
+        return fxstring_view<T_CHAR, T_CHAR_TRAITS>(str1) != str2.view();
+    }
+    template <typename T_OTHER, typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+    inline typename detail::_hybrid_comparable_reversed<hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_OTHER>::type
+    operator<(const T_OTHER& str1, const hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str2)
+    {
+        return fxstring_view<T_CHAR, T_CHAR_TRAITS>(str1) < str2.view();
+    }
+
+    template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS, typename T_OTHER>
+    inline typename detail::_hybrid_comparable<hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_OTHER>::type
+    operator>(const hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str1, const T_OTHER& str2)
+    {
+        return fxstring_view<T_CHAR, T_CHAR_TRAITS>(str2) < str1.view();
+    }
+    template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS, typename T_OTHER>
+    inline typename detail::_hybrid_comparable<hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_OTHER>::type
+    operator<=(const hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str1, const T_OTHER& str2)
+    {
+        return !(fxstring_view<T_CHAR, T_CHAR_TRAITS>(str2) < str1.view());
+    }
+    template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS, typename T_OTHER>
+    inline typename detail::_hybrid_comparable<hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_OTHER>::type
+    operator>=(const hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str1, const T_OTHER& str2)
+    {
+        return !(str1.view() < fxstring_view<T_CHAR, T_CHAR_TRAITS>(str2));
+    }
+    template <typename T_OTHER, typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+    inline typename detail::_hybrid_comparable_reversed<hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_OTHER>::type
+    operator>(const T_OTHER& str1, const hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str2)
+    {
+        return str2.view() < fxstring_view<T_CHAR, T_CHAR_TRAITS>(str1);
+    }
+    template <typename T_OTHER, typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+    inline typename detail::_hybrid_comparable_reversed<hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_OTHER>::type
+    operator<=(const T_OTHER& str1, const hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str2)
+    {
+        return !(str2.view() < fxstring_view<T_CHAR, T_CHAR_TRAITS>(str1));
+    }
+    template <typename T_OTHER, typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+    inline typename detail::_hybrid_comparable_reversed<hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>, T_OTHER>::type
+    operator>=(const T_OTHER& str1, const hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str2)
+    {
+        return !(fxstring_view<T_CHAR, T_CHAR_TRAITS>(str1) < str2.view());
+    }
+
+    template <size_t t_buf_size>
+    using hybrid_fxstring_a = hybrid_fxstring<char, t_buf_size>;
+    template <size_t t_buf_size>
+    using hybrid_fxstring_w = hybrid_fxstring<wchar_t, t_buf_size>;
+
+    //
+    // A string of any length whose storage comes from an fxstring_arena,
+    // for per-request scratch strings. It is a hybrid_fxstring without an
+    // inline buffer: the same API, search and formatting code, and growing
+    // in place while it is the arena's last allocation. Copying it into an
+    // fxstring copies size() characters, without scanning.
+    //
+    // The arena must outlive the string, or at least its use; strings need
+    // not be destroyed before the arena is reset or rewound.
+    //
+    template <typename T_CHAR, typename T_CHAR_TRAITS = std::char_traits<T_CHAR>>
+    class arena_fxstring : public hybrid_fxstring<T_CHAR, 1, T_CHAR_TRAITS>
+    {
+    public:
+        using base_type = hybrid_fxstring<T_CHAR, 1, T_CHAR_TRAITS>;
+        using value_type = T_CHAR;
+        using size_type = size_t;
+        using view_type = fxstring_view<T_CHAR, T_CHAR_TRAITS>;
+
+        explicit arena_fxstring(fxstring_arena& arena) : base_type(&arena)
+        {
+        }
+        arena_fxstring(fxstring_arena& arena, view_type str) : base_type(&arena)
+        {
+            this->assign(str.data(), str.size());
+        }
+        arena_fxstring(fxstring_arena& arena, size_type capacity) : base_type(&arena)
+        {
+            this->reserve(capacity);
+        }
+
+        using base_type::operator=;
+
+        fxstring_arena& arena() const { return *static_cast<fxstring_arena *>(this->m_resource); }
+    }; // arena_fxstring
+
+    using arena_fxstring_a = arena_fxstring<char>;
+    using arena_fxstring_w = arena_fxstring<wchar_t>;
+} // namespace khmz
+
+namespace std
+{
+    //
+    // Swapping
+    //
+    template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+    inline void swap(khmz::hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str1,
+                     khmz::hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str2)
+    {
+        str1.swap(str2);
+    }
+
+    //
+    // Hash. Equals that of an fxstring<T_CHAR, t_buf_size> of the same value.
+    //
+    template <typename T_CHAR, size_t t_buf_size, typename T_CHAR_TRAITS>
+    struct hash<khmz::hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>>
+    {
+        inline size_t operator()(const khmz::hybrid_fxstring<T_CHAR, t_buf_size, T_CHAR_TRAITS>& str) const
+        {
+            return khmz::detail::_hash(t_buf_size - 1, str.data(), str.size());
+        }
+    };
+    template <typename T_CHAR, typename T_CHAR_TRAITS>
+    struct hash<khmz::arena_fxstring<T_CHAR, T_CHAR_TRAITS>>
+        : hash<khmz::hybrid_fxstring<T_CHAR, 1, T_CHAR_TRAITS>>
+    {
+    };
+} // namespace std
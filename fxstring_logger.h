@@ -0,0 +1,356 @@
+// fxstring_logger.h --- asynchronous logger with deferred formatting
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include "fxstring_queue.h"
+#include <atomic>           // For std::atomic
+#include <chrono>           // For std::chrono::system_clock
+#include <cstdarg>          // For va_list
+#include <cstdint>          // For std::int64_t
+#include <cstdio>           // For std::FILE, std::vsnprintf
+#include <cstring>          // For std::memcpy
+#include <ctime>            // For std::tm
+#include <thread>           // For std::thread
+#include <tuple>            // For std::tuple
+#include <type_traits>      // For std::decay
+#include <vector>           // For std::vector
+
+namespace khmz
+{
+    namespace detail
+    {
+        template <size_t... t_indexes>
+        struct _index_sequence
+        {
+        };
+        template <size_t t_count, size_t... t_indexes>
+        struct _make_index_sequence : _make_index_sequence<t_count - 1, t_count - 1, t_indexes...>
+        {
+        };
+        template <size_t... t_indexes>
+        struct _make_index_sequence<0, t_indexes...>
+        {
+            using type = _index_sequence<t_indexes...>;
+        };
+
+        //
+        // Captured arguments. Strings are copied into fxstrings of
+        // t_string_size; other arguments must be scalars, captured as they are.
+        //
+        template <typename T, size_t t_string_size, typename = void>
+        struct _log_capture
+        {
+            static_assert(std::is_scalar<T>::value, "unsupported type of log argument");
+            using type = T;
+        };
+        template <size_t t_string_size>
+        struct _log_capture<const char *, t_string_size>
+        {
+            using type = fxstring<char, t_string_size>;
+        };
+        template <size_t t_string_size>
+        struct _log_capture<char *, t_string_size>
+        {
+            using type = fxstring<char, t_string_size>;
+        };
+        template <typename T, size_t t_string_size>
+        struct _log_capture<T, t_string_size,
+                            typename std::enable_if<is_string_class_likely<T>::value>::type>
+        {
+            static_assert(std::is_same<typename T::value_type, char>::value, "log strings must be of char");
+            using type = fxstring<char, t_string_size>;
+        };
+
+        template <typename T>
+        inline const T& _log_value(const T& value)
+        {
+            return value;
+        }
+        template <size_t t_buf_size>
+        inline const char *_log_value(const fxstring<char, t_buf_size>& str)
+        {
+            return str.c_str();
+        }
+
+        template <size_t t_buf_size>
+        inline fxstring<char, t_buf_size> _log_store(const char *str)
+        {
+            return fxstring<char, t_buf_size>(str ? str : "(null)");
+        }
+        template <size_t t_buf_size, typename T_STRING,
+                  typename = typename std::enable_if<is_string_class_likely<T_STRING>::value>::type>
+        inline fxstring<char, t_buf_size> _log_store(const T_STRING& str)
+        {
+            return fxstring<char, t_buf_size>(str.data(), str.size());
+        }
+        template <size_t t_buf_size, typename T,
+                  typename = typename std::enable_if<std::is_scalar<T>::value &&
+                                                     !std::is_same<T, char *>::value>::type>
+        inline T _log_store(T value)
+        {
+            return value;
+        }
+
+        inline int _log_vsnprintf(char *dest, size_t size, const char *format, ...)
+        {
+            va_list va;
+            va_start(va, format);
+            const int ret = std::vsnprintf(dest, size, format, va);
+            va_end(va);
+            return ret;
+        }
+
+        // Formats a captured std::tuple of arguments into dest
+        template <typename T_TUPLE, size_t... t_indexes>
+        inline int _log_format(char *dest, size_t size, const char *format, const void *args,
+                               _index_sequence<t_indexes...>)
+        {
+            const T_TUPLE& tuple = *static_cast<const T_TUPLE *>(args);
+            (void)tuple;
+            return _log_vsnprintf(dest, size, format, _log_value(std::get<t_indexes>(tuple))...);
+        }
+        template <typename T_TUPLE>
+        inline int _log_format(char *dest, size_t size, const char *format, const void *args)
+        {
+            return _log_format<T_TUPLE>(dest, size, format, args,
+                                        typename _make_index_sequence<std::tuple_size<T_TUPLE>::value>::type());
+        }
+
+        template <size_t t_args_size>
+        struct alignas(_cache_line_size) _log_slot
+        {
+            std::atomic<size_t> sequence;
+            std::int64_t time;          // Microseconds since the epoch
+            int level;
+            const char *format;
+            int (*formatter)(char *dest, size_t size, const char *format, const void *args);
+            alignas(std::max_align_t) unsigned char args[t_args_size];
+        };
+
+        // Writes value as width decimal digits, with leading zeros
+        inline void _log_digits(char *dest, unsigned value, int width)
+        {
+            for (int i = width - 1; i >= 0; --i, value /= 10)
+                dest[i] = static_cast<char>('0' + value % 10);
+        }
+
+        // "YYYY-MM-DD HH:MM:SS.uuuuuu" into dest[27]
+        inline void _log_time(char *dest, std::int64_t time)
+        {
+            const std::time_t seconds = static_cast<std::time_t>(time / 1000000);
+            std::tm tm;
+#ifdef _WIN32
+            gmtime_s(&tm, &seconds);
+#else
+            gmtime_r(&seconds, &tm);
+#endif
+            std::memcpy(dest, "0000-00-00 00:00:00.000000", 27);
+            _log_digits(dest, tm.tm_year + 1900, 4);
+            _log_digits(dest + 5, tm.tm_mon + 1, 2);
+            _log_digits(dest + 8, tm.tm_mday, 2);
+            _log_digits(dest + 11, tm.tm_hour, 2);
+            _log_digits(dest + 14, tm.tm_min, 2);
+            _log_digits(dest + 17, tm.tm_sec, 2);
+            _log_digits(dest + 20, static_cast<unsigned>(time % 1000000), 6);
+        }
+    } // namespace detail
+
+    //
+    // Asynchronous logger. A call captures the format pointer and a copy of
+    // the arguments into a fixed-size record in a lock-free ring, without
+    // formatting, blocking or allocating; when the ring is full the record is
+    // dropped and counted. A background thread formats the records and
+    // writes them to the FILE* in batches.
+    //
+    // The format must outlive the logger, as string literals do. String
+    // arguments are copied and truncated to t_string_size - 1 characters.
+    // Each line is "<UTC time> <level> <message>\n", truncated to t_line_size.
+    //
+    template <size_t t_args_size = 192, size_t t_string_size = 64, size_t t_line_size = 512>
+    class fxstring_logger
+    {
+    public:
+        using size_type = size_t;
+
+        enum level_type
+        {
+            debug,
+            info,
+            warning,
+            error
+        };
+
+        explicit fxstring_logger(std::FILE *fp = stderr, size_type capacity = 4096)
+            : m_fp(fp), m_ring(capacity), m_level(info), m_dropped(0), m_written(0), m_stop(false)
+        {
+            m_thread = std::thread(&fxstring_logger::_run, this);
+        }
+        ~fxstring_logger()
+        {
+            stop();
+        }
+        fxstring_logger(const fxstring_logger&) = delete;
+        fxstring_logger& operator=(const fxstring_logger&) = delete;
+
+        //
+        // Logging. Returns false if the level is filtered out or the record
+        // was dropped.
+        //
+        template <typename... T_ARGS>
+        bool log(level_type level, const char *format, const T_ARGS&... args)
+        {
+            using tuple_type = std::tuple<typename detail::_log_capture<typename std::decay<T_ARGS>::type,
+                                                                        t_string_size>::type...>;
+            static_assert(sizeof(tuple_type) <= t_args_size, "log arguments are too large for the record");
+            static_assert(std::is_trivially_destructible<tuple_type>::value, "log arguments must be trivial");
+
+            if (level < m_level.load(std::memory_order_relaxed))
+                return false;
+            size_type pos;
+            if (!m_ring.claim_push(1, pos))
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            slot_type& slot = m_ring.slot(pos);
+            slot.time = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            slot.level = level;
+            slot.format = format;
+            slot.formatter = &detail::_log_format<tuple_type>;
+            new(slot.args) tuple_type(detail::_log_store<t_string_size>(args)...);
+            m_ring.publish_push(pos);
+            return true;
+        }
+        template <typename... T_ARGS>
+        bool log_debug(const char *format, const T_ARGS&... args)
+        {
+            return log(debug, format, args...);
+        }
+        template <typename... T_ARGS>
+        bool log_info(const char *format, const T_ARGS&... args)
+        {
+            return log(info, format, args...);
+        }
+        template <typename... T_ARGS>
+        bool log_warning(const char *format, const T_ARGS&... args)
+        {
+            return log(warning, format, args...);
+        }
+        template <typename... T_ARGS>
+        bool log_error(const char *format, const T_ARGS&... args)
+        {
+            return log(error, format, args...);
+        }
+
+        //
+        // Control
+        //
+        void set_level(level_type level) { m_level.store(level, std::memory_order_relaxed); }
+        level_type level() const { return m_level.load(std::memory_order_relaxed); }
+        // The number of records dropped because the ring was full
+        size_type dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+        // The number of records written
+        size_type written() const { return m_written.load(std::memory_order_acquire); }
+
+        // Waits until the records logged so far are written. This blocks,
+        // so it is meant for shutdown and tests.
+        void flush()
+        {
+            const size_type target = m_ring.push_position();
+            // Dropped records take no positions, so each position is written
+            while (m_written.load(std::memory_order_acquire) < target)
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        // Writes the remaining records and stops the thread
+        void stop()
+        {
+            if (!m_thread.joinable())
+                return;
+            m_stop.store(true, std::memory_order_release);
+            m_thread.join();
+        }
+
+    protected:
+        using slot_type = detail::_log_slot<t_args_size>;
+        static constexpr size_type s_batch_size = 64;
+        static constexpr size_type s_buffer_size = 64 * 1024;
+
+        std::FILE *m_fp;
+        detail::_sequence_ring<slot_type> m_ring;
+        std::atomic<level_type> m_level;
+        std::atomic<size_type> m_dropped;
+        std::atomic<size_type> m_written;
+        std::atomic<bool> m_stop;
+        std::thread m_thread;
+
+        void _run()
+        {
+            static const char *const s_level_names[] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+            std::vector<char> buffer(s_buffer_size);
+            std::int64_t last_second = -1;
+            char time_text[32] = "";
+            unsigned idle = 0;
+            for (;;)
+            {
+                // Checked before draining, so that records logged before stop() are written
+                const bool stopping = m_stop.load(std::memory_order_acquire);
+                size_type used = 0, count = 0;
+                size_type pos, n;
+                while ((n = m_ring.claim_pop(s_batch_size, pos)) != 0)
+                {
+                    for (size_type i = 0; i < n; ++i)
+                    {
+                        slot_type& slot = m_ring.slot(pos + i);
+                        if (slot.time / 1000000 != last_second)
+                        {
+                            detail::_log_time(time_text, slot.time);
+                            last_second = slot.time / 1000000;
+                        }
+                        else
+                        {
+                            detail::_log_digits(time_text + 20, static_cast<unsigned>(slot.time % 1000000), 6);
+                        }
+                        if (s_buffer_size - used < t_line_size)
+                        {
+                            std::fwrite(buffer.data(), 1, used, m_fp);
+                            used = 0;
+                        }
+                        char *line = buffer.data() + used;
+                        int len = std::snprintf(line, t_line_size, "%s %s ", time_text, s_level_names[slot.level]);
+                        if (len > 0 && static_cast<size_type>(len) < t_line_size - 1)
+                        {
+                            const int msg = slot.formatter(line + len, t_line_size - 1 - len, slot.format, slot.args);
+                            len += (msg < 0) ? 0 : static_cast<int>(khmz::detail::_min<size_type>(msg, t_line_size - 2 - len));
+                        }
+                        else
+                        {
+                            len = static_cast<int>(t_line_size - 2);
+                        }
+                        line[len] = '\n';
+                        used += len + 1;
+                        m_ring.publish_pop(pos + i);
+                    }
+                    count += n;
+                }
+                if (count)
+                {
+                    std::fwrite(buffer.data(), 1, used, m_fp);
+                    std::fflush(m_fp);
+                    m_written.fetch_add(count, std::memory_order_release);
+                    idle = 0;
+                    continue;
+                }
+                if (stopping)
+                    break;
+                // Back off while idle; callers never wait for this thread
+                if (++idle < 64)
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(500));
+            }
+        }
+    }; // fxstring_logger
+} // namespace khmz
@@ -0,0 +1,365 @@
+// fxstring_queue.h --- bounded lock-free queues of fxstrings
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include <atomic>           // For std::atomic
+#include <cstdint>          // For std::uint32_t, std::uintptr_t
+#include <memory>           // For std::unique_ptr
+#include <new>              // For placement new
+
+namespace khmz
+{
+    namespace detail
+    {
+        // The assumed size of a cache line
+        static constexpr size_t _cache_line_size = 64;
+
+        // The message slot: the length and the used prefix of the string
+        template <typename T_CHAR, size_t t_buf_size, bool t_sequenced>
+        struct alignas(_cache_line_size) _queue_slot
+        {
+            std::uint32_t length;
+            T_CHAR data[t_buf_size];
+        };
+        template <typename T_CHAR, size_t t_buf_size>
+        struct alignas(_cache_line_size) _queue_slot<T_CHAR, t_buf_size, true>
+        {
+            std::atomic<size_t> sequence;
+            std::uint32_t length;
+            T_CHAR data[t_buf_size];
+        };
+
+        // An array of count slots aligned to cache lines
+        template <typename T_SLOT>
+        class _slot_array
+        {
+        public:
+            explicit _slot_array(size_t count)
+                : m_storage(new unsigned char[count * sizeof(T_SLOT) + alignof(T_SLOT)]), m_count(count)
+            {
+                void *p = m_storage.get();
+                const size_t misalign = reinterpret_cast<std::uintptr_t>(p) % alignof(T_SLOT);
+                m_slots = reinterpret_cast<T_SLOT *>(m_storage.get() + (misalign ? alignof(T_SLOT) - misalign : 0));
+                for (size_t i = 0; i < count; ++i)
+                    new(&m_slots[i]) T_SLOT();
+            }
+            ~_slot_array()
+            {
+                for (size_t i = 0; i < m_count; ++i)
+                    m_slots[i].~T_SLOT();
+            }
+            _slot_array(const _slot_array&) = delete;
+            _slot_array& operator=(const _slot_array&) = delete;
+
+            T_SLOT& operator[](size_t index) { return m_slots[index]; }
+
+        protected:
+            std::unique_ptr<unsigned char[]> m_storage;
+            T_SLOT *m_slots;
+            size_t m_count;
+        };
+
+        template <typename T_SLOT, typename T_CHAR>
+        inline void _queue_store(T_SLOT& slot, const T_CHAR *str, size_t len)
+        {
+            slot.length = static_cast<std::uint32_t>(len);
+            std::char_traits<T_CHAR>::copy(slot.data, str, len);
+        }
+        template <typename T_SLOT, typename T_CHAR, size_t t_buf_size>
+        inline void _queue_load(fxstring<T_CHAR, t_buf_size>& str, const T_SLOT& slot)
+        {
+            std::char_traits<T_CHAR>::copy(str.data(), slot.data, slot.length);
+            str[slot.length] = 0;
+        }
+
+        inline bool _is_power_of_two(size_t value)
+        {
+            return value && !(value & (value - 1));
+        }
+    } // namespace detail
+
+    //
+    // Single-producer single-consumer bounded queue. Each message copies only
+    // the used prefix of the string. The capacity must be a power of two.
+    //
+    template <typename T_CHAR, size_t t_buf_size>
+    class fxstring_spsc_queue
+    {
+    public:
+        using value_type = fxstring<T_CHAR, t_buf_size>;
+        using size_type = size_t;
+
+        explicit fxstring_spsc_queue(size_type capacity)
+            : m_slots(capacity), m_mask(capacity - 1), m_head(0), m_cached_tail(0), m_tail(0), m_cached_head(0)
+        {
+            assert(detail::_is_power_of_two(capacity));
+        }
+        fxstring_spsc_queue(const fxstring_spsc_queue&) = delete;
+        fxstring_spsc_queue& operator=(const fxstring_spsc_queue&) = delete;
+
+        size_type capacity() const { return m_mask + 1; }
+        // Approximate when called concurrently
+        size_type size() const
+        {
+            const size_type head = m_head.load(std::memory_order_acquire);
+            return m_tail.load(std::memory_order_acquire) - head;
+        }
+        bool empty() const { return size() == 0; }
+
+        //
+        // Producer. Strings longer than max_size are truncated.
+        //
+        bool try_push(const T_CHAR *str, size_type len)
+        {
+            const size_type tail = m_tail.load(std::memory_order_relaxed);
+            if (!_room(tail, 1))
+                return false;
+            detail::_queue_store(m_slots[tail & m_mask], str, khmz::detail::_min(len, s_max_size));
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        bool try_push(const value_type& str)
+        {
+            return try_push(str.data(), str.size());
+        }
+        // Pushes up to count strings and returns the number pushed
+        size_type try_push(const value_type *items, size_type count)
+        {
+            const size_type tail = m_tail.load(std::memory_order_relaxed);
+            const size_type n = _room(tail, count);
+            for (size_type i = 0; i < n; ++i)
+                detail::_queue_store(m_slots[(tail + i) & m_mask], items[i].data(), items[i].size());
+            if (n)
+                m_tail.store(tail + n, std::memory_order_release);
+            return n;
+        }
+
+        //
+        // Consumer
+        //
+        bool try_pop(value_type& str)
+        {
+            const size_type head = m_head.load(std::memory_order_relaxed);
+            if (!_available(head, 1))
+                return false;
+            detail::_queue_load(str, m_slots[head & m_mask]);
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+        // Pops up to count strings and returns the number popped
+        size_type try_pop(value_type *items, size_type count)
+        {
+            const size_type head = m_head.load(std::memory_order_relaxed);
+            const size_type n = _available(head, count);
+            for (size_type i = 0; i < n; ++i)
+                detail::_queue_load(items[i], m_slots[(head + i) & m_mask]);
+            if (n)
+                m_head.store(head + n, std::memory_order_release);
+            return n;
+        }
+
+    protected:
+        using slot_type = detail::_queue_slot<T_CHAR, t_buf_size, false>;
+        static constexpr size_type s_max_size = t_buf_size - 1;
+
+        detail::_slot_array<slot_type> m_slots;
+        const size_type m_mask;
+        // The consumer's line
+        alignas(detail::_cache_line_size) std::atomic<size_type> m_head;
+        size_type m_cached_tail;
+        // The producer's line
+        alignas(detail::_cache_line_size) std::atomic<size_type> m_tail;
+        size_type m_cached_head;
+
+        // The number of free slots after tail, up to count
+        size_type _room(size_type tail, size_type count)
+        {
+            if (capacity() - (tail - m_cached_head) < count)
+                m_cached_head = m_head.load(std::memory_order_acquire);
+            return khmz::detail::_min(count, capacity() - (tail - m_cached_head));
+        }
+        // The number of filled slots after head, up to count
+        size_type _available(size_type head, size_type count)
+        {
+            if (m_cached_tail - head < count)
+                m_cached_tail = m_tail.load(std::memory_order_acquire);
+            return khmz::detail::_min(count, m_cached_tail - head);
+        }
+    }; // fxstring_spsc_queue
+
+    namespace detail
+    {
+        //
+        // A bounded ring of slots after Dmitry Vyukov's MPMC queue: each slot
+        // carries a sequence number telling whose turn it is. T_SLOT must have
+        // a std::atomic<size_t> member named sequence. Positions are claimed
+        // in runs and published one slot at a time.
+        //
+        template <typename T_SLOT>
+        class _sequence_ring
+        {
+        public:
+            explicit _sequence_ring(size_t capacity)
+                : m_slots(capacity), m_mask(capacity - 1), m_enqueue_pos(0), m_dequeue_pos(0)
+            {
+                assert(_is_power_of_two(capacity));
+                for (size_t i = 0; i < capacity; ++i)
+                    m_slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+
+            size_t capacity() const { return m_mask + 1; }
+            size_t push_position() const { return m_enqueue_pos.load(std::memory_order_acquire); }
+            size_t pop_position() const { return m_dequeue_pos.load(std::memory_order_acquire); }
+            // Approximate when called concurrently
+            size_t size() const
+            {
+                const size_t head = pop_position();
+                const size_t tail = push_position();
+                return (tail > head) ? tail - head : 0;
+            }
+
+            T_SLOT& slot(size_t pos) { return m_slots[pos & m_mask]; }
+
+            // Claims up to count positions to write, sets first and returns the count
+            size_t claim_push(size_t count, size_t& first)
+            {
+                return _claim(m_enqueue_pos, 0, count, first);
+            }
+            void publish_push(size_t pos)
+            {
+                slot(pos).sequence.store(pos + 1, std::memory_order_release);
+            }
+            // Claims up to count positions to read, sets first and returns the count
+            size_t claim_pop(size_t count, size_t& first)
+            {
+                return _claim(m_dequeue_pos, 1, count, first);
+            }
+            void publish_pop(size_t pos)
+            {
+                slot(pos).sequence.store(pos + capacity(), std::memory_order_release);
+            }
+
+        protected:
+            _slot_array<T_SLOT> m_slots;
+            const size_t m_mask;
+            alignas(_cache_line_size) std::atomic<size_t> m_enqueue_pos;
+            alignas(_cache_line_size) std::atomic<size_t> m_dequeue_pos;
+
+            // A slot at pos is ready when its sequence is pos + lag
+            // (0 for producers, 1 for consumers).
+            size_t _claim(std::atomic<size_t>& position, size_t lag, size_t count, size_t& first)
+            {
+                size_t pos = position.load(std::memory_order_relaxed);
+                for (;;)
+                {
+                    size_t n = 0;
+                    for (; n < count; ++n)
+                    {
+                        const size_t seq = slot(pos + n).sequence.load(std::memory_order_acquire);
+                        if (seq != pos + n + lag)
+                            break;
+                    }
+                    if (!n)
+                    {
+                        const size_t seq = slot(pos).sequence.load(std::memory_order_acquire);
+                        const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - (pos + lag));
+                        if (diff < 0)
+                            return 0;   // Full or empty
+                        pos = position.load(std::memory_order_relaxed);
+                        continue;
+                    }
+                    if (position.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+                    {
+                        first = pos;
+                        return n;
+                    }
+                }
+            }
+        }; // _sequence_ring
+    } // namespace detail
+
+    //
+    // Multi-producer multi-consumer bounded queue over _sequence_ring.
+    // The capacity must be a power of two.
+    //
+    template <typename T_CHAR, size_t t_buf_size>
+    class fxstring_mpmc_queue
+    {
+    public:
+        using value_type = fxstring<T_CHAR, t_buf_size>;
+        using size_type = size_t;
+
+        explicit fxstring_mpmc_queue(size_type capacity) : m_ring(capacity)
+        {
+        }
+        fxstring_mpmc_queue(const fxstring_mpmc_queue&) = delete;
+        fxstring_mpmc_queue& operator=(const fxstring_mpmc_queue&) = delete;
+
+        size_type capacity() const { return m_ring.capacity(); }
+        // Approximate when called concurrently
+        size_type size() const { return m_ring.size(); }
+        bool empty() const { return size() == 0; }
+
+        //
+        // Producers. Strings longer than max_size are truncated.
+        //
+        bool try_push(const T_CHAR *str, size_type len)
+        {
+            size_type pos;
+            if (!m_ring.claim_push(1, pos))
+                return false;
+            detail::_queue_store(m_ring.slot(pos), str, khmz::detail::_min(len, s_max_size));
+            m_ring.publish_push(pos);
+            return true;
+        }
+        bool try_push(const value_type& str)
+        {
+            return try_push(str.data(), str.size());
+        }
+        // Pushes up to count strings, claiming the slots at once
+        size_type try_push(const value_type *items, size_type count)
+        {
+            size_type pos;
+            const size_type n = m_ring.claim_push(count, pos);
+            for (size_type i = 0; i < n; ++i)
+            {
+                detail::_queue_store(m_ring.slot(pos + i), items[i].data(), items[i].size());
+                m_ring.publish_push(pos + i);
+            }
+            return n;
+        }
+
+        //
+        // Consumers
+        //
+        bool try_pop(value_type& str)
+        {
+            size_type pos;
+            if (!m_ring.claim_pop(1, pos))
+                return false;
+            detail::_queue_load(str, m_ring.slot(pos));
+            m_ring.publish_pop(pos);
+            return true;
+        }
+        // Pops up to count strings, claiming the slots at once
+        size_type try_pop(value_type *items, size_type count)
+        {
+            size_type pos;
+            const size_type n = m_ring.claim_pop(count, pos);
+            for (size_type i = 0; i < n; ++i)
+            {
+                detail::_queue_load(items[i], m_ring.slot(pos + i));
+                m_ring.publish_pop(pos + i);
+            }
+            return n;
+        }
+
+    protected:
+        using slot_type = detail::_queue_slot<T_CHAR, t_buf_size, true>;
+        static constexpr size_type s_max_size = t_buf_size - 1;
+
+        detail::_sequence_ring<slot_type> m_ring;
+    }; // fxstring_mpmc_queue
+} // namespace khmz
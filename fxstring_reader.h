@@ -0,0 +1,307 @@
+// fxstring_reader.h --- buffered line reader producing fxstrings
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include <cstdio>           // For std::FILE, std::fread
+#include <cstring>          // For std::memchr, std::memmove
+#include <cerrno>           // For errno, EINTR
+#include <vector>           // For std::vector
+
+#ifdef _WIN32
+    #include <io.h>         // For _read
+#else
+    #include <unistd.h>     // For read
+#endif
+
+namespace khmz
+{
+    namespace detail
+    {
+        // The first ch in [first, last), or last
+        inline const char *_find_char(const char *first, const char *last, char ch)
+        {
+#ifdef FXSTRING_SSE2
+            const __m128i key = _mm_set1_epi8(ch);
+            for (; last - first >= 64; first += 64)
+            {
+                const __m128i *p = reinterpret_cast<const __m128i *>(first);
+                const __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(p + 0), key);
+                const __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(p + 1), key);
+                const __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128(p + 2), key);
+                const __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128(p + 3), key);
+                if (!_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))))
+                    continue;
+                const std::uint64_t mask =
+                    std::uint64_t(static_cast<unsigned>(_mm_movemask_epi8(a))) |
+                    (std::uint64_t(static_cast<unsigned>(_mm_movemask_epi8(b))) << 16) |
+                    (std::uint64_t(static_cast<unsigned>(_mm_movemask_epi8(c))) << 32) |
+                    (std::uint64_t(static_cast<unsigned>(_mm_movemask_epi8(d))) << 48);
+                return first + _ctz64(mask);
+            }
+            for (; last - first >= 16; first += 16)
+            {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+                const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, key));
+                if (mask)
+                    return first + _ctz64(static_cast<unsigned>(mask));
+            }
+#endif
+            const void *p = std::memchr(first, ch, static_cast<size_t>(last - first));
+            return p ? static_cast<const char *>(p) : last;
+        }
+    } // namespace detail
+
+    //
+    // Reads lines from a FILE* or a file descriptor in large blocks. The
+    // line terminators ("\n" or "\r\n") are not included in the lines.
+    // Lines longer than the limit are handled by the long line policy.
+    //
+    class fxstring_line_reader
+    {
+    public:
+        using view_type = fxstring_view<char>;
+        using size_type = size_t;
+
+        enum long_line_policy
+        {
+            truncate,   // Returns the head of the line and discards the rest
+            split,      // Returns the line in pieces of the limit
+            skip        // Discards the line
+        };
+
+        static constexpr size_type default_block_size = 1 << 16;
+        static constexpr size_type default_max_line = 1 << 12;
+
+        explicit fxstring_line_reader(std::FILE *fp, long_line_policy policy = truncate,
+                                      size_type max_line = default_max_line,
+                                      size_type block_size = default_block_size)
+            : m_fp(fp), m_fd(-1)
+        {
+            _init(policy, max_line, block_size);
+        }
+        explicit fxstring_line_reader(int fd, long_line_policy policy = truncate,
+                                      size_type max_line = default_max_line,
+                                      size_type block_size = default_block_size)
+            : m_fp(nullptr), m_fd(fd)
+        {
+            _init(policy, max_line, block_size);
+        }
+        fxstring_line_reader(const fxstring_line_reader&) = delete;
+        fxstring_line_reader& operator=(const fxstring_line_reader&) = delete;
+
+        //
+        // Reading. Returns false at the end of input. A view is valid until
+        // the next call. A line read into fxstring<char, N> is limited to
+        // N - 1 characters as well as to max_line().
+        //
+        bool next(view_type& line)
+        {
+            return _next(line, m_max_line);
+        }
+        template <size_t t_buf_size>
+        bool next(fxstring<char, t_buf_size>& line)
+        {
+            view_type view;
+            if (!_next(view, khmz::detail::_min<size_type>(t_buf_size - 1, m_max_line)))
+            {
+                line[0] = 0;
+                return false;
+            }
+            traits_type::copy(line.data(), view.data(), view.size());
+            line[view.size()] = 0;
+            return true;
+        }
+
+        //
+        // Status
+        //
+        // Whether the last line was cut by the limit. With split, this is
+        // true for all pieces but the last.
+        bool truncated() const { return m_truncated; }
+        // The number of lines over the limit, including the skipped ones
+        size_type long_lines() const { return m_long_lines; }
+        // Whether a read error occurred. Reading stops at an error.
+        bool error() const { return m_error; }
+        bool eof() const { return m_eof && m_begin == m_end; }
+        long_line_policy policy() const { return m_policy; }
+        size_type max_line() const { return m_max_line; }
+
+    protected:
+        using traits_type = std::char_traits<char>;
+
+        std::FILE *m_fp;
+        int m_fd;
+        std::vector<char> m_buf;
+        size_type m_begin;          // The start of the unread data
+        size_type m_scan;           // Where the search of '\n' resumes
+        size_type m_end;            // The end of the data
+        size_type m_block_size;
+        size_type m_max_line;
+        long_line_policy m_policy;
+        size_type m_long_lines;
+        bool m_truncated;
+        bool m_discarding;          // Discarding the rest of a long line
+        bool m_splitting;           // Returning the pieces of a long line
+        bool m_eof;
+        bool m_error;
+
+        void _init(long_line_policy policy, size_type max_line, size_type block_size)
+        {
+            assert(max_line > 0 && block_size > 0);
+            // After compaction, at most max_line + 1 bytes remain, so each
+            // read has at least block_size bytes of room.
+            m_buf.resize(max_line + 1 + block_size);
+            m_begin = m_scan = m_end = 0;
+            m_block_size = block_size;
+            m_max_line = max_line;
+            m_policy = policy;
+            m_long_lines = 0;
+            m_truncated = m_discarding = m_splitting = m_eof = m_error = false;
+        }
+
+        bool _fill()
+        {
+            if (m_eof)
+                return false;
+            if (m_begin)
+            {
+                std::memmove(m_buf.data(), m_buf.data() + m_begin, m_end - m_begin);
+                m_scan -= m_begin;
+                m_end -= m_begin;
+                m_begin = 0;
+            }
+            const size_type room = m_buf.size() - m_end;
+            size_type got;
+            if (m_fp)
+            {
+                got = std::fread(m_buf.data() + m_end, 1, room, m_fp);
+                if (got < room)
+                {
+                    m_error = std::ferror(m_fp) != 0;
+                    m_eof = true;
+                }
+            }
+            else
+            {
+                for (;;)
+                {
+#ifdef _WIN32
+                    const int n = ::_read(m_fd, m_buf.data() + m_end, static_cast<unsigned>(room));
+#else
+                    const ssize_t n = ::read(m_fd, m_buf.data() + m_end, room);
+#endif
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n <= 0)
+                    {
+                        m_error = n < 0;
+                        m_eof = true;
+                        got = 0;
+                    }
+                    else
+                    {
+                        got = static_cast<size_type>(n);
+                    }
+                    break;
+                }
+            }
+            m_end += got;
+            return got > 0;
+        }
+
+        // The line of [m_begin, m_begin + len), followed by skip bytes of terminator
+        void _emit(view_type& line, size_type len, size_type skip)
+        {
+            const char *data = m_buf.data() + m_begin;
+            if (skip && len && data[len - 1] == '\r')
+                --len;
+            line = view_type(data, len);
+        }
+
+        bool _next(view_type& line, size_type limit)
+        {
+            m_truncated = false;
+            for (;;)
+            {
+                const char *base = m_buf.data();
+                const char *nl = detail::_find_char(base + m_scan, base + m_end, '\n');
+                const size_type pos = static_cast<size_type>(nl - base);
+
+                if (m_discarding)
+                {
+                    if (pos < m_end)
+                    {
+                        m_begin = m_scan = pos + 1;
+                        m_discarding = false;
+                        continue;
+                    }
+                    m_begin = m_scan = m_end;
+                    if (!_fill())
+                        return false;
+                    continue;
+                }
+
+                const size_type len = pos - m_begin;
+                if (pos < m_end)
+                {
+                    // The terminator may be "\r\n", where '\r' doesn't count
+                    const size_type text = (len && base[pos - 1] == '\r') ? len - 1 : len;
+                    if (text <= limit)
+                    {
+                        _emit(line, len, 1);
+                        m_begin = m_scan = pos + 1;
+                        m_splitting = false;
+                        return true;
+                    }
+                }
+                else if (len <= limit || m_eof ||
+                         (len == limit + 1 && base[m_end - 1] == '\r'))
+                {
+                    // A trailing '\r' may be followed by '\n' in the next block
+                    m_scan = m_end;
+                    if (_fill())
+                        continue;
+                    if (m_begin == m_end)
+                        return false;
+                    if (m_end - m_begin <= limit)
+                    {
+                        // The last line without a terminator
+                        _emit(line, m_end - m_begin, 0);
+                        m_begin = m_scan = m_end;
+                        m_splitting = false;
+                        return true;
+                    }
+                }
+
+                // A line longer than limit
+                switch (m_policy)
+                {
+                case truncate:
+                    ++m_long_lines;
+                    _emit(line, limit, 0);
+                    m_truncated = true;
+                    m_begin = m_scan = m_begin + limit;
+                    m_discarding = true;
+                    return true;
+                case split:
+                    _emit(line, limit, 0);
+                    m_truncated = true;
+                    if (!m_splitting)
+                        ++m_long_lines;
+                    m_splitting = true;
+                    m_begin = m_begin + limit;
+                    if (m_scan < m_begin)
+                        m_scan = m_begin;
+                    return true;
+                case skip:
+                    ++m_long_lines;
+                    m_begin = m_scan = m_begin + limit;
+                    m_discarding = true;
+                    continue;
+                }
+            }
+        }
+    }; // fxstring_line_reader
+} // namespace khmz
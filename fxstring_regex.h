@@ -0,0 +1,723 @@
+// fxstring_regex.h --- regular expressions compiled to DFAs, for fxstrings
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include <algorithm>        // For std::sort, std::unique, std::upper_bound
+#include <cstdint>          // For std::uint32_t, std::uint64_t
+#include <map>              // For std::map
+#include <type_traits>      // For std::make_unsigned
+#include <utility>          // For std::pair
+#include <vector>           // For std::vector
+
+namespace khmz
+{
+    //
+    // A regular expression compiled to table-driven DFAs. Matching reads
+    // each character once per pass, with one table lookup, so it takes
+    // linear time whatever the pattern. The syntax is a subset of ERE:
+    //
+    //     x           the character x; \x for any of .[]()|*+?{}^$\ .
+    //     .           any character
+    //     [a-z_] [^0-9]
+    //                 a set, or its complement; ] is a member if first
+    //     \d \w \s    digits, word characters, white space (ASCII), and
+    //     \D \W \S    their complements; also in sets. \t \n \r too.
+    //     xy  x|y     concatenation, alternation
+    //     (x)         grouping; (?:x) too. Groups do not capture.
+    //     x* x+ x?    repetition; x{m}, x{m,} and x{m,n} with counts up to 255
+    //     ^ $         the beginning and the end of the string; zero-width, so
+    //                 ^^a, a$$ and (^|x)^a match as POSIX ERE does
+    //
+    // search() finds the leftmost-longest match, as POSIX does: a reverse
+    // pass finds where the leftmost match starts, and a forward pass from
+    // there finds where the longest match ends. The span is returned as a
+    // view.
+    //
+    // compile() fails, and valid() is false, on syntax errors and when a
+    // DFA would have more than max_states states. An invalid regex matches
+    // nothing.
+    //
+    template <typename T_CHAR, typename T_CHAR_TRAITS = std::char_traits<T_CHAR>>
+    class fxstring_regex
+    {
+    public:
+        using value_type = T_CHAR;
+        using size_type = size_t;
+        using view_type = fxstring_view<T_CHAR, T_CHAR_TRAITS>;
+
+        static constexpr size_type npos = -1;
+        static constexpr size_type s_default_max_states = 4096;
+
+        fxstring_regex() : m_class_count(0), m_valid(false)
+        {
+        }
+        explicit fxstring_regex(view_type pattern, size_type max_states = s_default_max_states)
+            : m_class_count(0), m_valid(false)
+        {
+            compile(pattern, max_states);
+        }
+
+        bool compile(view_type pattern, size_type max_states = s_default_max_states)
+        {
+            m_valid = false;
+            compiler comp(pattern);
+            node_id root;
+            if (!comp.parse(root))
+                return false;
+            _make_classes(comp);
+
+            // Forward: ^? R $?, anchored. Reverse: $? any* reverse(R) ^?, for the leftmost start.
+            nfa forward, reverse;
+            const std::uint32_t match = forward.add(nfa::match, 0);
+            std::uint32_t start = forward.add(nfa::eot, match);
+            start = forward.add_split(start, match);
+            start = _build_nfa(comp, forward, root, start, false);
+            start = forward.add_split(forward.add(nfa::bot, start), start);
+            if (!_build_dfa(forward, start, m_forward, max_states))
+                return false;
+
+            const std::uint32_t reverse_match = reverse.add(nfa::match, 0);
+            start = reverse.add(nfa::bot, reverse_match);
+            start = reverse.add_split(start, reverse_match);
+            start = _build_nfa(comp, reverse, root, start, true);
+            const std::uint32_t loop = reverse.add_split(0, start);
+            const std::uint32_t skip = reverse.add(nfa::any_char, loop);
+            reverse.states[loop].out = skip;
+            start = reverse.add_split(reverse.add(nfa::eot, loop), loop);
+            if (!_build_dfa(reverse, start, m_reverse, max_states))
+                return false;
+
+            m_valid = true;
+            return true;
+        }
+
+        bool valid() const { return m_valid; }
+        // The number of states of the forward and the reverse DFAs
+        size_type state_count() const { return m_forward.accepting.size() + m_reverse.accepting.size(); }
+
+        // Whether the whole of str matches
+        bool match(view_type str) const
+        {
+            if (!m_valid)
+                return false;
+            std::uint32_t state = m_forward.next(s_start, m_class_count);
+            for (size_type i = 0; i < str.size() && state != s_dead; ++i)
+                state = m_forward.next(state, _class_of(str[i]));
+            return m_forward.accepting[m_forward.next(state, m_class_count + 1)] != 0;
+        }
+
+        // Whether str contains a match
+        bool search(view_type str) const
+        {
+            return _leftmost_start(str) != npos;
+        }
+        // Finds the leftmost-longest match and returns it in span
+        bool search(view_type str, view_type& span) const
+        {
+            const size_type start = _leftmost_start(str);
+            if (start == npos)
+                return false;
+            span = view_type(str.data() + start, _longest_end(str, start) - start);
+            return true;
+        }
+
+    protected:
+        //
+        // Parsing into a tree of nodes
+        //
+        using node_id = std::uint32_t;
+        struct node
+        {
+            enum kind_type { empty, set, bot, eot, concat, alternate, star, optional };
+            kind_type kind;
+            node_id a, b;           // Operands, or the set index
+        };
+        // Ranges of character codes; a negated set is stored as its complement
+        using ranges_type = std::vector<std::pair<std::uint64_t, std::uint64_t>>;
+
+        static constexpr std::uint64_t s_code_end = std::uint64_t(1) << (sizeof(T_CHAR) * 8);
+        static constexpr std::uint32_t s_max_count = 255;
+
+        static std::uint64_t _code(T_CHAR ch)
+        {
+            return static_cast<std::uint64_t>(static_cast<typename std::make_unsigned<T_CHAR>::type>(ch));
+        }
+
+        class compiler
+        {
+        public:
+            std::vector<node> nodes;
+            std::vector<ranges_type> sets;
+
+            explicit compiler(view_type pattern) : m_pattern(pattern), m_pos(0)
+            {
+            }
+
+            bool parse(node_id& root)
+            {
+                return _alternate(root) && m_pos == m_pattern.size();
+            }
+
+        protected:
+            view_type m_pattern;
+            size_type m_pos;
+
+            bool _at(T_CHAR ch) const
+            {
+                return m_pos < m_pattern.size() && m_pattern[m_pos] == ch;
+            }
+            node_id _add(typename node::kind_type kind, node_id a = 0, node_id b = 0)
+            {
+                const node n = { kind, a, b };
+                nodes.push_back(n);
+                return static_cast<node_id>(nodes.size() - 1);
+            }
+            node_id _add_set(const ranges_type& ranges)
+            {
+                sets.push_back(ranges);
+                return _add(node::set, static_cast<node_id>(sets.size() - 1));
+            }
+
+            bool _alternate(node_id& ret)
+            {
+                if (!_concat(ret))
+                    return false;
+                while (_at(T_CHAR('|')))
+                {
+                    ++m_pos;
+                    node_id right;
+                    if (!_concat(right))
+                        return false;
+                    ret = _add(node::alternate, ret, right);
+                }
+                return true;
+            }
+            bool _concat(node_id& ret)
+            {
+                ret = _add(node::empty);
+                while (m_pos < m_pattern.size() && !_at(T_CHAR('|')) && !_at(T_CHAR(')')))
+                {
+                    node_id item;
+                    if (!_repeat(item))
+                        return false;
+                    ret = _add(node::concat, ret, item);
+                }
+                return true;
+            }
+            bool _repeat(node_id& ret)
+            {
+                if (!_atom(ret))
+                    return false;
+                for (;;)
+                {
+                    if (_at(T_CHAR('*')))
+                        ret = _add(node::star, ret);
+                    else if (_at(T_CHAR('+')))
+                        ret = _add(node::concat, ret, _add(node::star, ret));
+                    else if (_at(T_CHAR('?')))
+                        ret = _add(node::optional, ret);
+                    else if (_at(T_CHAR('{')))
+                    {
+                        std::uint32_t min_count, max_count;
+                        if (!_counts(min_count, max_count))
+                            return false;
+                        ret = _counted(ret, min_count, max_count);
+                        continue;
+                    }
+                    else
+                        return true;
+                    ++m_pos;
+                }
+            }
+            // {m}, {m,} or {m,n}; max_count is s_max_count + 1 if unbounded
+            bool _counts(std::uint32_t& min_count, std::uint32_t& max_count)
+            {
+                ++m_pos;
+                if (!_number(min_count))
+                    return false;
+                max_count = min_count;
+                if (_at(T_CHAR(',')))
+                {
+                    ++m_pos;
+                    max_count = s_max_count + 1;
+                    if (!_at(T_CHAR('}')) && !_number(max_count))
+                        return false;
+                }
+                if (!_at(T_CHAR('}')) || max_count < min_count)
+                    return false;
+                ++m_pos;
+                return true;
+            }
+            bool _number(std::uint32_t& ret)
+            {
+                ret = 0;
+                const size_type first = m_pos;
+                while (m_pos < m_pattern.size() && T_CHAR('0') <= m_pattern[m_pos] && m_pattern[m_pos] <= T_CHAR('9'))
+                {
+                    ret = ret * 10 + static_cast<std::uint32_t>(m_pattern[m_pos++] - T_CHAR('0'));
+                    if (ret > s_max_count)
+                        return false;
+                }
+                return m_pos > first;
+            }
+            // item{min_count,max_count}: the copies share the item's node, and are built separately
+            node_id _counted(node_id item, std::uint32_t min_count, std::uint32_t max_count)
+            {
+                node_id ret = _add(node::empty);
+                for (std::uint32_t i = 0; i < min_count; ++i)
+                    ret = _add(node::concat, ret, item);
+                if (max_count > s_max_count)
+                    return _add(node::concat, ret, _add(node::star, item));
+                node_id tail = _add(node::empty);
+                for (std::uint32_t i = min_count; i < max_count; ++i)
+                    tail = _add(node::optional, _add(node::concat, item, tail));
+                return _add(node::concat, ret, tail);
+            }
+
+            bool _atom(node_id& ret)
+            {
+                if (m_pos >= m_pattern.size())
+                    return false;
+                const T_CHAR ch = m_pattern[m_pos++];
+                ranges_type ranges;
+                switch (ch)
+                {
+                case T_CHAR('('):
+                    if (_at(T_CHAR('?')))
+                    {
+                        if (m_pos + 1 >= m_pattern.size() || m_pattern[m_pos + 1] != T_CHAR(':'))
+                            return false;
+                        m_pos += 2;
+                    }
+                    if (!_alternate(ret) || !_at(T_CHAR(')')))
+                        return false;
+                    ++m_pos;
+                    return true;
+                case T_CHAR(')'): case T_CHAR('*'): case T_CHAR('+'): case T_CHAR('?'): case T_CHAR('{'):
+                    return false;
+                case T_CHAR('^'):
+                    ret = _add(node::bot);
+                    return true;
+                case T_CHAR('$'):
+                    ret = _add(node::eot);
+                    return true;
+                case T_CHAR('.'):
+                    ranges.push_back(std::make_pair(std::uint64_t(0), s_code_end - 1));
+                    break;
+                case T_CHAR('['):
+                    if (!_set(ranges))
+                        return false;
+                    break;
+                case T_CHAR('\\'):
+                    if (!_escape(ranges))
+                        return false;
+                    break;
+                default:
+                    ranges.push_back(std::make_pair(_code(ch), _code(ch)));
+                    break;
+                }
+                ret = _add_set(ranges);
+                return true;
+            }
+
+            // After a backslash: a class such as \d, or an escaped character
+            bool _escape(ranges_type& ranges)
+            {
+                if (m_pos >= m_pattern.size())
+                    return false;
+                const T_CHAR ch = m_pattern[m_pos++];
+                ranges_type cls;
+                bool negated = false;
+                switch (ch)
+                {
+                case T_CHAR('D'): negated = true; // Fall through
+                case T_CHAR('d'):
+                    cls.push_back(std::make_pair(_code('0'), _code('9')));
+                    break;
+                case T_CHAR('W'): negated = true; // Fall through
+                case T_CHAR('w'):
+                    cls.push_back(std::make_pair(_code('0'), _code('9')));
+                    cls.push_back(std::make_pair(_code('A'), _code('Z')));
+                    cls.push_back(std::make_pair(_code('_'), _code('_')));
+                    cls.push_back(std::make_pair(_code('a'), _code('z')));
+                    break;
+                case T_CHAR('S'): negated = true; // Fall through
+                case T_CHAR('s'):
+                    cls.push_back(std::make_pair(_code('\t'), _code('\r')));
+                    cls.push_back(std::make_pair(_code(' '), _code(' ')));
+                    break;
+                case T_CHAR('t'): cls.push_back(std::make_pair(_code('\t'), _code('\t'))); break;
+                case T_CHAR('n'): cls.push_back(std::make_pair(_code('\n'), _code('\n'))); break;
+                case T_CHAR('r'): cls.push_back(std::make_pair(_code('\r'), _code('\r'))); break;
+                default:          cls.push_back(std::make_pair(_code(ch), _code(ch))); break;
+                }
+                if (negated)
+                    cls = _complement(cls);
+                ranges.insert(ranges.end(), cls.begin(), cls.end());
+                return true;
+            }
+
+            // After [: members up to ]
+            bool _set(ranges_type& ranges)
+            {
+                const bool negated = _at(T_CHAR('^'));
+                if (negated)
+                    ++m_pos;
+                const size_type members = m_pos;
+                while (m_pos < m_pattern.size() && !(_at(T_CHAR(']')) && m_pos > members))
+                {
+                    std::uint64_t lo;
+                    if (!_set_member(ranges, lo))
+                        continue;
+                    std::uint64_t hi = lo;
+                    if (_at(T_CHAR('-')) && m_pos + 1 < m_pattern.size() && m_pattern[m_pos + 1] != T_CHAR(']'))
+                    {
+                        ++m_pos;
+                        if (!_set_member(ranges, hi) || hi < lo)
+                            return false;
+                    }
+                    ranges.push_back(std::make_pair(lo, hi));
+                }
+                if (m_pos >= m_pattern.size())
+                    return false;
+                ++m_pos;
+                if (negated)
+                    ranges = _complement(ranges);
+                return true;
+            }
+            // A character of a set, into code; false after a class such as \d, which is added to ranges
+            bool _set_member(ranges_type& ranges, std::uint64_t& code)
+            {
+                const T_CHAR ch = m_pattern[m_pos++];
+                if (ch != T_CHAR('\\') || m_pos >= m_pattern.size())
+                {
+                    code = _code(ch);
+                    return true;
+                }
+                ranges_type escaped;
+                _escape(escaped);
+                if (escaped.size() == 1 && escaped[0].first == escaped[0].second)
+                {
+                    code = escaped[0].first;
+                    return true;
+                }
+                ranges.insert(ranges.end(), escaped.begin(), escaped.end());
+                return false;
+            }
+
+            static ranges_type _complement(ranges_type ranges)
+            {
+                std::sort(ranges.begin(), ranges.end());
+                ranges_type ret;
+                std::uint64_t next = 0;
+                for (const std::pair<std::uint64_t, std::uint64_t>& range : ranges)
+                {
+                    if (range.first > next)
+                        ret.push_back(std::make_pair(next, range.first - 1));
+                    next = (std::max)(next, range.second + 1);
+                }
+                if (next < s_code_end)
+                    ret.push_back(std::make_pair(next, s_code_end - 1));
+                return ret;
+            }
+        }; // compiler
+
+        //
+        // The alphabet is partitioned into classes of characters that no set
+        // tells apart; the DFAs read classes, then the pseudo-characters
+        // ^ (m_class_count) and $ (m_class_count + 1).
+        //
+        std::vector<std::uint64_t> m_class_starts;      // Sorted; class k starts at m_class_starts[k]
+        std::uint32_t m_byte_classes[256];              // The classes of codes below 256
+        std::vector<std::vector<char>> m_set_classes;   // Whether set i contains class k
+        std::uint32_t m_class_count;
+
+        void _make_classes(const compiler& comp)
+        {
+            m_class_starts.assign(1, 0);
+            for (const ranges_type& ranges : comp.sets)
+            {
+                for (const std::pair<std::uint64_t, std::uint64_t>& range : ranges)
+                {
+                    m_class_starts.push_back(range.first);
+                    if (range.second + 1 < s_code_end)
+                        m_class_starts.push_back(range.second + 1);
+                }
+            }
+            std::sort(m_class_starts.begin(), m_class_starts.end());
+            m_class_starts.erase(std::unique(m_class_starts.begin(), m_class_starts.end()), m_class_starts.end());
+            m_class_count = static_cast<std::uint32_t>(m_class_starts.size());
+            for (std::uint64_t code = 0; code < 256 && code < s_code_end; ++code)
+                m_byte_classes[code] = _search_class(code);
+
+            m_set_classes.assign(comp.sets.size(), std::vector<char>(m_class_count, 0));
+            for (size_type i = 0; i < comp.sets.size(); ++i)
+            {
+                for (const std::pair<std::uint64_t, std::uint64_t>& range : comp.sets[i])
+                {
+                    for (std::uint32_t k = _search_class(range.first); k < m_class_count &&
+                         m_class_starts[k] <= range.second; ++k)
+                    {
+                        m_set_classes[i][k] = 1;
+                    }
+                }
+            }
+        }
+        std::uint32_t _search_class(std::uint64_t code) const
+        {
+            return static_cast<std::uint32_t>(
+                std::upper_bound(m_class_starts.begin(), m_class_starts.end(), code) - m_class_starts.begin() - 1);
+        }
+        std::uint32_t _class_of(T_CHAR ch) const
+        {
+            const std::uint64_t code = _code(ch);
+            return (code < 256) ? m_byte_classes[code] : _search_class(code);
+        }
+
+        //
+        // Thompson NFAs, built back to front: each node is built before the
+        // state that follows it
+        //
+        struct nfa
+        {
+            enum kind_type { set, any_char, bot, eot, split, match };
+            struct state
+            {
+                kind_type kind;
+                std::uint32_t set;
+                std::uint32_t out, out1;
+            };
+            std::vector<state> states;
+
+            std::uint32_t add(kind_type kind, std::uint32_t out, std::uint32_t set_index = 0)
+            {
+                const state s = { kind, set_index, out, 0 };
+                states.push_back(s);
+                return static_cast<std::uint32_t>(states.size() - 1);
+            }
+            std::uint32_t add_split(std::uint32_t out, std::uint32_t out1)
+            {
+                const state s = { split, 0, out, out1 };
+                states.push_back(s);
+                return static_cast<std::uint32_t>(states.size() - 1);
+            }
+        };
+
+        // Builds node n followed by next; concatenations are reversed if reversed
+        std::uint32_t _build_nfa(const compiler& comp, nfa& machine, node_id n, std::uint32_t next,
+                                 bool reversed) const
+        {
+            const node& nd = comp.nodes[n];
+            switch (nd.kind)
+            {
+            case node::empty:
+                return next;
+            case node::set:
+                return machine.add(nfa::set, next, nd.a);
+            case node::bot:
+                return machine.add(nfa::bot, next);
+            case node::eot:
+                return machine.add(nfa::eot, next);
+            case node::concat:
+                if (reversed)
+                    return _build_nfa(comp, machine, nd.b, _build_nfa(comp, machine, nd.a, next, reversed), reversed);
+                return _build_nfa(comp, machine, nd.a, _build_nfa(comp, machine, nd.b, next, reversed), reversed);
+            case node::alternate:
+                {
+                    const std::uint32_t left = _build_nfa(comp, machine, nd.a, next, reversed);
+                    const std::uint32_t right = _build_nfa(comp, machine, nd.b, next, reversed);
+                    return machine.add_split(left, right);
+                }
+            case node::star:
+                {
+                    const std::uint32_t loop = machine.add_split(0, next);
+                    const std::uint32_t body = _build_nfa(comp, machine, nd.a, loop, reversed);
+                    machine.states[loop].out = body;
+                    return loop;
+                }
+            default:    // optional
+                return machine.add_split(_build_nfa(comp, machine, nd.a, next, reversed), next);
+            }
+        }
+
+        //
+        // DFAs by subset construction. State 0 is dead, and state 1 starts.
+        //
+        struct dfa
+        {
+            std::vector<std::uint32_t> table;   // [state * symbols + symbol]
+            std::vector<char> accepting;
+            std::uint32_t symbols;
+
+            std::uint32_t next(std::uint32_t state, std::uint32_t symbol) const
+            {
+                return table[state * symbols + symbol];
+            }
+        };
+        enum : std::uint32_t { s_dead = 0, s_start = 1 };
+        // The anchors known to hold at a position: those read since the last character
+        enum : std::uint32_t { s_at_bot = 1, s_at_eot = 2 };
+
+        // Whether state t is an anchor that holds
+        static bool _passes(const typename nfa::state& t, std::uint32_t anchors)
+        {
+            return (t.kind == nfa::bot && (anchors & s_at_bot)) || (t.kind == nfa::eot && (anchors & s_at_eot));
+        }
+
+        // Adds the states reachable from s without reading to closure; the anchors that
+        // hold are zero-width, so ^^ and $$ match as ^ and $ do
+        static void _closure(const nfa& machine, std::uint32_t s, std::uint32_t anchors, std::vector<char>& seen,
+                             std::vector<std::uint32_t>& closure)
+        {
+            std::vector<std::uint32_t> stack(1, s);
+            while (!stack.empty())
+            {
+                const std::uint32_t t = stack.back();
+                stack.pop_back();
+                if (seen[t])
+                    continue;
+                seen[t] = 1;
+                if (machine.states[t].kind == nfa::split)
+                {
+                    stack.push_back(machine.states[t].out1);
+                    stack.push_back(machine.states[t].out);
+                }
+                else if (_passes(machine.states[t], anchors))
+                {
+                    stack.push_back(machine.states[t].out);
+                }
+                else
+                {
+                    closure.push_back(t);
+                }
+            }
+        }
+
+        bool _build_dfa(const nfa& machine, std::uint32_t start, dfa& out, size_type max_states) const
+        {
+            // The NFA states, and the anchors that hold
+            using key_type = std::pair<std::vector<std::uint32_t>, std::uint32_t>;
+            const std::uint32_t symbols = m_class_count + 2;
+            std::map<key_type, std::uint32_t> ids;
+            std::vector<key_type> keys;
+            std::vector<char> seen(machine.states.size(), 0);
+
+            out.symbols = symbols;
+            out.table.assign(2 * symbols, s_dead);
+            out.accepting.assign(2, 0);
+            keys.push_back(key_type());
+            ids[key_type()] = s_dead;
+            key_type key;
+            key.second = 0;
+            _closure(machine, start, 0, seen, key.first);
+            std::sort(key.first.begin(), key.first.end());
+            keys.push_back(key);
+            ids[key] = s_start;
+
+            for (std::uint32_t id = s_start; id < keys.size(); ++id)
+            {
+                for (std::uint32_t t : keys[id].first)
+                    out.accepting[id] |= (machine.states[t].kind == nfa::match);
+                for (std::uint32_t symbol = 0; symbol < symbols; ++symbol)
+                {
+                    // Reading ^ or $ stays at the position, where the anchors read before still hold
+                    std::uint32_t anchors = 0;
+                    if (symbol == m_class_count)
+                        anchors = keys[id].second | s_at_bot;
+                    else if (symbol == m_class_count + 1)
+                        anchors = keys[id].second | s_at_eot;
+                    key.first.clear();
+                    std::fill(seen.begin(), seen.end(), 0);
+                    for (std::uint32_t t : keys[id].first)
+                    {
+                        const typename nfa::state& st = machine.states[t];
+                        bool reads = false;
+                        switch (st.kind)
+                        {
+                        case nfa::set:      reads = symbol < m_class_count && m_set_classes[st.set][symbol]; break;
+                        case nfa::any_char: reads = symbol < m_class_count; break;
+                        case nfa::bot:
+                        case nfa::eot:      reads = _passes(st, anchors); break;
+                        default:            break;
+                        }
+                        if (reads)
+                            _closure(machine, st.out, anchors, seen, key.first);
+                    }
+                    std::sort(key.first.begin(), key.first.end());
+                    key.second = key.first.empty() ? 0 : anchors;
+                    typename std::map<key_type, std::uint32_t>::const_iterator it = ids.find(key);
+                    std::uint32_t target;
+                    if (it != ids.end())
+                    {
+                        target = it->second;
+                    }
+                    else
+                    {
+                        if (keys.size() >= max_states)
+                            return false;
+                        target = static_cast<std::uint32_t>(keys.size());
+                        ids[key] = target;
+                        keys.push_back(key);
+                        out.table.resize(out.table.size() + symbols, s_dead);
+                        out.accepting.push_back(0);
+                    }
+                    out.table[id * symbols + symbol] = target;
+                }
+            }
+            return true;
+        }
+
+        //
+        // Matching
+        //
+        bool m_valid;
+        dfa m_forward;
+        dfa m_reverse;
+
+        // Reads str backwards; the last accepting position seen is the leftmost start
+        size_type _leftmost_start(view_type str) const
+        {
+            if (!m_valid)
+                return npos;
+            size_type ret = npos;
+            std::uint32_t state = s_start;
+            if (m_reverse.accepting[state])
+                ret = str.size();
+            state = m_reverse.next(state, m_class_count + 1);
+            if (m_reverse.accepting[state])
+                ret = str.size();
+            for (size_type i = str.size(); i-- > 0 && state != s_dead; )
+            {
+                state = m_reverse.next(state, _class_of(str[i]));
+                if (m_reverse.accepting[state])
+                    ret = i;
+            }
+            if (state != s_dead && m_reverse.accepting[m_reverse.next(state, m_class_count)])
+                ret = 0;
+            return ret;
+        }
+
+        // Reads str forwards from start, which a match begins at; returns where the longest ends
+        size_type _longest_end(view_type str, size_type start) const
+        {
+            size_type ret = start;
+            std::uint32_t state = s_start;
+            if (start == 0)
+                state = m_forward.next(state, m_class_count);
+            for (size_type i = start; i < str.size() && state != s_dead; ++i)
+            {
+                state = m_forward.next(state, _class_of(str[i]));
+                if (m_forward.accepting[state])
+                    ret = i + 1;
+            }
+            if (state != s_dead && m_forward.accepting[m_forward.next(state, m_class_count + 1)])
+                ret = str.size();
+            return ret;
+        }
+    }; // fxstring_regex
+
+    using fxstring_regex_a = fxstring_regex<char>;
+    using fxstring_regex_w = fxstring_regex<wchar_t>;
+} // namespace khmz
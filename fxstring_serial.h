@@ -0,0 +1,234 @@
+// fxstring_serial.h --- compact binary serialization of fxstrings
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include "fxstring_utf.h"
+#include <cstdint>          // For std::uint8_t
+#include <cstring>          // For std::memcpy
+
+//
+// Encoding of a string: the payload length in bytes as an unsigned LEB128
+// varint, followed by the payload. The payload of char strings is their
+// bytes as-is; the payload of wider strings is UTF-8, so that wchar_t data
+// is portable between UTF-16 and UTF-32 platforms. Unpaired surrogates and
+// other invalid code units become U+FFFD.
+//
+// Encoding of a range: the number of strings as a varint, followed by the
+// strings.
+//
+namespace khmz
+{
+    //
+    // Sizes
+    //
+    constexpr size_t varint_length(size_t value)
+    {
+        return (value < 0x80) ? 1 : 1 + varint_length(value >> 7);
+    }
+    // The largest payload of a string of max_size code units
+    template <typename T_CHAR>
+    constexpr size_t max_serialized_payload(size_t max_size)
+    {
+        return max_size * ((sizeof(T_CHAR) == 1) ? 1 : (sizeof(T_CHAR) == 2) ? 3 : 4);
+    }
+    // The largest encoding of a fxstring<T_CHAR, t_buf_size>
+    template <typename T_CHAR, size_t t_buf_size>
+    constexpr size_t max_serialized_size()
+    {
+        return varint_length(max_serialized_payload<T_CHAR>(t_buf_size - 1)) +
+               max_serialized_payload<T_CHAR>(t_buf_size - 1);
+    }
+
+    namespace detail
+    {
+        inline size_t _varint_encode(std::uint8_t *dest, size_t value)
+        {
+            size_t i = 0;
+            while (value >= 0x80)
+            {
+                dest[i++] = static_cast<std::uint8_t>(value | 0x80);
+                value >>= 7;
+            }
+            dest[i++] = static_cast<std::uint8_t>(value);
+            return i;
+        }
+
+        // Returns the number of bytes read, or zero on truncated or overflowing input
+        inline size_t _varint_decode(size_t& value, const std::uint8_t *src, size_t len)
+        {
+            value = 0;
+            for (size_t i = 0, shift = 0; i < len && shift < sizeof(size_t) * 8; ++i, shift += 7)
+            {
+                const size_t bits = src[i] & 0x7F;
+                if ((bits << shift) >> shift != bits)
+                    return 0;
+                value |= bits << shift;
+                if (!(src[i] & 0x80))
+                    return i + 1;
+            }
+            return 0;
+        }
+
+        //
+        // Payload length
+        //
+        template <typename T_CHAR>
+        inline size_t _payload_length(const T_CHAR *, size_t len, _utf_width<1>)
+        {
+            return len;
+        }
+        template <typename T_CHAR, typename T_WIDTH>
+        inline size_t _payload_length(const T_CHAR *str, size_t len, T_WIDTH width)
+        {
+            size_t ret = 0;
+            for (size_t i = 0; i < len; )
+            {
+                if (_utf_unit(str[i]) < 0x80)
+                {
+                    ++i;
+                    ++ret;
+                    continue;
+                }
+                const char32_t cp = _utf_decode(str, len, i, width);
+                ret += (cp < 0x800) ? 2 : (cp < 0x10000) ? 3 : 4;
+            }
+            return ret;
+        }
+
+        //
+        // Payload encoding. dest has room for the payload length.
+        //
+        template <typename T_CHAR>
+        inline void _payload_encode(std::uint8_t *dest, size_t payload, const T_CHAR *str, size_t, _utf_width<1>)
+        {
+            std::memcpy(dest, str, payload);
+        }
+        template <typename T_CHAR, typename T_WIDTH>
+        inline void _payload_encode(std::uint8_t *dest, size_t payload, const T_CHAR *str, size_t len, T_WIDTH)
+        {
+            transcode(reinterpret_cast<char *>(dest), payload, str, len);
+        }
+
+        //
+        // Payload decoding into dest of max_size code units. Returns the
+        // number of code units written, or npos if the payload doesn't fit.
+        //
+        template <typename T_CHAR>
+        inline size_t _payload_decode(T_CHAR *dest, size_t max_size, const std::uint8_t *src, size_t payload, _utf_width<1>)
+        {
+            if (payload > max_size)
+                return size_t(-1);
+            std::memcpy(dest, src, payload);
+            return payload;
+        }
+        template <typename T_CHAR, typename T_WIDTH>
+        inline size_t _payload_decode(T_CHAR *dest, size_t max_size, const std::uint8_t *src, size_t payload, T_WIDTH)
+        {
+            const transcode_result ret = transcode(dest, max_size, reinterpret_cast<const char *>(src), payload);
+            if (ret.read != payload)
+                return size_t(-1);
+            return ret.written;
+        }
+    } // namespace detail
+
+    //
+    // The exact encoded size of str
+    //
+    template <typename T_CHAR, size_t t_buf_size>
+    inline size_t serialized_size(const fxstring<T_CHAR, t_buf_size>& str)
+    {
+        const size_t payload = detail::_payload_length(str.data(), str.size(), detail::_utf_width_of<T_CHAR>());
+        return varint_length(payload) + payload;
+    }
+    template <typename T_CHAR, size_t t_buf_size>
+    inline size_t serialized_size(const fxstring<T_CHAR, t_buf_size> *first, size_t count)
+    {
+        size_t ret = varint_length(count);
+        for (size_t i = 0; i < count; ++i)
+            ret += serialized_size(first[i]);
+        return ret;
+    }
+
+    //
+    // Serialization. Returns the number of bytes written to dest, or zero
+    // if dest_size is too small.
+    //
+    template <typename T_CHAR, size_t t_buf_size>
+    inline size_t serialize(void *dest, size_t dest_size, const fxstring<T_CHAR, t_buf_size>& str)
+    {
+        using width = detail::_utf_width_of<T_CHAR>;
+        std::uint8_t *out = static_cast<std::uint8_t *>(dest);
+        const size_t len = str.size();
+        const size_t payload = detail::_payload_length(str.data(), len, width());
+        const size_t head = varint_length(payload);
+        if (dest_size < head || dest_size - head < payload)
+            return 0;
+        detail::_varint_encode(out, payload);
+        detail::_payload_encode(out + head, payload, str.data(), len, width());
+        return head + payload;
+    }
+    template <typename T_CHAR, size_t t_buf_size>
+    inline size_t serialize(void *dest, size_t dest_size, const fxstring<T_CHAR, t_buf_size> *first, size_t count)
+    {
+        std::uint8_t *out = static_cast<std::uint8_t *>(dest);
+        const size_t head = varint_length(count);
+        if (dest_size < head)
+            return 0;
+        size_t ret = detail::_varint_encode(out, count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t n = serialize(out + ret, dest_size - ret, first[i]);
+            if (!n)
+                return 0;
+            ret += n;
+        }
+        return ret;
+    }
+
+    //
+    // Deserialization. Returns the number of bytes read from src, or zero
+    // if src is truncated or malformed, or if a string doesn't fit in
+    // t_buf_size. For a range, count is the capacity of first on entry and
+    // the number of strings read on return.
+    //
+    template <typename T_CHAR, size_t t_buf_size>
+    inline size_t deserialize(fxstring<T_CHAR, t_buf_size>& str, const void *src, size_t src_size)
+    {
+        const std::uint8_t *in = static_cast<const std::uint8_t *>(src);
+        size_t payload;
+        const size_t head = detail::_varint_decode(payload, in, src_size);
+        if (!head || src_size - head < payload)
+            return 0;
+        const size_t len = detail::_payload_decode(str.data(), str.max_size(), in + head, payload,
+                                                   detail::_utf_width_of<T_CHAR>());
+        if (len == size_t(-1))
+        {
+            str[0] = 0;
+            return 0;
+        }
+        str[len] = 0;
+        return head + payload;
+    }
+    template <typename T_CHAR, size_t t_buf_size>
+    inline size_t deserialize(fxstring<T_CHAR, t_buf_size> *first, size_t& count, const void *src, size_t src_size)
+    {
+        const std::uint8_t *in = static_cast<const std::uint8_t *>(src);
+        size_t num;
+        size_t ret = detail::_varint_decode(num, in, src_size);
+        const size_t capacity = count;
+        count = 0;
+        if (!ret || num > capacity)
+            return 0;
+        for (size_t i = 0; i < num; ++i)
+        {
+            const size_t n = deserialize(first[i], in + ret, src_size - ret);
+            if (!n)
+                return 0;
+            ret += n;
+            count = i + 1;
+        }
+        return ret;
+    }
+} // namespace khmz
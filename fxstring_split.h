@@ -0,0 +1,318 @@
+// fxstring_split.h --- non-allocating split, tokenize and join
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include <initializer_list> // For std::initializer_list
+#include <iterator>         // For std::forward_iterator_tag
+
+namespace khmz
+{
+    namespace detail
+    {
+        template <typename T>
+        struct _non_deduced
+        {
+            using type = T;
+        };
+
+        //
+        // Delimiters. find returns the position of the first delimiter at or
+        // after pos, or len.
+        //
+        template <typename T_CHAR>
+        struct _split_char
+        {
+            T_CHAR ch;
+
+            size_t find(const T_CHAR *str, size_t len, size_t pos) const
+            {
+                const T_CHAR *p = std::char_traits<T_CHAR>::find(str + pos, len - pos, ch);
+                return p ? static_cast<size_t>(p - str) : len;
+            }
+        };
+
+        template <typename T_CHAR>
+        struct _split_set
+        {
+            fxstring_view<T_CHAR> set;
+
+            size_t find(const T_CHAR *str, size_t len, size_t pos) const
+            {
+                for (; pos < len; ++pos)
+                {
+                    if (std::char_traits<T_CHAR>::find(set.data(), set.size(), str[pos]))
+                        break;
+                }
+                return pos;
+            }
+        };
+
+        template <typename T_CHAR>
+        struct _split_space
+        {
+            size_t find(const T_CHAR *str, size_t len, size_t pos) const
+            {
+                for (; pos < len; ++pos)
+                {
+                    const T_CHAR ch = str[pos];
+                    if (ch == ' ' || (T_CHAR('\t') <= ch && ch <= T_CHAR('\r')))
+                        break;
+                }
+                return pos;
+            }
+        };
+    } // namespace detail
+
+    //
+    // A lazy range of the pieces of a string between delimiters, as views
+    // into the string. The string must outlive the range and its iterators;
+    // the iterators don't refer to the range. When skip_empty is set, empty
+    // pieces are skipped (tokenizing).
+    //
+    template <typename T_CHAR, typename T_DELIMITER>
+    class fxstring_split_range
+    {
+    public:
+        using view_type = fxstring_view<T_CHAR>;
+        using size_type = size_t;
+        static constexpr size_type npos = -1;
+
+        class iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = view_type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const view_type *;
+            using reference = const view_type&;
+
+            iterator() : m_delimiter(), m_skip_empty(false), m_pos(npos), m_end(npos)
+            {
+            }
+            explicit iterator(const fxstring_split_range& range)
+                : m_str(range.m_str), m_delimiter(range.m_delimiter), m_skip_empty(range.m_skip_empty)
+            {
+                _find(0);
+            }
+
+            reference operator*() const
+            {
+                assert(m_pos != npos);
+                return m_value;
+            }
+            pointer operator->() const
+            {
+                assert(m_pos != npos);
+                return &m_value;
+            }
+            iterator& operator++()
+            {
+                assert(m_pos != npos);
+                if (m_end == m_str.size())
+                    m_pos = m_end = npos;
+                else
+                    _find(m_end + 1);
+                return *this;
+            }
+            iterator operator++(int)
+            {
+                iterator ret = *this;
+                ++*this;
+                return ret;
+            }
+            friend bool operator==(const iterator& lhs, const iterator& rhs)
+            {
+                return lhs.m_pos == rhs.m_pos;
+            }
+            friend bool operator!=(const iterator& lhs, const iterator& rhs)
+            {
+                return lhs.m_pos != rhs.m_pos;
+            }
+
+        protected:
+            view_type m_str;
+            T_DELIMITER m_delimiter;
+            bool m_skip_empty;
+            size_type m_pos;
+            size_type m_end;
+            view_type m_value;
+
+            void _find(size_type pos)
+            {
+                const T_CHAR *str = m_str.data();
+                const size_type len = m_str.size();
+                for (;;)
+                {
+                    const size_type end = m_delimiter.find(str, len, pos);
+                    if (end > pos || !m_skip_empty)
+                    {
+                        m_pos = pos;
+                        m_end = end;
+                        m_value = view_type(str + pos, end - pos);
+                        return;
+                    }
+                    if (end == len)
+                    {
+                        m_pos = m_end = npos;
+                        return;
+                    }
+                    pos = end + 1;
+                }
+            }
+        }; // iterator
+
+        using const_iterator = iterator;
+
+        fxstring_split_range(view_type str, T_DELIMITER delimiter, bool skip_empty)
+            : m_str(str), m_delimiter(delimiter), m_skip_empty(skip_empty)
+        {
+        }
+
+        iterator begin() const { return iterator(*this); }
+        iterator end() const { return iterator(); }
+
+        // Whether there are no pieces
+        bool empty() const { return begin() == end(); }
+
+    protected:
+        view_type m_str;
+        T_DELIMITER m_delimiter;
+        bool m_skip_empty;
+    }; // fxstring_split_range
+
+    //
+    // split: the pieces between each delimiter, including the empty ones.
+    // "a,,b" gives "a", "" and "b"; an empty string gives one empty piece.
+    //
+    template <typename T_CHAR>
+    inline fxstring_split_range<T_CHAR, detail::_split_char<T_CHAR>>
+    split(const T_CHAR *str, typename detail::_non_deduced<T_CHAR>::type delimiter)
+    {
+        const detail::_split_char<T_CHAR> delim = { delimiter };
+        return fxstring_split_range<T_CHAR, detail::_split_char<T_CHAR>>(str, delim, false);
+    }
+    template <typename T_STRING,
+              typename = typename std::enable_if<detail::is_string_class_likely<T_STRING>::value>::type>
+    inline fxstring_split_range<typename T_STRING::value_type, detail::_split_char<typename T_STRING::value_type>>
+    split(const T_STRING& str, typename T_STRING::value_type delimiter)
+    {
+        using char_type = typename T_STRING::value_type;
+        const detail::_split_char<char_type> delim = { delimiter };
+        return fxstring_split_range<char_type, detail::_split_char<char_type>>(
+            fxstring_view<char_type>(str.data(), str.size()), delim, false);
+    }
+
+    //
+    // split_any: the pieces between any of the delimiters, including the empty ones
+    //
+    template <typename T_CHAR>
+    inline fxstring_split_range<T_CHAR, detail::_split_set<T_CHAR>>
+    split_any(const T_CHAR *str, typename detail::_non_deduced<fxstring_view<T_CHAR>>::type delimiters)
+    {
+        const detail::_split_set<T_CHAR> delim = { delimiters };
+        return fxstring_split_range<T_CHAR, detail::_split_set<T_CHAR>>(str, delim, false);
+    }
+    template <typename T_STRING,
+              typename = typename std::enable_if<detail::is_string_class_likely<T_STRING>::value>::type>
+    inline fxstring_split_range<typename T_STRING::value_type, detail::_split_set<typename T_STRING::value_type>>
+    split_any(const T_STRING& str, fxstring_view<typename T_STRING::value_type> delimiters)
+    {
+        using char_type = typename T_STRING::value_type;
+        const detail::_split_set<char_type> delim = { delimiters };
+        return fxstring_split_range<char_type, detail::_split_set<char_type>>(
+            fxstring_view<char_type>(str.data(), str.size()), delim, false);
+    }
+
+    //
+    // tokenize: the non-empty pieces between any of the delimiters.
+    // ";a;;b;" gives "a" and "b".
+    //
+    template <typename T_CHAR>
+    inline fxstring_split_range<T_CHAR, detail::_split_set<T_CHAR>>
+    tokenize(const T_CHAR *str, typename detail::_non_deduced<fxstring_view<T_CHAR>>::type delimiters)
+    {
+        const detail::_split_set<T_CHAR> delim = { delimiters };
+        return fxstring_split_range<T_CHAR, detail::_split_set<T_CHAR>>(str, delim, true);
+    }
+    template <typename T_STRING,
+              typename = typename std::enable_if<detail::is_string_class_likely<T_STRING>::value>::type>
+    inline fxstring_split_range<typename T_STRING::value_type, detail::_split_set<typename T_STRING::value_type>>
+    tokenize(const T_STRING& str, fxstring_view<typename T_STRING::value_type> delimiters)
+    {
+        using char_type = typename T_STRING::value_type;
+        const detail::_split_set<char_type> delim = { delimiters };
+        return fxstring_split_range<char_type, detail::_split_set<char_type>>(
+            fxstring_view<char_type>(str.data(), str.size()), delim, true);
+    }
+
+    //
+    // split_whitespace: the non-empty pieces between ASCII whitespace
+    //
+    template <typename T_CHAR>
+    inline fxstring_split_range<T_CHAR, detail::_split_space<T_CHAR>>
+    split_whitespace(const T_CHAR *str)
+    {
+        return fxstring_split_range<T_CHAR, detail::_split_space<T_CHAR>>(str, detail::_split_space<T_CHAR>(), true);
+    }
+    template <typename T_STRING,
+              typename = typename std::enable_if<detail::is_string_class_likely<T_STRING>::value>::type>
+    inline fxstring_split_range<typename T_STRING::value_type, detail::_split_space<typename T_STRING::value_type>>
+    split_whitespace(const T_STRING& str)
+    {
+        using char_type = typename T_STRING::value_type;
+        return fxstring_split_range<char_type, detail::_split_space<char_type>>(
+            fxstring_view<char_type>(str.data(), str.size()), detail::_split_space<char_type>(), true);
+    }
+
+    //
+    // join: writes the parts with separators between them into dest. Each
+    // part is measured once and copied once, and the terminator is written
+    // once at the end. Returns false if the result was truncated to max_size().
+    //
+    namespace detail
+    {
+        template <typename T_CHAR>
+        inline bool _join_copy(T_CHAR *dest, size_t max_size, size_t& len, fxstring_view<T_CHAR> str)
+        {
+            const size_t n = _min(str.size(), max_size - len);
+            std::char_traits<T_CHAR>::copy(dest + len, str.data(), n);
+            len += n;
+            return n == str.size();
+        }
+
+        template <typename T_CHAR, typename T_ITERATOR>
+        inline bool _join(T_CHAR *dest, size_t max_size, T_ITERATOR first, T_ITERATOR last,
+                          fxstring_view<T_CHAR> separator)
+        {
+            size_t len = 0;
+            bool ret = true;
+            for (T_ITERATOR it = first; it != last && ret; ++it)
+            {
+                if (it != first)
+                    ret = _join_copy(dest, max_size, len, separator);
+                if (ret)
+                    ret = _join_copy(dest, max_size, len, fxstring_view<T_CHAR>(*it));
+            }
+            dest[len] = 0;
+            return ret;
+        }
+    } // namespace detail
+
+    template <typename T_CHAR, size_t t_buf_size, typename T_RANGE>
+    inline bool join(fxstring<T_CHAR, t_buf_size>& dest, const T_RANGE& parts,
+                     typename detail::_non_deduced<fxstring_view<T_CHAR>>::type separator)
+    {
+        using std::begin;
+        using std::end;
+        return detail::_join(dest.data(), dest.max_size(), begin(parts), end(parts), separator);
+    }
+    template <typename T_CHAR, size_t t_buf_size>
+    inline bool join(fxstring<T_CHAR, t_buf_size>& dest,
+                     std::initializer_list<typename detail::_non_deduced<fxstring_view<T_CHAR>>::type> parts,
+                     typename detail::_non_deduced<fxstring_view<T_CHAR>>::type separator)
+    {
+        return detail::_join(dest.data(), dest.max_size(), parts.begin(), parts.end(), separator);
+    }
+} // namespace khmz
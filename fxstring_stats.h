@@ -0,0 +1,311 @@
+// fxstring_stats.h --- instrumentation counters of fxstring operations
+// License: MIT
+
+#pragma once
+
+#include <atomic>           // For std::atomic
+#include <cstddef>          // For std::size_t
+#include <cstdint>          // For std::uint64_t
+#include <cstdio>           // For std::FILE, std::fprintf
+#include <map>              // For std::map
+#include <mutex>            // For std::mutex
+#include <utility>          // For std::pair
+#include <vector>           // For std::vector
+
+// The number of distinct capacities counted per thread; the rest share one entry
+#ifndef FXSTRING_STATS_CAPACITIES
+    #define FXSTRING_STATS_CAPACITIES 64
+#endif
+
+namespace khmz
+{
+    using size_t = std::size_t;
+
+    //
+    // What fxstring counts when FXSTRING_STATS is defined before including
+    // fxstring.h. Operations built on others count those too: replace()
+    // moves characters through erase and insert, and most operations scan
+    // the length through size().
+    //
+    enum class fxstring_stats_op
+    {
+        size,       // Length scans
+        assign,
+        append,
+        insert,
+        erase,
+        replace,
+        resize,
+        format,
+    };
+    static constexpr size_t fxstring_stats_op_count = 8;
+
+    inline const char *fxstring_stats_op_name(fxstring_stats_op op)
+    {
+        static const char *const s_names[fxstring_stats_op_count] =
+        {
+            "size", "assign", "append", "insert", "erase", "replace", "resize", "format",
+        };
+        return s_names[static_cast<size_t>(op)];
+    }
+
+    struct fxstring_stats_counters
+    {
+        std::uint64_t calls;
+        std::uint64_t scanned_bytes;    // Read to find the terminator
+        std::uint64_t moved_bytes;      // Shifted within the buffer to open or close a gap
+        std::uint64_t truncations;      // Calls that dropped characters at max_size()
+    };
+
+    // The counters of one operation on strings of one buf_size(), or of the capacities beyond the table (0)
+    struct fxstring_stats_entry
+    {
+        fxstring_stats_op op;
+        size_t capacity;
+        fxstring_stats_counters counters;
+    };
+
+    namespace detail
+    {
+        static constexpr size_t _stats_values = 4;
+
+        // Written by its thread only, and read by any; hence relaxed loads and stores, not RMW
+        struct _stats_slot
+        {
+            std::atomic<size_t> capacity;
+            std::atomic<std::uint64_t> values[fxstring_stats_op_count][_stats_values];
+        };
+
+        struct _stats_block;
+
+        //
+        // The blocks of the live threads, and the sums of the exited ones.
+        // Totals are raw sums; reset() records them as the baseline that
+        // later snapshots subtract, since other threads own the counters.
+        //
+        class _stats_registry
+        {
+        public:
+            using key_type = std::pair<size_t, size_t>;     // Capacity and operation
+            using totals_type = std::map<key_type, fxstring_stats_counters>;
+
+            void add(_stats_block *block)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_blocks.push_back(block);
+            }
+            inline void retire(_stats_block *block);
+
+            std::vector<fxstring_stats_entry> snapshot()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                const totals_type totals = _totals();
+                std::vector<fxstring_stats_entry> ret;
+                for (const totals_type::value_type& pair : totals)
+                {
+                    fxstring_stats_counters counters = pair.second;
+                    const totals_type::const_iterator base = m_baseline.find(pair.first);
+                    if (base != m_baseline.end())
+                    {
+                        counters.calls -= base->second.calls;
+                        counters.scanned_bytes -= base->second.scanned_bytes;
+                        counters.moved_bytes -= base->second.moved_bytes;
+                        counters.truncations -= base->second.truncations;
+                    }
+                    if (counters.calls)
+                    {
+                        const fxstring_stats_entry entry =
+                            { static_cast<fxstring_stats_op>(pair.first.second), pair.first.first, counters };
+                        ret.push_back(entry);
+                    }
+                }
+                return ret;
+            }
+            void reset()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_baseline = _totals();
+            }
+
+        protected:
+            std::mutex m_mutex;
+            std::vector<_stats_block *> m_blocks;
+            totals_type m_retired;
+            totals_type m_baseline;
+
+            static inline void _add_block(totals_type& totals, const _stats_block& block);
+            totals_type _totals() const
+            {
+                totals_type ret = m_retired;
+                for (const _stats_block *block : m_blocks)
+                    _add_block(ret, *block);
+                return ret;
+            }
+        };
+
+        inline _stats_registry& _stats_registry_instance()
+        {
+            static _stats_registry s_registry;
+            return s_registry;
+        }
+
+        // The counters of one thread
+        struct _stats_block
+        {
+            // The last slot is for the capacities that did not fit
+            _stats_slot slots[FXSTRING_STATS_CAPACITIES + 1];
+
+            _stats_block()
+            {
+                for (_stats_slot& slot : slots)
+                {
+                    slot.capacity.store(0, std::memory_order_relaxed);
+                    for (auto& values : slot.values)
+                        for (std::atomic<std::uint64_t>& value : values)
+                            value.store(0, std::memory_order_relaxed);
+                }
+                _stats_registry_instance().add(this);
+            }
+            ~_stats_block()
+            {
+                _stats_registry_instance().retire(this);
+            }
+            _stats_block(const _stats_block&) = delete;
+            _stats_block& operator=(const _stats_block&) = delete;
+
+            _stats_slot& find(size_t capacity)
+            {
+                const size_t i = static_cast<size_t>((std::uint64_t(capacity) * 0x9E3779B97F4A7C15ull) >> 32);
+                for (size_t probe = 0; probe < FXSTRING_STATS_CAPACITIES; ++probe)
+                {
+                    _stats_slot& slot = slots[(i + probe) % FXSTRING_STATS_CAPACITIES];
+                    const size_t key = slot.capacity.load(std::memory_order_relaxed);
+                    if (key == capacity)
+                        return slot;
+                    if (!key)
+                    {
+                        slot.capacity.store(capacity, std::memory_order_relaxed);
+                        return slot;
+                    }
+                }
+                return slots[FXSTRING_STATS_CAPACITIES];
+            }
+        };
+
+        inline void _stats_registry::retire(_stats_block *block)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            _add_block(m_retired, *block);
+            for (size_t i = 0; i < m_blocks.size(); ++i)
+            {
+                if (m_blocks[i] == block)
+                {
+                    m_blocks.erase(m_blocks.begin() + i);
+                    break;
+                }
+            }
+        }
+
+        inline void _stats_registry::_add_block(totals_type& totals, const _stats_block& block)
+        {
+            for (size_t i = 0; i <= FXSTRING_STATS_CAPACITIES; ++i)
+            {
+                const _stats_slot& slot = block.slots[i];
+                const size_t capacity = (i < FXSTRING_STATS_CAPACITIES)
+                                      ? slot.capacity.load(std::memory_order_relaxed) : 0;
+                if (!capacity && i < FXSTRING_STATS_CAPACITIES)
+                    continue;
+                for (size_t op = 0; op < fxstring_stats_op_count; ++op)
+                {
+                    const std::atomic<std::uint64_t> *values = slot.values[op];
+                    const std::uint64_t calls = values[0].load(std::memory_order_relaxed);
+                    if (!calls)
+                        continue;
+                    fxstring_stats_counters& counters = totals[key_type(capacity, op)];
+                    counters.calls += calls;
+                    counters.scanned_bytes += values[1].load(std::memory_order_relaxed);
+                    counters.moved_bytes += values[2].load(std::memory_order_relaxed);
+                    counters.truncations += values[3].load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        inline _stats_block& _stats_local()
+        {
+            thread_local _stats_block s_block;
+            return s_block;
+        }
+
+        inline void _stats_add(std::atomic<std::uint64_t>& value, std::uint64_t count)
+        {
+            value.store(value.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+        }
+
+        // The hook of FXSTRING_STATS_COUNT
+        inline void _stats_count(fxstring_stats_op op, size_t capacity, size_t scanned_bytes,
+                                 size_t moved_bytes, bool truncated)
+        {
+            std::atomic<std::uint64_t> *values = _stats_local().find(capacity).values[static_cast<size_t>(op)];
+            _stats_add(values[0], 1);
+            if (scanned_bytes)
+                _stats_add(values[1], scanned_bytes);
+            if (moved_bytes)
+                _stats_add(values[2], moved_bytes);
+            if (truncated)
+                _stats_add(values[3], 1);
+        }
+    } // namespace detail
+
+    //
+    // The counts of all threads since the start or fxstring_stats_reset(),
+    // by capacity and then operation. Threads that exited are included.
+    //
+    inline std::vector<fxstring_stats_entry> fxstring_stats_snapshot()
+    {
+        return detail::_stats_registry_instance().snapshot();
+    }
+
+    inline void fxstring_stats_reset()
+    {
+        detail::_stats_registry_instance().reset();
+    }
+
+    // Prints the snapshot as a table, with per-operation totals at the end
+    inline void fxstring_stats_dump(std::FILE *fp = stderr)
+    {
+        const std::vector<fxstring_stats_entry> entries = fxstring_stats_snapshot();
+        fxstring_stats_counters totals[fxstring_stats_op_count] = {};
+        std::fprintf(fp, "%-8s %-8s %14s %16s %16s %12s\n",
+                     "capacity", "op", "calls", "scanned bytes", "moved bytes", "truncations");
+        for (const fxstring_stats_entry& entry : entries)
+        {
+            const fxstring_stats_counters& c = entry.counters;
+            if (entry.capacity)
+                std::fprintf(fp, "%-8zu ", entry.capacity);
+            else
+                std::fprintf(fp, "%-8s ", "other");
+            std::fprintf(fp, "%-8s %14llu %16llu %16llu %12llu\n", fxstring_stats_op_name(entry.op),
+                         static_cast<unsigned long long>(c.calls),
+                         static_cast<unsigned long long>(c.scanned_bytes),
+                         static_cast<unsigned long long>(c.moved_bytes),
+                         static_cast<unsigned long long>(c.truncations));
+            fxstring_stats_counters& total = totals[static_cast<size_t>(entry.op)];
+            total.calls += c.calls;
+            total.scanned_bytes += c.scanned_bytes;
+            total.moved_bytes += c.moved_bytes;
+            total.truncations += c.truncations;
+        }
+        for (size_t op = 0; op < fxstring_stats_op_count; ++op)
+        {
+            const fxstring_stats_counters& c = totals[op];
+            if (!c.calls)
+                continue;
+            std::fprintf(fp, "%-8s %-8s %14llu %16llu %16llu %12llu\n", "all",
+                         fxstring_stats_op_name(static_cast<fxstring_stats_op>(op)),
+                         static_cast<unsigned long long>(c.calls),
+                         static_cast<unsigned long long>(c.scanned_bytes),
+                         static_cast<unsigned long long>(c.moved_bytes),
+                         static_cast<unsigned long long>(c.truncations));
+        }
+    }
+} // namespace khmz
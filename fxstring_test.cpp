@@ -2,7 +2,31 @@
 // License: MIT
 
 #include "fxstring.h"
+#include "fxstring_utf.h"
+#include "fxstring_codec.h"
+#include "fxstring_column.h"
+#include "fxstring_batch.h"
+#include "fxstring_file.h"
+#include "fxstring_serial.h"
+#include "fxstring_reader.h"
+#include "fxstring_csv.h"
+#include "fxstring_split.h"
+#include "fxstring_queue.h"
+#include "fxstring_logger.h"
+#include "fxstring_atomic.h"
+#include "fxstring_concat.h"
+#include "fxstring_builder.h"
+#include "fxstring_hybrid.h"
+#include "fxstring_stats.h"
+#include "fxstring_glob.h"
+#include "fxstring_regex.h"
+#include "fxstring_distance.h"
 #include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <thread>
+#include <regex>
+#include <unordered_set>
 
 template <size_t t_buf_size>
 using string_t = khmz::fxstring<char, t_buf_size>;
@@ -658,6 +682,36 @@ static void fxstring_appending_tests(void)
         str.append({ 'B' });
         assert(str == "AB");
     }
+    {
+        // push_back fills every slot up to max_size(), then truncates
+        string_t<4> str("ab");
+        str.push_back('c');
+        assert(str == "abc" && str.size() == str.max_size());
+        str.push_back('d');
+        assert(str == "abc");
+        string_t<2> one;
+        one.push_back('x');
+        assert(one == "x");
+    }
+    {
+        // append(count, ch) fills and truncates like append(str, count)
+        string_t<6> str("ab");
+        assert(str.append(2, 'x') == "abxx");
+        assert(str.append(0, 'y') == "abxx");
+        str.append(5, 'z');
+        assert(str == "abxxz" && str.size() == str.max_size());
+        khmz::fxstring_w<4> wide;
+        assert(wide.append(9, L'w') == L"www");
+    }
+    {
+        // append(first, last) returns the string and copy() the count copied
+        string_t<16> text("hello");
+        std::string tail = "xyz";
+        assert(text.append(tail.begin(), tail.end()) == "helloxyz");
+        char buf[4];
+        assert(text.copy(buf, 3, 1) == 3 && std::memcmp(buf, "ell", 3) == 0);
+        assert(text.copy(buf, 4, 6) == 2 && std::memcmp(buf, "yz", 2) == 0);
+    }
 }
 
 static void fxstring_insertion_tests(void)
@@ -798,6 +852,2025 @@ static void fxstring_replacing_tests(void)
         str.replace(1, 3, "");
         assert(str == "A");
     }
+    {
+        // A replacement longer than the room left is clipped to max_size()
+        string_t<4> str("abc");
+        str.replace(1, 1, "wxyz");
+        assert(str == "awx" && str.size() == 3);
+        str.replace(3, 0, "tail");
+        assert(str == "awx");
+        str.replace(0, 3, std::string("0123456"));
+        assert(str == "012");
+
+        // String classes are read up to size(), not up to a terminator
+        string_t<8> text("abcd");
+        text.replace(1, 2, khmz::fxstring_view_a("xyz", 2));
+        assert(text == "axyd");
+        text.replace(text.cbegin(), text.cbegin() + 1, khmz::fxstring_view_a("QRS", 1));
+        assert(text == "Qxyd");
+    }
+}
+
+static void fxstring_utf_tests(void)
+{
+    {
+        // ASCII, longer than a vector
+        const char *text = "The quick brown fox jumps over the lazy dog";
+        khmz::fxstring_w<64> wstr;
+        khmz::transcode_result ret = khmz::transcode(wstr, text);
+        assert(ret.read == std::strlen(text));
+        assert(ret.written == std::strlen(text));
+        assert(wstr == std::wstring(text, text + std::strlen(text)));
+
+        khmz::fxstring_a<64> str;
+        khmz::transcode(str, wstr);
+        assert(str == text);
+
+        khmz::fxstring_u16<64> u16;
+        khmz::transcode(u16, str);
+        assert(u16.size() == str.size());
+        khmz::fxstring_a<64> str2;
+        khmz::transcode(str2, u16);
+        assert(str2 == text);
+    }
+    {
+        // U+3042, U+1F600
+        const char *text = "a\xE3\x81\x82\xF0\x9F\x98\x80";
+        khmz::fxstring_u16<8> u16;
+        khmz::transcode(u16, text);
+        assert(u16.size() == 4);
+        assert(u16[0] == u'a' && u16[1] == 0x3042 && u16[2] == 0xD83D && u16[3] == 0xDE00);
+
+        khmz::fxstring_u32<8> u32;
+        khmz::transcode(u32, u16);
+        assert(u32.size() == 3);
+        assert(u32[0] == U'a' && u32[1] == 0x3042 && u32[2] == 0x1F600);
+
+        khmz::fxstring_a<16> str;
+        khmz::transcode(str, u32);
+        assert(str == text);
+
+        khmz::fxstring_w<8> wstr;
+        khmz::transcode(wstr, text);
+        assert(wstr.size() == (sizeof(wchar_t) == 2 ? 4u : 3u));
+    }
+    {
+        // Truncation never splits a code point
+        const char *text = "a\xF0\x9F\x98\x80";
+        khmz::fxstring_u16<3> u16;
+        khmz::transcode_result ret = khmz::transcode(u16, text);
+        assert(ret.read == 1);
+        assert(u16.size() == 1);
+
+        khmz::fxstring_u32<2> u32 = { U'\x3042' };
+        khmz::fxstring_a<3> str;
+        ret = khmz::transcode(str, u32);
+        assert(ret.read == 0);
+        assert(str.empty());
+    }
+    {
+        // Invalid input becomes U+FFFD
+        khmz::fxstring_u32<8> u32;
+        khmz::transcode(u32, "\xC0\xAF" "A\xED\xA0\x80");
+        assert(u32.size() == 3);
+        assert(u32[0] == 0xFFFD && u32[1] == U'A' && u32[2] == 0xFFFD);
+
+        khmz::fxstring_u16<4> u16 = { 0xD800, u'B' };
+        khmz::fxstring_a<8> str;
+        khmz::transcode(str, u16);
+        assert(str == "\xEF\xBF\xBD" "B");
+    }
+}
+
+static void fxstring_utf8_validation_tests(void)
+{
+    {
+        assert(khmz::is_valid_utf8(""));
+        assert(khmz::is_valid_utf8("The quick brown fox jumps over the lazy dog"));
+        assert(khmz::is_valid_utf8("a\xC2\x80\xE3\x81\x82\xF0\x9F\x98\x80\xF4\x8F\xBF\xBF"));
+        assert(!khmz::is_valid_utf8("\x80"));
+        assert(!khmz::is_valid_utf8("\xC0\xAF"));             // overlong
+        assert(!khmz::is_valid_utf8("\xE0\x9F\xBF"));         // overlong
+        assert(!khmz::is_valid_utf8("\xED\xA0\x80"));         // surrogate
+        assert(!khmz::is_valid_utf8("\xF4\x90\x80\x80"));     // beyond U+10FFFF
+        assert(!khmz::is_valid_utf8("\xE3\x81"));             // incomplete
+        assert(khmz::utf8_validate("0123456789ABCDEFGH\xFF", 19) == 18);
+
+        khmz::fxstring_a<8> str = "\xE3\x81\x82";
+        assert(khmz::is_valid_utf8(str));
+        assert(!khmz::is_ascii(str));
+        str = "ASCII";
+        assert(khmz::is_ascii(str));
+        assert(khmz::is_ascii(L"wide", 4));
+        assert(!khmz::is_ascii(u"\x3042", 1));
+    }
+    {
+        // U+3042 is 3 bytes
+        khmz::fxstring_a<5> str;
+        str.assign(khmz::utf_truncate, "ab\xE3\x81\x82");
+        assert(str == "ab");
+        str.assign(khmz::utf_truncate, "a\xE3\x81\x82");
+        assert(str == "a\xE3\x81\x82");
+        str.assign(khmz::utf_truncate, "abcdef");
+        assert(str == "abcd");
+
+        str = "ab";
+        str.append(khmz::utf_truncate, "\xE3\x81\x82");
+        assert(str == "ab");
+        str.append(khmz::utf_truncate, std::string("c\xC2\x80"));
+        assert(str == "abc");
+
+        str = "a\xE3\x81\x82";
+        str.insert(khmz::utf_truncate, 0, "b");
+        assert(str == "ba");
+        str.insert(khmz::utf_truncate, 1, "\xC2\x80");
+        assert(str == "b\xC2\x80" "a");
+
+        khmz::fxstring_a<4> str2(khmz::utf_truncate, "\xF0\x9F\x98\x80");
+        assert(str2.empty());
+    }
+    {
+        khmz::fxstring_u16<3> u16;
+        u16.assign(khmz::utf_truncate, u"a\U0001F600");
+        assert(u16.size() == 1);
+        u16.assign(khmz::utf_truncate, u"\U0001F600");
+        assert(u16.size() == 2);
+    }
+}
+
+static void fxstring_codec_tests(void)
+{
+    unsigned char digest[32];
+    for (size_t i = 0; i < sizeof(digest); ++i)
+        digest[i] = static_cast<unsigned char>(i * 37 + 5);
+    {
+        khmz::fxstring_a<65> hex;
+        khmz::hex_encode(hex, digest);
+        assert(hex.size() == 64);
+        char expected[65];
+        for (size_t i = 0; i < sizeof(digest); ++i)
+            std::sprintf(&expected[2 * i], "%02x", digest[i]);
+        assert(hex == expected);
+        assert(khmz::hex_encode(digest) == hex);
+
+        unsigned char decoded[32];
+        assert(khmz::hex_decode(decoded, hex));
+        assert(std::memcmp(decoded, digest, sizeof(digest)) == 0);
+
+        for (auto& ch : hex)
+            ch = static_cast<char>(std::toupper(ch));
+        assert(khmz::hex_decode(decoded, hex));
+        assert(std::memcmp(decoded, digest, sizeof(digest)) == 0);
+
+        hex[40] = 'g';
+        assert(!khmz::hex_decode(decoded, hex));
+        hex.resize(63);
+        assert(!khmz::hex_decode(decoded, hex));
+    }
+    {
+        khmz::fxstring_a<45> b64;
+        khmz::base64_encode(b64, digest);
+        assert(b64.size() == 44);
+        assert(khmz::base64_encode(digest) == b64);
+
+        unsigned char decoded[32];
+        assert(khmz::base64_decode(decoded, b64));
+        assert(std::memcmp(decoded, digest, sizeof(digest)) == 0);
+
+        b64[3] = '*';
+        assert(!khmz::base64_decode(decoded, b64));
+    }
+    {
+        // RFC 4648 test vectors
+        const char *vectors[][2] =
+        {
+            { "", "" }, { "f", "Zg==" }, { "fo", "Zm8=" }, { "foo", "Zm9v" },
+            { "foob", "Zm9vYg==" }, { "fooba", "Zm9vYmE=" }, { "foobar", "Zm9vYmFy" },
+            { "Many hands make light work.", "TWFueSBoYW5kcyBtYWtlIGxpZ2h0IHdvcmsu" },
+        };
+        for (auto& item : vectors)
+        {
+            char buf[64];
+            size_t len = khmz::base64_encode(buf, item[0], std::strlen(item[0]));
+            assert(std::string(buf, len) == item[1]);
+
+            size_t size;
+            assert(khmz::base64_decode(buf, size, item[1], std::strlen(item[1])));
+            assert(std::string(buf, size) == item[0]);
+
+            len = khmz::hex_encode(buf, item[0], std::strlen(item[0]));
+            char bytes[32];
+            assert(khmz::hex_decode(bytes, size, buf, len));
+            assert(std::string(bytes, size) == item[0]);
+        }
+
+        // Padding that doesn't complete a quantum, and nonzero unused bits
+        static const char *const s_malformed[] = { "AAAA=", "AA=", "Zg=", "Zm8==", "Zh==", "Zm9=", "Zh", "Zm9" };
+        for (const char *item : s_malformed)
+        {
+            char buf[8];
+            size_t size;
+            assert(!khmz::base64_decode(buf, size, item, std::strlen(item)));
+        }
+        char buf[8];
+        size_t size;
+        assert(khmz::base64_decode(buf, size, "Zg", 2) && size == 1 && buf[0] == 'f');
+        assert(khmz::base64_decode(buf, size, "Zm8", 3) && size == 2);
+    }
+}
+
+static void fxstring_view_tests(void)
+{
+    {
+        khmz::fxstring_view_a view("ABCDEF", 4);
+        assert(view.size() == 4);
+        assert(view == khmz::fxstring_view_a("ABCD"));
+        assert(view.substr(1, 2) == khmz::fxstring_view_a("BC"));
+        assert(view.starts_with("AB"));
+        assert(view.ends_with("CD"));
+        assert(view.find('C') == 2);
+        assert(view.find('E') == view.npos);
+
+        string_t<8> str = view;
+        assert(str == "ABCD");
+        assert(str.compare(view) == 0);
+        assert(str.compare(khmz::fxstring_view_a("ABCDE", 3)) > 0);
+        assert(str.compare(khmz::fxstring_view_a("ABCDE", 5)) < 0);
+        assert(khmz::fxstring_view_a(str) == view);
+    }
+}
+
+static void fxstring_column_tests(void)
+{
+    const char *words[] =
+    {
+        "apple", "banana", "cherry", "apple", "apricot", "", "applesauce-long", "APPLE"
+    };
+    for (int with_hashes = 0; with_hashes < 2; ++with_hashes)
+    {
+        khmz::fxstring_column_a<12> column(with_hashes != 0);
+        for (int i = 0; i < 20; ++i)
+            column.append(std::begin(words), std::end(words));
+        assert(column.size() == 160);
+        assert(column[1] == khmz::fxstring_view_a("banana"));
+        assert(column[6] == khmz::fxstring_view_a("applesauce-"));
+        assert(column.length(6) == 11);
+        assert(column.value(2) == "cherry");
+
+        std::vector<std::uint64_t> bitmap(column.bitmap_size());
+        assert(column.equal("apple", bitmap.data()) == 40);
+        assert(bitmap[0] & (1 << 0));
+        assert(bitmap[0] & (1 << 3));
+        assert(!(bitmap[0] & (1 << 7)));
+        assert(column.equal("", bitmap.data()) == 20);
+        assert(column.equal("applesauce-long", bitmap.data()) == 0);
+
+        assert(column.starts_with("ap", bitmap.data()) == 80);
+        assert(column.starts_with("", bitmap.data()) == 160);
+
+        std::vector<size_t> hashes(column.size());
+        column.hash_all(hashes.data());
+        std::hash<string_t<12>> hasher;
+        for (size_t i = 0; i < column.size(); ++i)
+            assert(hashes[i] == hasher(column.value(i)));
+
+        column.to_upper();
+        assert(column[0] == khmz::fxstring_view_a("APPLE"));
+        assert(column.equal("APPLE", bitmap.data()) == 60);
+        column.to_lower();
+        assert(column.equal("apple", bitmap.data()) == 60);
+        assert(column.hash(0) == hasher(column.value(0)));
+
+        column.set(0, "cherry");
+        assert(column[0] == khmz::fxstring_view_a("cherry"));
+        assert(column.equal("cherry", bitmap.data()) == 21);
+    }
+}
+
+template <typename T_CHAR, size_t t_buf_size>
+static void fxstring_batch_test(const T_CHAR *const *keys, size_t key_count)
+{
+    using fxstr = khmz::fxstring<T_CHAR, t_buf_size>;
+    std::vector<fxstr> rows;
+    for (size_t i = 0; i < 150; ++i)
+    {
+        fxstr str = keys[(i * 7) % key_count];
+        // garbage after the terminator
+        const size_t len = str.size();
+        if (len + 1 < str.max_size())
+            str.data()[len + 1] = T_CHAR('@');
+        rows.push_back(str);
+    }
+
+    std::vector<std::uint64_t> bitmap((rows.size() + 63) / 64);
+    std::vector<size_t> indexes(rows.size());
+    for (size_t i = 0; i < key_count; ++i)
+    {
+        const std::basic_string<T_CHAR> key = keys[i];
+        const khmz::fxstring_predicate<T_CHAR> preds[] =
+        {
+            khmz::pred::equal(key), khmz::pred::not_equal(key), khmz::pred::starts_with(key),
+            khmz::pred::less(key), khmz::pred::less_equal(key),
+            khmz::pred::greater(key), khmz::pred::greater_equal(key),
+        };
+        for (auto& pred : preds)
+        {
+            size_t count = khmz::select(rows.data(), rows.size(), pred, bitmap.data());
+            size_t index_count = khmz::select_indexes(rows.data(), rows.size(), pred, indexes.data());
+            assert(count == index_count);
+            size_t expected_count = 0;
+            for (size_t k = 0; k < rows.size(); ++k)
+            {
+                const std::basic_string<T_CHAR> row = rows[k].c_str();
+                bool expected = false;
+                switch (pred.op)
+                {
+                case khmz::fxstring_predicate<T_CHAR>::equal:         expected = (row == key); break;
+                case khmz::fxstring_predicate<T_CHAR>::not_equal:     expected = (row != key); break;
+                case khmz::fxstring_predicate<T_CHAR>::starts_with:   expected = (row.compare(0, key.size(), key) == 0); break;
+                case khmz::fxstring_predicate<T_CHAR>::less:          expected = (row < key); break;
+                case khmz::fxstring_predicate<T_CHAR>::less_equal:    expected = (row <= key); break;
+                case khmz::fxstring_predicate<T_CHAR>::greater:       expected = (row > key); break;
+                case khmz::fxstring_predicate<T_CHAR>::greater_equal: expected = (row >= key); break;
+                }
+                assert(((bitmap[k / 64] >> (k % 64)) & 1) == (expected ? 1u : 0u));
+                if (expected)
+                    assert(indexes[expected_count++] == k);
+            }
+            assert(count == expected_count);
+        }
+    }
+}
+
+template <typename T_CHAR, size_t t_buf_size>
+static void fxstring_hash_batch_test(const T_CHAR *const *keys, size_t key_count)
+{
+    std::vector<khmz::fxstring<T_CHAR, t_buf_size>> rows;
+    for (size_t i = 0; i < 23; ++i)
+        rows.push_back(keys[(i * 5) % key_count]);
+    std::vector<std::uint64_t> hashes(rows.size());
+    khmz::hash_batch(rows.data(), rows.size(), hashes.data());
+    std::hash<khmz::fxstring<T_CHAR, t_buf_size>> hasher;
+    for (size_t i = 0; i < rows.size(); ++i)
+        assert(hashes[i] == hasher(rows[i]));
+}
+
+static void fxstring_batch_tests(void)
+{
+    static const char *keys[] =
+    {
+        "", "A", "AB", "ABC", "ABD", "AAA", "B", "Z", "\xE3\x81\x82",
+        "0123456789ABCDEF", "0123456789ABCDEFG", "0123456789ABCDEFGHIJKLMNOPQRSTUV",
+    };
+    fxstring_batch_test<char, 1>(keys, 1);
+    fxstring_batch_test<char, 2>(keys, 9);
+    fxstring_batch_test<char, 4>(keys, 9);
+    fxstring_batch_test<char, 8>(keys, 9);
+    fxstring_batch_test<char, 12>(keys, 12);
+    fxstring_batch_test<char, 16>(keys, 12);
+    fxstring_batch_test<char, 17>(keys, 12);
+    fxstring_batch_test<char, 32>(keys, 12);
+    fxstring_batch_test<char, 40>(keys, 12);
+
+    static const wchar_t *wkeys[] =
+    {
+        L"", L"A", L"AB", L"ABC", L"ABD", L"\x3042", L"0123456789", L"0123456789ABCDEFGHIJ",
+    };
+    fxstring_batch_test<wchar_t, 2>(wkeys, 8);
+    fxstring_batch_test<wchar_t, 4>(wkeys, 8);
+    fxstring_batch_test<wchar_t, 5>(wkeys, 8);
+    fxstring_batch_test<wchar_t, 16>(wkeys, 8);
+
+    fxstring_hash_batch_test<char, 1>(keys, 12);
+    fxstring_hash_batch_test<char, 8>(keys, 12);
+    fxstring_hash_batch_test<char, 17>(keys, 12);
+    fxstring_hash_batch_test<char, 40>(keys, 12);
+    fxstring_hash_batch_test<wchar_t, 16>(wkeys, 8);
+}
+
+static void fxstring_file_tests(void)
+{
+    const char *path = "fxstring_test_file.bin";
+
+    std::vector<khmz::fxstring_a<32>> records;
+    for (int i = 0; i < 1000; ++i)
+    {
+        khmz::fxstring_a<32> str("record ");
+        str += std::to_string(i);
+        records.push_back(str);
+    }
+    records[3] = "";
+    records[4] = "0123456789012345678901234567890123456789";
+
+    {
+        khmz::fxstring_file_writer<char, 32> writer(path);
+        assert(writer.is_open());
+        assert(writer.write(records[0]));
+        assert(writer.write(&records[1], records.size() - 1));
+        assert(writer.size() == records.size());
+        assert(writer.close());
+    }
+    {
+        khmz::fxstring_file_reader<char, 32> reader(path, true);
+        assert(reader.is_open());
+        assert(reader.size() == records.size());
+        assert(reader[0] == "record 0");
+        assert(reader[3].empty());
+        assert(reader[4] == "0123456789012345678901234567890");
+        assert(reader.at(999) == "record 999");
+        assert(std::equal(reader.begin(), reader.end(), records.begin()));
+        size_t count = 0;
+        for (const khmz::fxstring_a<32>& str : reader)
+            count += (str.find('7') != str.npos);
+        assert(count == 272);
+
+        khmz::fxstring_file_reader<char, 32> moved(std::move(reader));
+        assert(!reader.is_open());
+        assert(moved.size() == records.size());
+    }
+    {
+        // Mismatches of the capacity and the character type
+        khmz::fxstring_file_reader<char, 16> reader16(path);
+        assert(!reader16.is_open());
+        khmz::fxstring_file_reader<wchar_t, 32> readerw(path);
+        assert(!readerw.is_open());
+    }
+
+#ifndef _WIN32
+    {
+        // Failed writes make close() fail; the device isn't removed
+        khmz::fxstring_file_writer<char, 32> writer("/dev/full");
+        if (writer.is_open())
+        {
+            assert(!writer.write(records.data(), records.size()) && !writer.is_open());
+            assert(!writer.close() && !writer.close());
+            struct stat st;
+            assert(::stat("/dev/full", &st) == 0);
+        }
+    }
+#endif
+
+    assert(khmz::write_fxstring_file(path, records.data(), 0));
+    {
+        khmz::fxstring_file_reader<char, 32> reader(path);
+        assert(reader.is_open());
+        assert(reader.empty());
+        assert(reader.begin() == reader.end());
+    }
+
+    {
+        // A truncated file
+        assert(khmz::write_fxstring_file(path, records.data(), 10));
+        std::FILE *fp = std::fopen(path, "r+b");
+        assert(fp);
+        khmz::fxstring_file_header header;
+        assert(std::fread(&header, sizeof(header), 1, fp) == 1);
+        header.count = 11;
+        std::rewind(fp);
+        assert(std::fwrite(&header, sizeof(header), 1, fp) == 1);
+        std::fclose(fp);
+        khmz::fxstring_file_reader<char, 32> reader(path);
+        assert(!reader.is_open());
+    }
+
+    khmz::fxstring_file_reader<char, 32> missing("fxstring_test_missing.bin");
+    assert(!missing.is_open());
+
+    std::remove(path);
+}
+
+static void fxstring_serial_tests(void)
+{
+    unsigned char buf[1024];
+
+    static_assert(khmz::varint_length(127) == 1 && khmz::varint_length(128) == 2, "");
+    static_assert(khmz::max_serialized_size<char, 32>() == 32, "");
+    static_assert(khmz::max_serialized_size<char16_t, 64>() == 2 + 189, "");
+
+    {
+        khmz::fxstring_a<32> str("hello"), out("garbage");
+        assert(khmz::serialized_size(str) == 6);
+        assert(khmz::serialize(buf, sizeof(buf), str) == 6);
+        assert(buf[0] == 5 && std::memcmp(&buf[1], "hello", 5) == 0);
+        assert(khmz::deserialize(out, buf, 6) == 6);
+        assert(out == "hello");
+
+        // Too small buffers and truncated input
+        assert(khmz::serialize(buf, 5, str) == 0);
+        assert(khmz::deserialize(out, buf, 5) == 0);
+        assert(khmz::deserialize(out, buf, 0) == 0);
+
+        // Too small capacity
+        khmz::fxstring_a<5> small;
+        assert(khmz::deserialize(small, buf, 6) == 0);
+        assert(small.empty());
+
+        str.clear();
+        assert(khmz::serialize(buf, sizeof(buf), str) == 1 && buf[0] == 0);
+        assert(khmz::deserialize(out, buf, 1) == 1 && out.empty());
+    }
+    {
+        // A two-byte varint
+        khmz::fxstring_a<256> str;
+        str.assign(200, 'x');
+        assert(khmz::serialize(buf, sizeof(buf), str) == 202);
+        assert(buf[0] == (0x80 | (200 & 0x7F)) && buf[1] == 1);
+        khmz::fxstring_a<256> out;
+        assert(khmz::deserialize(out, buf, 202) == 202);
+        assert(out == str);
+
+        // Overlong varints are rejected
+        std::memset(buf, 0xFF, 11);
+        assert(khmz::deserialize(out, buf, 11) == 0);
+    }
+    {
+        // wchar_t, char16_t and char32_t are encoded as UTF-8
+        const wchar_t wide[] = { L'a', 0x3042, 0x20AC, 0 };
+        const unsigned char utf8[] = { 7, 'a', 0xE3, 0x81, 0x82, 0xE2, 0x82, 0xAC };
+        khmz::fxstring_w<16> wstr(wide), wout;
+        assert(khmz::serialized_size(wstr) == sizeof(utf8));
+        assert(khmz::serialize(buf, sizeof(buf), wstr) == sizeof(utf8));
+        assert(std::memcmp(buf, utf8, sizeof(utf8)) == 0);
+        assert(khmz::deserialize(wout, buf, sizeof(utf8)) == sizeof(utf8));
+        assert(wout == wstr);
+
+        khmz::fxstring_u16<8> u16;
+        assert(khmz::deserialize(u16, buf, sizeof(utf8)) == sizeof(utf8));
+        assert(u16.size() == 3 && u16[1] == 0x3042);
+        khmz::fxstring_u16<3> u16small;
+        assert(khmz::deserialize(u16small, buf, sizeof(utf8)) == 0);
+
+        // A surrogate pair becomes one 4-byte sequence
+        const char16_t pair[] = { 0xD83D, 0xDE00, 0 };
+        khmz::fxstring_u16<8> u16pair(pair);
+        const unsigned char emoji[] = { 4, 0xF0, 0x9F, 0x98, 0x80 };
+        assert(khmz::serialize(buf, sizeof(buf), u16pair) == sizeof(emoji));
+        assert(std::memcmp(buf, emoji, sizeof(emoji)) == 0);
+        khmz::fxstring_u32<4> u32;
+        assert(khmz::deserialize(u32, buf, sizeof(emoji)) == sizeof(emoji));
+        assert(u32.size() == 1 && u32[0] == 0x1F600);
+    }
+    {
+        // Ranges
+        khmz::fxstring_a<16> strs[4] = { "one", "", "three", "four" };
+        const size_t size = khmz::serialized_size(strs, 4);
+        assert(size == 1 + 4 + 1 + 6 + 5);
+        assert(khmz::serialize(buf, size - 1, strs, 4) == 0);
+        assert(khmz::serialize(buf, sizeof(buf), strs, 4) == size);
+        assert(buf[0] == 4);
+
+        khmz::fxstring_a<16> out[4];
+        size_t count = 4;
+        assert(khmz::deserialize(out, count, buf, size) == size);
+        assert(count == 4);
+        assert(std::equal(out, out + 4, strs));
+
+        count = 3;
+        assert(khmz::deserialize(out, count, buf, size) == 0);
+        count = 4;
+        assert(khmz::deserialize(out, count, buf, size - 1) == 0);
+        assert(count == 3);
+    }
+}
+
+// The lines of text as fxstring_line_reader should return them
+static std::vector<std::string>
+fxstring_reference_lines(const std::string& text, khmz::fxstring_line_reader::long_line_policy policy,
+                         size_t limit, size_t& long_lines)
+{
+    std::vector<std::string> ret;
+    long_lines = 0;
+    size_t begin = 0;
+    while (begin < text.size())
+    {
+        size_t end = text.find('\n', begin);
+        const bool terminated = (end != std::string::npos);
+        if (!terminated)
+            end = text.size();
+        std::string line = text.substr(begin, end - begin);
+        if (terminated && !line.empty() && line.back() == '\r')
+            line.pop_back();
+        begin = end + 1;
+        if (line.size() <= limit)
+        {
+            ret.push_back(line);
+            continue;
+        }
+        ++long_lines;
+        switch (policy)
+        {
+        case khmz::fxstring_line_reader::truncate:
+            ret.push_back(line.substr(0, limit));
+            break;
+        case khmz::fxstring_line_reader::split:
+            while (line.size() > limit)
+            {
+                ret.push_back(line.substr(0, limit));
+                line.erase(0, limit);
+            }
+            ret.push_back(line);
+            break;
+        case khmz::fxstring_line_reader::skip:
+            break;
+        }
+    }
+    return ret;
+}
+
+static void fxstring_reader_test(const std::string& text, khmz::fxstring_line_reader::long_line_policy policy,
+                                 size_t max_line, size_t block_size)
+{
+    std::FILE *fp = std::tmpfile();
+    assert(fp);
+    assert(std::fwrite(text.data(), 1, text.size(), fp) == text.size());
+
+    size_t expected_long_lines;
+    const std::vector<std::string> expected = fxstring_reference_lines(text, policy, max_line, expected_long_lines);
+    {
+        std::rewind(fp);
+        khmz::fxstring_line_reader reader(fp, policy, max_line, block_size);
+        khmz::fxstring_view_a line;
+        size_t i = 0;
+        while (reader.next(line))
+        {
+            assert(i < expected.size());
+            assert(std::string(line.data(), line.size()) == expected[i]);
+            ++i;
+        }
+        assert(i == expected.size());
+        assert(reader.eof() && !reader.error());
+        assert(reader.long_lines() == expected_long_lines);
+    }
+#ifndef _WIN32
+    {
+        // Into fxstrings, from a file descriptor
+        std::rewind(fp);
+        khmz::fxstring_line_reader reader(fileno(fp), policy, 1000, block_size);
+        khmz::fxstring_a<8> line;
+        const std::vector<std::string> expected8 = fxstring_reference_lines(text, policy, 7, expected_long_lines);
+        size_t i = 0;
+        while (reader.next(line))
+        {
+            assert(i < expected8.size());
+            assert(line == expected8[i].c_str());
+            ++i;
+        }
+        assert(i == expected8.size());
+        assert(line.empty());
+    }
+#endif
+    std::fclose(fp);
+}
+
+static void fxstring_reader_tests(void)
+{
+    assert(khmz::detail::_find_char("abc", "abc" + 3, 'x') == "abc" + 3);
+    {
+        char buf[200];
+        for (size_t i = 0; i < sizeof(buf); ++i)
+            buf[i] = 'a';
+        for (size_t pos = 0; pos < sizeof(buf); ++pos)
+        {
+            buf[pos] = '\n';
+            assert(khmz::detail::_find_char(buf, buf + sizeof(buf), '\n') == buf + pos);
+            assert(khmz::detail::_find_char(buf, buf + pos, '\n') == buf + pos);
+            buf[pos] = 'a';
+        }
+    }
+
+    {
+        std::FILE *fp = std::tmpfile();
+        assert(fp);
+        std::fputs("abcdefgh\r\nxy", fp);
+        std::rewind(fp);
+        khmz::fxstring_line_reader reader(fp, khmz::fxstring_line_reader::split, 3);
+        khmz::fxstring_a<16> line;
+        assert(reader.next(line) && line == "abc" && reader.truncated());
+        assert(reader.next(line) && line == "def" && reader.truncated());
+        assert(reader.next(line) && line == "gh" && !reader.truncated());
+        assert(reader.next(line) && line == "xy" && !reader.truncated());
+        assert(!reader.next(line) && reader.eof());
+        assert(reader.long_lines() == 1);
+        std::fclose(fp);
+    }
+
+    const char *texts[] =
+    {
+        "",
+        "\n",
+        "one",
+        "one\ntwo\nthree\n",
+        "one\r\ntwo\r\n\r\nlast",
+        "short\nthis line is rather long\nmid\n\nanother very long line without end",
+        "123456\r\n1234567\r\n12345678\r\n123456789\n\r\r\n",
+    };
+    const khmz::fxstring_line_reader::long_line_policy policies[] =
+    {
+        khmz::fxstring_line_reader::truncate,
+        khmz::fxstring_line_reader::split,
+        khmz::fxstring_line_reader::skip,
+    };
+    std::string random_text;
+    unsigned seed = 1;
+    for (int i = 0; i < 3000; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        const unsigned r = (seed >> 16) % 23;
+        random_text += (r == 0) ? '\n' : (r == 1) ? '\r' : char('a' + r);
+    }
+    for (const khmz::fxstring_line_reader::long_line_policy policy : policies)
+    {
+        for (const char *text : texts)
+        {
+            for (size_t max_line = 1; max_line <= 9; ++max_line)
+            {
+                fxstring_reader_test(text, policy, max_line, 1);
+                fxstring_reader_test(text, policy, max_line, 3);
+                fxstring_reader_test(text, policy, max_line, 64);
+            }
+        }
+        fxstring_reader_test(random_text, policy, 5, 7);
+        fxstring_reader_test(random_text, policy, 40, 100);
+        fxstring_reader_test(random_text, policy, 1000, 1 << 16);
+    }
+}
+
+// Splits CSV text into records one character at a time. Every quote toggles
+// the quoted state; a field starting with a quote is unquoted afterwards.
+static std::vector<std::vector<std::string>>
+fxstring_reference_csv(const std::string& text, char delimiter, char quote)
+{
+    std::vector<std::vector<std::string>> ret;
+    std::vector<std::string> row;
+    std::string raw;
+    bool in_quote = false;
+    for (size_t i = 0; i <= text.size(); ++i)
+    {
+        const bool end = (i == text.size());
+        const char ch = end ? '\0' : text[i];
+        if (!end && quote && ch == quote)
+            in_quote = !in_quote;
+        if (!end && (in_quote || (ch != delimiter && ch != '\n')))
+        {
+            raw += ch;
+            continue;
+        }
+        if (end && raw.empty() && row.empty())
+            break;
+        if (ch == '\n' && !raw.empty() && raw.back() == '\r')
+            raw.pop_back();
+        std::string field;
+        if (quote && !raw.empty() && raw[0] == quote)
+        {
+            for (size_t k = 1; k < raw.size(); ++k)
+            {
+                if (raw[k] == quote)
+                {
+                    if (k + 1 >= raw.size() || raw[k + 1] != quote)
+                        continue;
+                    ++k;
+                }
+                field += raw[k];
+            }
+        }
+        else
+        {
+            field = raw;
+        }
+        row.push_back(field);
+        raw.clear();
+        if (ch != delimiter || end)
+        {
+            ret.push_back(row);
+            row.clear();
+        }
+    }
+    return ret;
+}
+
+static void fxstring_csv_test(const std::string& text, char delimiter, char quote)
+{
+    const std::vector<std::vector<std::string>> expected = fxstring_reference_csv(text, delimiter, quote);
+    khmz::fxstring_csv_parser parser(text.data(), text.size(), delimiter, quote);
+    khmz::fxstring_a<4> a;
+    khmz::fxstring_a<1> b;
+    khmz::fxstring_a<64> c;
+    size_t row = 0;
+    while (parser.next_row(a, b, c))
+    {
+        assert(row < expected.size());
+        const std::vector<std::string>& fields = expected[row];
+        assert(parser.fields() == fields.size());
+        const std::string empty;
+        const std::string& fa = fields.size() > 0 ? fields[0] : empty;
+        const std::string& fb = fields.size() > 1 ? fields[1] : empty;
+        const std::string& fc = fields.size() > 2 ? fields[2] : empty;
+        assert(a == fa.substr(0, 3).c_str() && parser.truncated(0) == (fa.size() > 3));
+        assert(b.empty() && parser.truncated(1) == (fb.size() > 0));
+        assert(c == fc.substr(0, 63).c_str() && parser.truncated(2) == (fc.size() > 63));
+        assert(parser.truncated() == (parser.truncated_mask() != 0));
+        ++row;
+    }
+    assert(row == expected.size());
+    assert(parser.eof() && parser.rows() == row);
+    assert(a.empty() && c.empty());
+}
+
+static void fxstring_csv_tests(void)
+{
+    {
+        const char text[] = "name,value,comment\r\n"
+                            "\"a,b\",12,\"say \"\"hi\"\"\"\n"
+                            "\"multi\nline\",,\n"
+                            "toolong,1\n"
+                            "last";
+        khmz::fxstring_csv_parser parser(text, sizeof(text) - 1);
+        khmz::fxstring_a<8> name;
+        khmz::fxstring_a<4> value;
+        khmz::fxstring_a<16> comment;
+        assert(parser.next_row(name, value, comment));
+        assert(name == "name" && value == "val" && comment == "comment");
+        assert(parser.fields() == 3 && parser.truncated() && parser.truncated_mask() == 2);
+        assert(parser.next_row(name, value, comment));
+        assert(name == "a,b" && value == "12" && comment == "say \"hi\"");
+        assert(!parser.truncated());
+        assert(parser.next_row(name, value, comment));
+        assert(name == "multi\nl" && value.empty() && comment.empty());
+        assert(parser.fields() == 3 && parser.truncated(0));
+        assert(parser.next_row(name, value));
+        assert(name == "toolong" && value == "1" && parser.fields() == 2);
+        assert(parser.skip_row());
+        assert(parser.fields() == 1);
+        assert(!parser.next_row(name));
+        assert(parser.rows() == 5);
+    }
+    {
+        const char text[] = "a\tb c\t\"d\"\nx\n";
+        khmz::fxstring_csv_parser parser(text, sizeof(text) - 1, '\t', '\0');
+        khmz::fxstring_a<8> x, y, z;
+        assert(parser.next_row(x, y, z));
+        assert(x == "a" && y == "b c" && z == "\"d\"");
+        assert(parser.next_row(x, y, z));
+        assert(x == "x" && y.empty() && z.empty() && parser.fields() == 1);
+        assert(!parser.next_row(x, y, z));
+    }
+
+    // Random texts across block boundaries
+    const char alphabet[] = { 'a', 'b', ',', '"', '\n', '\r', '\t', 'x' };
+    unsigned seed = 7;
+    for (int round = 0; round < 200; ++round)
+    {
+        std::string text;
+        seed = seed * 1103515245 + 12345;
+        const size_t size = (seed >> 16) % 300;
+        for (size_t i = 0; i < size; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            text += alphabet[(seed >> 16) % sizeof(alphabet)];
+        }
+        fxstring_csv_test(text, ',', '"');
+        fxstring_csv_test(text, '\t', '\0');
+    }
+}
+
+template <typename T_RANGE>
+static std::string fxstring_split_joined(const T_RANGE& range)
+{
+    std::string ret;
+    for (const khmz::fxstring_view_a& piece : range)
+    {
+        ret += '[';
+        ret.append(piece.data(), piece.size());
+        ret += ']';
+    }
+    return ret;
+}
+
+static void fxstring_split_tests(void)
+{
+    using namespace khmz;
+
+    assert(fxstring_split_joined(split("a,,b", ',')) == "[a][][b]");
+    assert(fxstring_split_joined(split("", ',')) == "[]");
+    assert(fxstring_split_joined(split(",", ',')) == "[][]");
+    assert(fxstring_split_joined(split("abc", ',')) == "[abc]");
+    assert(fxstring_split_joined(split_any("a,b;c,;", ",;")) == "[a][b][c][][]");
+    assert(fxstring_split_joined(tokenize(";;a,b;;c;", ",;")) == "[a][b][c]");
+    assert(tokenize(";;,", ",;").empty());
+    assert(tokenize("", ",;").empty());
+    assert(fxstring_split_joined(split_whitespace("  one\ttwo \r\n three  ")) == "[one][two][three]");
+    assert(split_whitespace(" \t ").empty());
+
+    {
+        fxstring_a<32> str("key=value=x");
+        assert(fxstring_split_joined(split(str, '=')) == "[key][value][x]");
+        std::string std_str("x y");
+        assert(fxstring_split_joined(split_whitespace(std_str)) == "[x][y]");
+        fxstring_view_a view(str.data(), 3);
+        assert(fxstring_split_joined(split(view, 'e')) == "[k][y]");
+
+        // Iterators outlive the range
+        fxstring_split_range<char, detail::_split_char<char>>::iterator it = split(str, '=').begin();
+        assert(*it == "key");
+        assert(*++it == "value");
+        assert(it->size() == 5);
+        it++;
+        assert(*it == "x");
+        assert(++it == split(str, '=').end());
+        assert(std::distance(split(str, '=').begin(), split(str, '=').end()) == 3);
+    }
+    {
+        const wchar_t *wstr = L"\u3042 b\u3044 c";
+        size_t count = 0;
+        for (const fxstring_view_w& piece : split_whitespace(wstr))
+            count += piece.size();
+        assert(count == 4);
+        assert(std::distance(split(wstr, L' ').begin(), split(wstr, L' ').end()) == 3);
+    }
+
+    {
+        fxstring_a<16> dest("garbage");
+        const char *parts[] = { "a", "bc", "def" };
+        assert(join(dest, parts, ", "));
+        assert(dest == "a, bc, def");
+        std::vector<std::string> strs(parts, parts + 3);
+        assert(join(dest, strs, ""));
+        assert(dest == "abcdef");
+        assert(join(dest, std::vector<std::string>(), ","));
+        assert(dest.empty());
+        assert(join(dest, { "x", "y" }, "-"));
+        assert(dest == "x-y");
+
+        // Joining the pieces of a split gives the original
+        fxstring_a<32> csv("one,two,,three"), out;
+        assert(join(out, split(csv, ','), ","));
+        assert(out == csv);
+
+        // Truncation
+        fxstring_a<6> small;
+        assert(!join(small, parts, ", "));
+        assert(small == "a, bc");
+        assert(!join(small, { "abcdefgh" }, ","));
+        assert(small == "abcde");
+        assert(join(small, { "ab", "c" }, "--"));
+        assert(small == "ab--c");
+
+        fxstring_w<8> wdest;
+        assert(join(wdest, { L"a", L"b" }, L"+"));
+        assert(wdest == L"a+b");
+    }
+}
+
+template <typename T_QUEUE>
+static void fxstring_queue_basic_test(void)
+{
+    T_QUEUE queue(4);
+    typename T_QUEUE::value_type str;
+    assert(queue.capacity() == 4 && queue.empty());
+    assert(!queue.try_pop(str));
+
+    assert(queue.try_push(typename T_QUEUE::value_type("one")));
+    assert(queue.try_push("0123456789abcdef", 16));   // Truncated
+    assert(queue.size() == 2);
+    assert(queue.try_pop(str) && str == "one");
+    assert(queue.try_pop(str) && str == "0123456");
+    assert(!queue.try_pop(str));
+
+    typename T_QUEUE::value_type items[6] = { "a", "b", "c", "d", "e", "f" };
+    assert(queue.try_push(items, 6) == 4);
+    assert(!queue.try_push(items[4]));
+    typename T_QUEUE::value_type out[6];
+    assert(queue.try_pop(out, 3) == 3);
+    assert(out[0] == "a" && out[1] == "b" && out[2] == "c");
+    assert(queue.try_push(&items[4], 2) == 2);
+    assert(queue.try_push(items, 1) == 1);
+    assert(queue.try_pop(out, 6) == 4);
+    assert(out[0] == "d" && out[1] == "e" && out[2] == "f" && out[3] == "a");
+    assert(queue.empty());
+}
+
+// Each producer sends "<producer>:<number>"; each consumer checks that the
+// numbers from a producer arrive in order, and all messages are counted.
+template <typename T_QUEUE>
+static void fxstring_queue_threads_test(int producers, int consumers, size_t batch)
+{
+    using value_type = typename T_QUEUE::value_type;
+    const int count = 5000;
+    T_QUEUE queue(64);
+    std::atomic<int> received(0);
+    std::atomic<long long> sum(0);
+    std::vector<std::thread> threads;
+
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&queue, p, batch]()
+        {
+            std::vector<value_type> items(batch);
+            for (int i = 0; i < count; )
+            {
+                size_t n = 0;
+                for (; n < batch && i + int(n) < count; ++n)
+                {
+                    items[n] = std::to_string(p).c_str();
+                    items[n] += ":";
+                    items[n] += std::to_string(i + n).c_str();
+                }
+                for (size_t done = 0; done < n; )
+                {
+                    const size_t pushed = (batch == 1) ? queue.try_push(items[0]) : queue.try_push(&items[done], n - done);
+                    if (!pushed)
+                        std::this_thread::yield();
+                    done += pushed;
+                }
+                i += int(n);
+            }
+        });
+    }
+    for (int c = 0; c < consumers; ++c)
+    {
+        threads.emplace_back([&queue, &received, &sum, producers, batch]()
+        {
+            std::vector<value_type> items(batch);
+            std::vector<int> last(producers, -1);
+            while (received.load() < producers * count)
+            {
+                const size_t n = (batch == 1) ? queue.try_pop(items[0]) : queue.try_pop(items.data(), batch);
+                if (!n)
+                    std::this_thread::yield();
+                for (size_t k = 0; k < n; ++k)
+                {
+                    const int p = std::atoi(items[k].c_str());
+                    const int i = std::atoi(items[k].c_str() + items[k].find(':') + 1);
+                    assert(i > last[p]);
+                    last[p] = i;
+                    sum += i;
+                }
+                received += int(n);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    assert(received.load() == producers * count);
+    assert(sum.load() == (long long)producers * count * (count - 1) / 2);
+    assert(queue.empty());
+}
+
+static void fxstring_queue_tests(void)
+{
+    fxstring_queue_basic_test<khmz::fxstring_spsc_queue<char, 8>>();
+    fxstring_queue_basic_test<khmz::fxstring_mpmc_queue<char, 8>>();
+    static_assert(sizeof(khmz::detail::_queue_slot<char, 8, true>) == 64, "");
+    static_assert(sizeof(khmz::detail::_queue_slot<char, 100, false>) == 128, "");
+
+    fxstring_queue_threads_test<khmz::fxstring_spsc_queue<char, 16>>(1, 1, 1);
+    fxstring_queue_threads_test<khmz::fxstring_spsc_queue<char, 16>>(1, 1, 7);
+    fxstring_queue_threads_test<khmz::fxstring_mpmc_queue<char, 16>>(1, 1, 1);
+    fxstring_queue_threads_test<khmz::fxstring_mpmc_queue<char, 16>>(3, 3, 1);
+    fxstring_queue_threads_test<khmz::fxstring_mpmc_queue<char, 16>>(3, 2, 5);
+}
+
+static std::vector<std::string> fxstring_read_lines(std::FILE *fp)
+{
+    std::vector<std::string> ret;
+    std::rewind(fp);
+    char buf[1024];
+    while (std::fgets(buf, sizeof(buf), fp))
+    {
+        std::string line(buf);
+        assert(!line.empty() && line.back() == '\n');
+        line.pop_back();
+        ret.push_back(line);
+    }
+    return ret;
+}
+
+static void fxstring_logger_tests(void)
+{
+    {
+        khmz::fxstring_a<8> str;
+        assert(str.printf("%d-%s", 12, "ab") == 5);
+        assert(str == "12-ab");
+        assert(str.printf("%s", "0123456789") == 10);
+        assert(str == "0123456");
+        khmz::fxstring_w<8> wstr;
+        assert(wstr.printf(L"%d", 42) == 2);
+        assert(wstr == L"42");
+        wstr.printf(L"%ls", L"0123456789");
+        assert(wstr.size() <= 7);
+    }
+
+    std::FILE *fp = std::tmpfile();
+    assert(fp);
+    {
+        khmz::fxstring_logger<> logger(fp, 1024);
+        const std::string name("std::string");
+        khmz::fxstring_a<16> label("fxstring");
+        char buf[16] = "buffer";
+        const char *null = nullptr;
+        assert(logger.log_info("plain message"));
+        assert(logger.log_info("int %d, unsigned %u, long %lld", -1, 2u, 3LL));
+        assert(logger.log_warning("double %.2f, char %c", 1.5, 'x'));
+        assert(logger.log_error("strings %s %s", "literal", name));
+        assert(logger.log_error("strings %s %s %s", label, buf, null));
+        assert(!logger.log_debug("filtered"));
+        logger.set_level(khmz::fxstring_logger<>::debug);
+        assert(logger.log_debug("percent %% %d", 100));
+        buf[0] = 'X';   // Captured already
+        logger.flush();
+        assert(logger.written() == 6 && logger.dropped() == 0);
+
+        std::vector<std::string> lines = fxstring_read_lines(fp);
+        assert(lines.size() == 6);
+        // "YYYY-MM-DD HH:MM:SS.uuuuuu LEVEL message"
+        for (const std::string& line : lines)
+            assert(line.size() > 27 && line[4] == '-' && line[19] == '.' && line[26] == ' ');
+        assert(lines[0].substr(27) == "INFO plain message");
+        assert(lines[1].substr(27) == "INFO int -1, unsigned 2, long 3");
+        assert(lines[2].substr(27) == "WARNING double 1.50, char x");
+        assert(lines[3].substr(27) == "ERROR strings literal std::string");
+        assert(lines[4].substr(27) == "ERROR strings fxstring buffer (null)");
+        assert(lines[5].substr(27) == "DEBUG percent % 100");
+
+        // Long strings are truncated to the string and line sizes
+        const std::string long_arg(100, 'a');
+        assert(logger.log_info("%s", long_arg));
+        static const std::string long_format(1000, 'b');
+        assert(logger.log_info(long_format.c_str()));
+        logger.flush();
+        lines = fxstring_read_lines(fp);
+        assert(lines.size() == 8);
+        assert(lines[6].substr(27) == "INFO " + std::string(63, 'a'));
+        assert(lines[7].size() == 510 && lines[7].substr(32) == std::string(478, 'b'));
+    }
+    {
+        // Concurrent callers; the records not dropped are all written
+        std::rewind(fp);
+        khmz::fxstring_logger<> logger(fp, 64);
+        std::vector<std::thread> threads;
+        std::atomic<int> logged(0);
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&logger, &logged, t]()
+            {
+                for (int i = 0; i < 1000; ++i)
+                    logged += logger.log_info("thread %d record %d", t, i);
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+        logger.stop();
+        assert(logger.written() == size_t(logged.load()));
+        assert(logger.written() + logger.dropped() == 4000);
+    }
+    std::fclose(fp);
+}
+
+template <typename T_ATOMIC>
+static void fxstring_atomic_test(const char *const *values, size_t count)
+{
+    using value_type = typename T_ATOMIC::value_type;
+    T_ATOMIC str;
+    assert(str.load().empty());
+    str.store(values[0]);
+    assert(str.load() == values[0]);
+
+    // compare_exchange compares the strings, not the bytes past the terminator
+    value_type expected(values[1]);
+    assert(!str.compare_exchange(expected, values[1]));
+    assert(expected == values[0]);
+    value_type dirty(values[1]);
+    dirty.assign(values[0]);
+    assert(str.compare_exchange(dirty, values[1]));
+    assert(value_type(str) == values[1]);
+
+    // Readers never see a torn string
+    str = values[0];
+    std::atomic<bool> done(false);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 2; ++t)
+    {
+        readers.emplace_back([&str, &done, values, count]()
+        {
+            while (!done.load(std::memory_order_relaxed))
+            {
+                const value_type value = str.load();
+                assert(std::find(values, values + count, value) != values + count);
+                (void)value;
+                std::this_thread::yield();
+            }
+        });
+    }
+    std::vector<std::thread> writers;
+    std::atomic<int> exchanged(0);
+    for (int t = 0; t < 2; ++t)
+    {
+        writers.emplace_back([&str, &exchanged, values, count, t]()
+        {
+            for (size_t i = 0; i < 2000; ++i)
+            {
+                if (t == 0)
+                {
+                    str.store(values[i % count]);
+                }
+                else
+                {
+                    value_type expected = str.load();
+                    if (str.compare_exchange(expected, values[(i + 1) % count]))
+                        ++exchanged;
+                }
+                if (i % 16 == 0)
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (std::thread& thread : writers)
+        thread.join();
+    done = true;
+    for (std::thread& thread : readers)
+        thread.join();
+    assert(exchanged > 0);
+}
+
+static void fxstring_atomic_tests(void)
+{
+    static const char *const short_values[] = { "a", "bc", "leader1", "" };
+    fxstring_atomic_test<khmz::atomic_fxstring_a<8>>(short_values, 4);
+    static_assert(khmz::atomic_fxstring_a<8>::is_always_lock_free, "");
+
+    static const char *const medium_values[] = { "node-1", "node-123456789", "x", "config v42" };
+    fxstring_atomic_test<khmz::atomic_fxstring_a<16>>(medium_values, 4);
+#ifdef FXSTRING_CAS16
+    static_assert(khmz::atomic_fxstring_a<16>::is_always_lock_free, "");
+#else
+    static_assert(!khmz::atomic_fxstring_a<16>::is_always_lock_free, "");
+#endif
+
+    static const char *const long_values[] = {
+        "the quick brown fox jumps over the lazy dog",
+        "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG, AND THEN SOME MORE",
+        "short",
+        "",
+    };
+    fxstring_atomic_test<khmz::atomic_fxstring_a<64>>(long_values, 4);
+    static_assert(!khmz::atomic_fxstring_a<64>::is_always_lock_free, "");
+
+    khmz::atomic_fxstring_w<2> wstr(L"x");
+    assert(wstr.load() == L"x");
+    khmz::fxstring_w<2> expected(L"x");
+    assert(wstr.compare_exchange(expected, L"y") && wstr.load() == L"y");
+}
+
+static void fxstring_concat_tests(void)
+{
+    const khmz::fxstring_a<16> host("example.com");
+    const khmz::fxstring_a<8> port("8080");
+    const std::string scheme("https");
+    const char *path = "/index.html";
+    const khmz::fxstring_view_a query("?q=1&x", 4);
+
+    khmz::fxstring_a<64> url = scheme + "://" + host + ':' + port + path + query;
+    assert(url == "https://example.com:8080/index.html?q=1");
+    assert((host + ':' + port).size() == 16);
+
+    // Assignment, appending and conversion to std::string
+    url = host + "/" + port;
+    assert(url == "example.com/8080");
+    url += "/" + port;
+    assert(url == "example.com/8080/8080");
+    url.append(port + port);
+    assert(url == "example.com/8080/808080808080");
+    const std::string str = host + '/' + scheme;
+    assert(str == "example.com/https");
+    assert((port + port).str() == "80808080");
+    assert((port + "").str() == "8080");
+
+    // Truncation to max_size
+    khmz::fxstring_a<8> small = host + port;
+    assert(small == "example");
+    small = port + host;
+    assert(small == "8080exa");
+    small = "abc";
+    small += small + "defgh";
+    assert(small == "abcabcd");
+
+    // The destination may be an operand
+    khmz::fxstring_a<16> self("b");
+    self = "a" + self + "c";
+    assert(self == "abc");
+    self = self + self;
+    assert(self == "abcabc");
+    self = self.c_str() + 3 + self;
+    assert(self == "abcabcabc");
+
+    // Wide strings
+    const khmz::fxstring_w<8> wide(L"key");
+    khmz::fxstring_w<16> wresult = wide + L'=' + L"value";
+    assert(wresult == L"key=value");
+    const std::wstring wstr = L"[" + wide + L"]";
+    assert(wstr == L"[key]");
+
+    // operator+ is not found for other operands
+    static_assert(!khmz::detail::is_string_expression<std::string>::value, "");
+    static_assert(khmz::detail::is_string_expression<decltype(host + port)>::value, "");
+    khmz::fxstring_a<16> copy(host);
+    auto it = copy.begin() + 1;
+    assert(*it == 'x');
+
+    // concat sums the capacities at compile time and never truncates
+    const khmz::fxstring_a<16> user("0123456789abcde");
+    const khmz::fxstring_a<32> tenant("tenant-with-a-very-long-name-xx");
+    auto key = khmz::concat(user, ':', tenant);
+    static_assert(std::is_same<decltype(key), khmz::fxstring_a<48>>::value, "");
+    assert(key == "0123456789abcde:tenant-with-a-very-long-name-xx");
+    auto label = khmz::concat("id=", port, '/', "x");
+    static_assert(std::is_same<decltype(label), khmz::fxstring_a<13>>::value, "");
+    assert(label == "id=8080/x");
+    assert(khmz::concat(khmz::fxstring_a<4>(), "") == "");
+    auto wlabel = khmz::concat(L'<', wide, L">");
+    static_assert(std::is_same<decltype(wlabel), khmz::fxstring_w<10>>::value, "");
+    assert(wlabel == L"<key>");
+}
+
+static void fxstring_builder_tests(void)
+{
+    {
+        khmz::fxstring_a<64> str("stale contents");
+        khmz::fxstring_builder<char, 64> builder(str);
+        builder.append("id=").append_int(-42).append(',').append(std::string("name"));
+        builder += '=';
+        builder += khmz::fxstring_a<8>("value");
+        builder.fill(3, '.');
+        assert(builder.append_format(" %d%%/%s", 50, "x") == 6);
+        builder.append_int(255, 16).append(' ').append_int(std::numeric_limits<long long>::min());
+        builder.append(' ').append_int(0u, 2);
+        assert(builder.size() == 51 && !builder.truncated());
+        assert(builder.finish() == "id=-42,name=value... 50%/xff -9223372036854775808 0");
+        assert(str.size() == 51);
+    }
+    {
+        // Appending after the current contents; an output iterator via back_inserter
+        khmz::fxstring_a<16> str("key:");
+        {
+            khmz::fxstring_builder<char, 16> builder(str, true);
+            const std::vector<char> chars = { 'a', 'b', 'c' };
+            std::copy(chars.begin(), chars.end(), std::back_inserter(builder));
+            builder += khmz::fxstring_a<4>("de") + "f";
+        }
+        assert(str == "key:abcdef");
+    }
+    {
+        // Truncation
+        khmz::fxstring_a<8> str;
+        khmz::fxstring_builder<char, 8> builder(str);
+        builder.append("abcd").append_int(123456);
+        assert(builder.truncated() && builder.finish() == "abcd123");
+        assert(builder.remaining() == 0);
+        builder.append('x').fill(2, 'y');
+        assert(builder.finish() == "abcd123");
+
+        khmz::fxstring_a<8> formatted;
+        khmz::fxstring_builder<char, 8> format_builder(formatted);
+        format_builder.append("ab");
+        assert(format_builder.append_format("%d", 1234567) == 7);
+        assert(format_builder.truncated() && format_builder.size() == 7);
+        assert(format_builder.finish() == "ab12345");
+    }
+    {
+        khmz::fxstring_w<8> str;
+        khmz::fxstring_builder<wchar_t, 8> builder(str);
+        builder.append(L"w").append_int(-7);
+        assert(builder.append_format(L"%ls", L"xy") == 2);
+        builder.append_format(L"%ls", L"0123456789");
+        assert(builder.truncated() && builder.size() <= 7);
+        assert(std::wcsncmp(builder.finish().c_str(), L"w-7xy", 5) == 0);
+    }
+}
+
+static void fxstring_hybrid_tests(void)
+{
+    khmz::reset_spill_counters();
+    {
+        khmz::hybrid_fxstring_a<8> str("abc");
+        assert(str == "abc" && str.size() == 3 && !str.spilled() && str.capacity() == 7);
+        str += "defg";
+        assert(str == "abcdefg" && !str.spilled());
+        str += 'h';
+        assert(str == "abcdefgh" && str.spilled() && str.capacity() >= 8);
+        assert(khmz::spill_counters().spills == 1);
+        str.append(str.data(), str.size());
+        assert(str == "abcdefghabcdefgh");
+        str.append(40, 'x');
+        assert(str.size() == 56 && str.back() == 'x' && str[str.size()] == 0);
+        assert(khmz::spill_counters().spills == 1 && khmz::spill_counters().reallocations >= 1);
+
+        // Search and comparison through the shared view code
+        assert(str.find("gha") == 6 && str.rfind('a') == 8 && str.find('z') == str.npos);
+        assert(str.find_first_of("hx") == 7 && str.find_last_not_of('x') == 15);
+        assert(str.starts_with("abc") && str.ends_with("xx") && str.compare("abd") < 0);
+        assert(str.substr(8, 3) == "abc");
+
+        // Moves take the buffer; copies make their own
+        khmz::hybrid_fxstring_a<8> copy(str);
+        khmz::hybrid_fxstring_a<8> moved(std::move(str));
+        assert(copy == moved && moved.spilled() && str.empty() && !str.spilled());
+        moved.assign(moved.data() + 50, 6);
+        assert(moved == "xxxxxx");
+        moved = "short";
+        assert(moved == "short" && moved.spilled());
+
+        khmz::hybrid_fxstring_a<8> formatted;
+        assert(formatted.printf("%d", 42) == 2 && formatted == "42" && !formatted.spilled());
+        assert(formatted.printf("%s-%d", "a long formatted value", 12345) == 28);
+        assert(formatted == "a long formatted value-12345");
+        khmz::hybrid_fxstring_w<4> wformatted;
+        assert(wformatted.printf(L"%ls", L"wide and long") == 13 && wformatted == L"wide and long");
+    }
+    {
+        // Insertion, erasure and replacement grow past the inline buffer
+        khmz::hybrid_fxstring_a<8> str("held");
+        str.insert(0, "be");
+        assert(str == "beheld" && !str.spilled());
+        str.insert(2, 3, '-');
+        assert(str == "be---held" && str.spilled());
+        str.insert(str.size(), str.data(), 2);
+        str.insert(str.cbegin() + 2, '+');
+        assert(str == "be+---heldbe");
+        str.replace(2, 4, "");
+        assert(str == "beheldbe");
+        str.replace(str.cbegin(), str.cbegin() + 2, std::string("a longer head "));
+        assert(str == "a longer head heldbe");
+        str.replace(0, str.npos, str.data() + 9, 4);
+        assert(str == "head");
+        str.erase(str.cbegin());
+        str.erase(1, 1);
+        assert(str == "ed");
+        assert(str.erase(str.cbegin(), str.cend()) == str.end() && str.empty() && str[0] == 0);
+        bool thrown = false;
+        try
+        {
+            str.insert(1, "x");
+        }
+        catch (const std::out_of_range&)
+        {
+            thrown = true;
+        }
+        assert(thrown && str.empty());
+
+        // Swapping inline and spilled strings, also across resources
+        char buffer[256];
+        khmz::fxstring_arena arena(buffer, sizeof(buffer), 128);
+        khmz::hybrid_fxstring_a<8> small("abc"), large("a value past the buffer"), other(&arena);
+        other = "from the arena, and spilled";
+        small.swap(large);
+        assert(small == "a value past the buffer" && large == "abc" && !large.spilled());
+        std::swap(small, other);
+        assert(small == "from the arena, and spilled" && other == "a value past the buffer");
+        assert(other.resource() == &arena && small.resource() != &arena);
+
+        // Ordering, in both directions
+        khmz::hybrid_fxstring_a<4> b("b");
+        assert(b > "a" && b >= "b" && b <= "b" && !(b > "c") && "c" > b && "b" >= b && "a" <= b);
+        assert(b > khmz::hybrid_fxstring_a<4>("a") && !(b >= khmz::hybrid_fxstring_a<4>("ba")));
+
+        // Hashes equal those of fxstrings of the same value
+        assert(std::hash<khmz::hybrid_fxstring_a<8>>()(large) == std::hash<string_t<8>>()(string_t<8>("abc")));
+        std::unordered_set<khmz::hybrid_fxstring_a<8>> set;
+        set.insert(khmz::hybrid_fxstring_a<8>("key"));
+        set.insert(khmz::hybrid_fxstring_a<8>("a spilled key"));
+        assert(set.count(khmz::hybrid_fxstring_a<8>("a spilled key")) == 1 && !set.count(large));
+    }
+    {
+        // Spilling into an arena, which outlives the strings and is reset at once
+        char buffer[256];
+        khmz::fxstring_arena arena(buffer, sizeof(buffer), 128);
+        std::vector<khmz::hybrid_fxstring_a<16>> strings;
+        for (int i = 0; i < 20; ++i)
+        {
+            strings.emplace_back(&arena);
+            strings.back().printf("value %d with a longer tail", i);
+        }
+        assert(strings[19] == "value 19 with a longer tail" && strings[19].resource() == &arena);
+        assert(arena.used() >= 20 * 28);
+        strings.clear();
+        arena.reset();
+        assert(arena.used() == 0);
+        void *p = arena.allocate(10, 1);
+        assert(p == buffer);
+        void *q = arena.allocate(8, 8);
+        assert(reinterpret_cast<std::uintptr_t>(q) % 8 == 0);
+        void *large = arena.allocate(1000, 16);
+        assert(large && reinterpret_cast<std::uintptr_t>(large) % 16 == 0);
+        std::memset(large, 0, 1000);
+    }
+    {
+        // Padding for alignment that runs past the end of an odd-sized buffer
+        alignas(16) char odd[100];
+        khmz::fxstring_arena arena(odd, sizeof(odd), 64);
+        assert(arena.allocate(99, 1) == odd);
+        char *q = static_cast<char *>(arena.allocate(8, 8));
+        assert((q < odd || q >= odd + sizeof(odd)) && reinterpret_cast<std::uintptr_t>(q) % 8 == 0);
+        std::memset(q, 0, 8);
+
+        // Strings of both widths sharing one odd-sized buffer
+        alignas(16) char shared[61];
+        khmz::fxstring_arena mixed(shared, sizeof(shared), 32);
+        khmz::hybrid_fxstring_a<4> narrow(&mixed);
+        khmz::hybrid_fxstring_w<2> wide(&mixed);
+        for (int i = 0; i < 8; ++i)
+        {
+            narrow += "ab";
+            wide += L"c";
+        }
+        assert(narrow == "abababababababab" && wide == L"cccccccc");
+        assert(reinterpret_cast<std::uintptr_t>(wide.data()) % alignof(wchar_t) == 0);
+    }
+}
+
+static void fxstring_arena_tests(void)
+{
+    khmz::fxstring_arena arena(256);
+    {
+        // Arena strings have no inline buffer to spill from, and leave the spill counters alone
+        khmz::fxstring_arena_scope scope(arena);
+        khmz::reset_spill_counters();
+        khmz::arena_fxstring_a grown(arena, "a value that grows");
+        grown.append(300, 'x');
+        const khmz::fxstring_spill_counters counters = khmz::spill_counters();
+        assert(grown.size() == 318 && !counters.spills && !counters.reallocations && !counters.bytes);
+    }
+    {
+        khmz::fxstring_arena_scope scope(arena);
+        khmz::arena_fxstring_a str(arena, "request");
+        assert(str == "request" && &str.arena() == &arena && arena.used() > 0);
+
+        // The last allocation grows in place
+        str.reserve(16);
+        const char *data = str.data();
+        str += " id=";
+        str.append(8, '7');
+        assert(str == "request id=77777777" && str.data() == data);
+
+        // The full fxstring API
+        assert(str.find("id") == 8 && str.rfind('7') == 18 && str.find_first_of("=") == 10);
+        assert(str.find_last_not_of('7') == 10 && str.compare("request") > 0);
+        assert(str.ends_with("777") && str.substr(0, 7) == "request");
+        str.printf("%s:%d", "status", 200);
+        assert(str == "status:200");
+
+        // Copied into a fixed fxstring by size
+        khmz::fxstring_a<8> fixed(str);
+        assert(fixed == "status:");
+        khmz::fxstring_a<32> whole(str);
+        assert(whole == "status:200" && str == whole);
+
+        khmz::arena_fxstring_w wide(arena, 40);
+        assert(wide.capacity() >= 40);
+        wide = L"wide";
+        assert(wide == L"wide");
+    }
+    assert(arena.used() == 0);
+
+    {
+        // Rewinding keeps what came before the mark, and releases later blocks
+        void *kept = arena.allocate(100, 1);
+        const khmz::fxstring_arena::marker mark = arena.mark();
+        arena.allocate(1000, 1);
+        assert(arena.used() == 1100);
+        arena.rewind(mark);
+        assert(arena.used() == 100);
+        assert(arena.allocate(10, 1) == static_cast<char *>(kept) + 100);
+    }
+
+    {
+        // The fxstring search functions with positions past the end
+        khmz::fxstring_a<16> str("abcabc");
+        assert(str.find("abc", 7) == str.npos && str.find('a', 9) == str.npos);
+        assert(str.rfind("abc", 100) == 3 && str.rfind('c', 100) == 5);
+        assert(str.find_first_of("c", 7) == str.npos && str.find_last_of("a", 100) == 3);
+        assert(str.find_first_not_of("ab", 6) == str.npos && str.find_last_not_of("c", 100) == 4);
+        assert(str.find(std::string("ca")) == 2 && str.rfind(std::string("ab"), str.npos) == 3);
+    }
+}
+
+// Not a template: one function for every capacity
+static void fxstring_ref_fill(khmz::fxstring_ref_a str, int id)
+{
+    str.assign("id=", 3);
+    str.printf("%s%d", "id=", id);
+    str += ';';
+}
+
+static void fxstring_ref_tests(void)
+{
+    khmz::fxstring_a<8> small;
+    khmz::fxstring_a<64> large;
+    fxstring_ref_fill(small, 123456);
+    fxstring_ref_fill(large, 123456);
+    assert(small == "id=1234" && large == "id=123456;");
+
+    khmz::fxstring_ref_a ref = large.ref();
+    assert(ref.size() == 10 && ref.max_size() == 63 && ref.data() == large.data());
+    ref.insert(3, "#", 1).append(3, '!').replace(0, 2, "ID", 2).erase(4, 2);
+    assert(large == "ID=#3456;!!!" && ref.view() == khmz::fxstring_view_a("ID=#3456;!!!"));
+    ref.resize(3);
+    assert(large == "ID=");
+
+    // Truncation at the capacity
+    khmz::fxstring_a<4> str("awx");
+    str.insert(1, 10, '-');
+    assert(str == "a--");
+
+    khmz::fxstring_w<8> wide(L"abc");
+    khmz::fxstring_ref_w wref(wide);
+    wref.assign(khmz::utf_truncate, L"0123456789", 10);
+    assert(wide == L"0123456");
+}
+
+static khmz::fxstring_stats_counters
+fxstring_stats_find(khmz::fxstring_stats_op op, size_t capacity)
+{
+    for (const khmz::fxstring_stats_entry& entry : khmz::fxstring_stats_snapshot())
+    {
+        if (entry.op == op && entry.capacity == capacity)
+            return entry.counters;
+    }
+    const khmz::fxstring_stats_counters none = { 0, 0, 0, 0 };
+    return none;
+}
+
+static void fxstring_stats_tests(void)
+{
+    using khmz::fxstring_stats_op;
+    khmz::fxstring_stats_reset();
+
+    // Counters of threads, including exited ones, are aggregated on demand
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([]()
+        {
+            for (int i = 0; i < 1000; ++i)
+                khmz::detail::_stats_count(fxstring_stats_op::erase, 7777, 0, 3, (i % 10) == 0);
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    khmz::fxstring_stats_counters counters = fxstring_stats_find(fxstring_stats_op::erase, 7777);
+    assert(counters.calls == 4000 && counters.moved_bytes == 12000 && counters.truncations == 400);
+
+    // More capacities than the table holds share the last entry
+    for (size_t capacity = 100000; capacity < 100000 + FXSTRING_STATS_CAPACITIES + 10; ++capacity)
+        khmz::detail::_stats_count(fxstring_stats_op::resize, capacity, 0, 0, false);
+    size_t resize_calls = 0;
+    for (const khmz::fxstring_stats_entry& entry : khmz::fxstring_stats_snapshot())
+        resize_calls += (entry.op == fxstring_stats_op::resize) ? entry.counters.calls : 0;
+    assert(resize_calls == FXSTRING_STATS_CAPACITIES + 10);
+    assert(fxstring_stats_find(fxstring_stats_op::resize, 0).calls >= 10);
+
+    khmz::fxstring_stats_reset();
+    assert(khmz::fxstring_stats_snapshot().empty());
+
+#ifdef FXSTRING_STATS
+    khmz::fxstring_a<8> str("abc");
+    assert(fxstring_stats_find(fxstring_stats_op::assign, 8).calls == 1);
+    str.insert(1, "xy");
+    counters = fxstring_stats_find(fxstring_stats_op::insert, 8);
+    assert(counters.calls == 1 && counters.moved_bytes == 4 && !counters.truncations);
+    str.append("123456");
+    counters = fxstring_stats_find(fxstring_stats_op::append, 8);
+    assert(str == "axybc12" && counters.calls == 1 && counters.truncations == 1);
+    str.erase(0, 2);
+    assert(fxstring_stats_find(fxstring_stats_op::erase, 8).moved_bytes == 5);
+    khmz::fxstring_stats_reset();
+    assert(str.size() == 5);
+    counters = fxstring_stats_find(fxstring_stats_op::size, 8);
+    assert(counters.calls == 1 && counters.scanned_bytes == 6);
+    khmz::fxstring_stats_reset();
+#endif
+
+    char text[4096];
+    std::FILE *fp = std::tmpfile();
+    assert(fp);
+    khmz::detail::_stats_count(fxstring_stats_op::format, 32, 0, 0, true);
+    khmz::fxstring_stats_dump(fp);
+    std::rewind(fp);
+    const size_t read = std::fread(text, 1, sizeof(text) - 1, fp);
+    text[read] = 0;
+    std::fclose(fp);
+    assert(std::strstr(text, "truncations") && std::strstr(text, "format"));
+    khmz::fxstring_stats_reset();
+}
+
+// A backtracking matcher of the same syntax, for comparison
+static bool fxstring_glob_reference(const char *p, const char *p_end, const char *s, const char *s_end)
+{
+    if (p == p_end)
+        return s == s_end;
+    if (*p == '*')
+    {
+        for (const char *t = s; ; ++t)
+        {
+            if (fxstring_glob_reference(p + 1, p_end, t, s_end))
+                return true;
+            if (t == s_end)
+                return false;
+        }
+    }
+    if (s == s_end)
+        return false;
+    if (*p == '?')
+        return fxstring_glob_reference(p + 1, p_end, s + 1, s_end);
+    if (*p == '[')
+    {
+        const char *q = p + 1;
+        const bool negated = (q < p_end && (*q == '!' || *q == '^'));
+        if (negated)
+            ++q;
+        const char *members = q;
+        bool found = false;
+        for (; q < p_end && (*q != ']' || q == members); ++q)
+        {
+            if (q + 2 < p_end && q[1] == '-' && q[2] != ']')
+            {
+                found |= (q[0] <= *s && *s <= q[2]);
+                q += 2;
+            }
+            else
+            {
+                found |= (*q == *s);
+            }
+        }
+        if (q < p_end)
+            return found != negated && fxstring_glob_reference(q + 1, p_end, s + 1, s_end);
+    }
+    if (*p == '\\' && p + 1 < p_end)
+        return p[1] == *s && fxstring_glob_reference(p + 2, p_end, s + 1, s_end);
+    return *p == *s && fxstring_glob_reference(p + 1, p_end, s + 1, s_end);
+}
+
+static void fxstring_glob_tests(void)
+{
+    khmz::fxstring_glob_a glob("*.log");
+    assert(glob.has_star() && glob.min_length() == 4);
+    assert(glob.match("server.log") && glob(".log") && !glob.match("server.log.1") && !glob.match("log"));
+
+    assert(khmz::glob_match("res/*/img_??.png", "res/ui/img_01.png"));
+    assert(!khmz::glob_match("res/*/img_??.png", "res/ui/img_1.png"));
+    assert(khmz::glob_match("[a-c]*[!0-9]", "b12x") && !khmz::glob_match("[a-c]*[!0-9]", "b123"));
+    assert(khmz::glob_match("[]x]y", "]y") && khmz::glob_match("[^a]", "b") && !khmz::glob_match("[^a]", "a"));
+    assert(khmz::glob_match("a\\*b", "a*b") && !khmz::glob_match("a\\*b", "axb"));
+    assert(khmz::glob_match("[abc", "[abc") && khmz::glob_match("x\\", "x\\"));
+    assert(khmz::glob_match("", "") && !khmz::glob_match("", "a") && khmz::glob_match("*", ""));
+    assert(khmz::glob_match(L"*été*", L"summer: été 2024"));
+    assert(khmz::glob_match(L"[Ā-ſ]?", L"Łx") && !khmz::glob_match(L"[Ā-ſ]?", L"Lx"));
+
+    // No backtracking blowup
+    std::string many_a(5000, 'a');
+    assert(!khmz::glob_match("*a*a*a*a*a*a*a*a*a*b", khmz::fxstring_view_a(many_a.data(), many_a.size())));
+
+    // Against the backtracking matcher, with literal runs long enough for the SIMD search
+    static const char *const s_patterns[] =
+    {
+        "*", "a*", "*a", "*ab*", "a?c*", "*[bc]a*", "*abcab*b", "??*??", "a*b*a",
+        "*[!a]*", "*abcabcabcabcabcabc*", "*bca?abc*", "[a-b]*c", "*\\?*", "*b*c*a*",
+    };
+    const char alphabet[] = "abc?";
+    std::uint64_t state = 12345;
+    for (const char *pattern : s_patterns)
+    {
+        khmz::fxstring_glob_a compiled(pattern);
+        for (int i = 0; i < 2000; ++i)
+        {
+            std::string str;
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            const size_t len = (state >> 33) % 40;
+            for (size_t j = 0; j < len; ++j)
+            {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                str += alphabet[(state >> 40) % ((state >> 60) ? 3 : 4)];
+            }
+            const bool expected = fxstring_glob_reference(pattern, pattern + std::strlen(pattern),
+                                                          str.data(), str.data() + str.size());
+            assert(compiled.match(khmz::fxstring_view_a(str.data(), str.size())) == expected);
+        }
+    }
+
+    // Batches over arrays and columns
+    std::vector<khmz::fxstring_a<16>> rows;
+    khmz::fxstring_column<char, 16> column;
+    for (int i = 0; i < 150; ++i)
+    {
+        khmz::fxstring_a<16> row;
+        row.printf((i % 3) ? "node-%d.cfg" : "node-%d.log", i);
+        rows.push_back(row);
+        column.push_back(row);
+    }
+    std::uint64_t bitmap[3], column_bitmap[3];
+    khmz::fxstring_glob_a logs("node-?[05].log");
+    assert(logs.match(rows.data(), rows.size(), bitmap) == 6);
+    assert(logs.match(column, column_bitmap) == 6);
+    assert(std::equal(bitmap, bitmap + 3, column_bitmap));
+    assert(bitmap[0] == ((std::uint64_t(1) << 15) | (std::uint64_t(1) << 30) |
+                         (std::uint64_t(1) << 45) | (std::uint64_t(1) << 60)));
+    assert(bitmap[1] == ((std::uint64_t(1) << 11) | (std::uint64_t(1) << 26)) && bitmap[2] == 0);
+    khmz::fxstring_glob_a cfg("*.cfg");
+    assert(cfg.match(column, column_bitmap) == 100);
+}
+
+static void fxstring_regex_tests(void)
+{
+    khmz::fxstring_regex_a id("[A-Z]{2}-\\d{3,4}");
+    assert(id.valid());
+    assert(id.match("AB-123") && id.match("XY-0042") && !id.match("AB-12") && !id.match("ab-123"));
+    assert(!id.match("AB-12345") && !id.match(" AB-123"));
+
+    khmz::fxstring_view_a span;
+    assert(id.search("ticket=QA-9001;", span) && span == "QA-9001");
+    assert(!id.search("ticket=Q-9001;"));
+
+    // Leftmost, then longest
+    khmz::fxstring_regex_a alt("ab|abcd|b");
+    const char text[] = "xabcde";
+    assert(alt.search(text, span) && span == "abcd" && span.data() == text + 1);
+    khmz::fxstring_regex_a lazy("a*");
+    assert(lazy.search("baa", span) && span.empty());
+    assert(khmz::fxstring_regex_a("a+").search("baaab", span) && span == "aaa");
+
+    // Anchors, classes, escapes and groups
+    khmz::fxstring_regex_a anchored("^(?:\\w+\\.)+log$");
+    assert(anchored.match("app.server.log") && !anchored.match("app.log.1") && !anchored.match(".log"));
+    assert(anchored.search("app.log", span) && span == "app.log" && !anchored.search(" app.log"));
+    assert(khmz::fxstring_regex_a("o$").search("foo", span) && span.data() != nullptr && span == "o");
+    assert(!khmz::fxstring_regex_a("^o").search("foo") && khmz::fxstring_regex_a("^f|x$").search("fox"));
+
+    // Anchors are zero-width, so they may repeat and stack
+    assert(khmz::fxstring_regex_a("^^a").search("a") && khmz::fxstring_regex_a("a$$").search("a"));
+    assert(khmz::fxstring_regex_a("^a$$").match("a") && khmz::fxstring_regex_a("(^)^a").search("ab", span) && span == "a");
+    assert(khmz::fxstring_regex_a("^*a").search("ba", span) && span == "a" && !khmz::fxstring_regex_a("a^b").search("ab"));
+    assert(khmz::fxstring_regex_a("$^").match("") && !khmz::fxstring_regex_a("$^").search("a"));
+    assert(khmz::fxstring_regex_a("x(^|a)").search("xa", span) && span == "xa" && !khmz::fxstring_regex_a("b$a").search("ba"));
+    assert(khmz::fxstring_regex_a("[]a-c]+").match("]ab]") && khmz::fxstring_regex_a("[^\\d\\s]*").match("ab_!"));
+    assert(!khmz::fxstring_regex_a("[^\\d\\s]*").match("ab 1") && khmz::fxstring_regex_a("\\D\\S\\W").match("x-."));
+    assert(khmz::fxstring_regex_a("a\\.b\\*\\t").match("a.b*\t") && !khmz::fxstring_regex_a("a\\.b").match("axb"));
+    assert(khmz::fxstring_regex_a("x{2,}y{0,1}").match("xxxxy") && !khmz::fxstring_regex_a("x{2,}").match("x"));
+    assert(khmz::fxstring_regex_a("").match("") && khmz::fxstring_regex_a("(a|)+b").match("aab"));
+    assert(khmz::fxstring_regex_w(L"[Ā-ſ]+\\d").match(L"ŁĄ7") && !khmz::fxstring_regex_w(L"[Ā-ſ]+").match(L"LA"));
+    assert(khmz::fxstring_regex_w(L"é.é").match(L"été") && !khmz::fxstring_regex_w(L"é.é").match(L"ete"));
+
+    // On fxstrings
+    khmz::fxstring_a<32> field("2024-06-30T12:00");
+    khmz::fxstring_regex_a date("\\d{4}-\\d\\d-\\d\\d");
+    assert(date.search(field, span) && span == "2024-06-30");
+
+    // Syntax errors and state limits make an invalid regex, which matches nothing
+    static const char *const s_invalid[] = { "(a", "a)", "*a", "a{3", "a{4,2}", "a{256}", "[ab", "(?x)", "a\\" };
+    for (const char *pattern : s_invalid)
+    {
+        khmz::fxstring_regex_a bad(pattern);
+        assert(!bad.valid() && !bad.match(pattern) && !bad.search(pattern));
+    }
+    khmz::fxstring_regex_a big;
+    assert(!big.compile("(a|b)*a(a|b){12}", 256) && big.compile("(a|b)*a(a|b){12}", 1 << 15));
+
+    // Linear time where backtracking is exponential
+    std::string many_a(20000, 'a');
+    assert(!khmz::fxstring_regex_a("(a*)*b").search(khmz::fxstring_view_a(many_a.data(), many_a.size())));
+
+    // Against std::regex: whole matches, and the start of the leftmost match
+    static const char *const s_patterns[] =
+    {
+        "a*", "(a|b)*c", "a(b|c)+a", "^ab", "b$", "(ab|a)(bc|c)?", "[ab]{2,3}c?", "a?b?c?",
+        "(a|ab)(c|bcd)", "c(a*|b)c", "^(a|b)*$", "[^a]+", "(aa|b)*a{1,2}$", "((a|b)c)*", ".b.",
+        "^^a", "a$$", "(^|c)^a", "a($|b)$", "(^a|b)(c$|d)",
+    };
+    std::uint64_t state = 777;
+    for (const char *pattern : s_patterns)
+    {
+        khmz::fxstring_regex_a compiled(pattern);
+        const std::regex reference(pattern);
+        assert(compiled.valid());
+        for (int i = 0; i < 500; ++i)
+        {
+            std::string str;
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            const size_t len = (state >> 33) % 12;
+            for (size_t j = 0; j < len; ++j)
+            {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                str += "abcd"[(state >> 40) % 4];
+            }
+            const khmz::fxstring_view_a view(str.data(), str.size());
+            assert(compiled.match(view) == std::regex_match(str, reference));
+            std::smatch found;
+            const bool expected = std::regex_search(str, found, reference);
+            assert(compiled.search(view, span) == expected);
+            if (!expected)
+                continue;
+            assert(span.data() == str.data() + found.position(0) && span.size() >= size_t(found.length(0)));
+            assert(compiled.match(span));
+        }
+    }
+}
+
+// The O(m * n) table
+static size_t fxstring_distance_reference(const std::string& a, const std::string& b)
+{
+    std::vector<size_t> row(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); ++j)
+        row[j] = j;
+    for (size_t i = 1; i <= a.size(); ++i)
+    {
+        size_t diagonal = row[0];
+        row[0] = i;
+        for (size_t j = 1; j <= b.size(); ++j)
+        {
+            const size_t above = row[j];
+            row[j] = std::min(std::min(row[j] + 1, row[j - 1] + 1), diagonal + (a[i - 1] != b[j - 1]));
+            diagonal = above;
+        }
+    }
+    return row[b.size()];
+}
+
+template <size_t t_buf_size>
+static void fxstring_distance_random_tests(std::uint64_t& state, size_t max_len)
+{
+    for (int i = 0; i < 400; ++i)
+    {
+        std::string a, b;
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        const size_t len_a = (state >> 33) % (max_len + 1), len_b = (state >> 45) % (max_len + 1);
+        for (size_t j = 0; j < len_a + len_b; ++j)
+        {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            (j < len_a ? a : b) += "abcd"[(state >> 40) % 4];
+        }
+        if (i % 4 == 0)     // Near-duplicates
+        {
+            b = a;
+            if (!b.empty())
+                b[(state >> 20) % b.size()] = 'x';
+            b.insert(0, "y");
+        }
+        const khmz::fxstring_a<t_buf_size> query(a);
+        const khmz::fxstring_distance_a<t_buf_size> prepared(query);
+        const khmz::fxstring_view_a text(b.data(), b.size());
+        const size_t expected = fxstring_distance_reference(query.c_str(), b);
+        assert(prepared.distance(text) == expected && khmz::edit_distance(query, text) == expected);
+        for (size_t k = 0; k < expected + 2; ++k)
+        {
+            size_t distance = 0;
+            assert(prepared.within(text, k, distance) == (expected <= k));
+            assert(expected > k || distance == expected);
+        }
+    }
+}
+
+static void fxstring_distance_tests(void)
+{
+    const khmz::fxstring_a<64> kitten("kitten");
+    assert(khmz::edit_distance(kitten, "sitting") == 3 && khmz::edit_distance(kitten, "") == 6);
+    assert(khmz::edit_distance(khmz::fxstring_a<64>(), "abc") == 3 && khmz::edit_distance(kitten, "kitten") == 0);
+    assert(khmz::edit_distance_within(kitten, "sitting", 3) && !khmz::edit_distance_within(kitten, "sitting", 2));
+    assert(!khmz::edit_distance_within(kitten, "kitten and a long tail", 5));
+    assert(khmz::edit_distance(khmz::fxstring_w<16>(L"Łódź"), L"Lodz") == 3);
+    assert(khmz::edit_distance(khmz::fxstring_w<16>(L"Łódź"), L"Łodź") == 1);
+
+    static_assert(khmz::fxstring_distance_a<65>::s_words == 1, "one word");
+    static_assert(khmz::fxstring_distance_a<66>::s_words == 2, "two words");
+    static_assert(khmz::fxstring_distance_a<1>::s_words == 1, "one word");
+
+    // Single words, and blocks across words
+    std::uint64_t state = 4242;
+    fxstring_distance_random_tests<16>(state, 20);
+    fxstring_distance_random_tests<65>(state, 70);
+    fxstring_distance_random_tests<200>(state, 210);
+    std::string long_a(150, 'a'), long_b(150, 'a');
+    long_b[0] = long_b[64] = long_b[128] = 'b';
+    assert(khmz::edit_distance(khmz::fxstring_a<256>(long_a), long_b.c_str()) == 3);
+
+    // Batches over columns
+    khmz::fxstring_column<char, 64> column;
+    static const char *const s_names[] =
+    {
+        "johnson", "jonson", "johnston", "jensen", "johnsen", "smith", "", "johnsonville", "jhonson",
+    };
+    for (int i = 0; i < 30; ++i)
+        for (const char *name : s_names)
+            column.push_back(name);
+    const khmz::fxstring_distance_a<64> query(khmz::fxstring_a<64>("johnson"));
+    std::vector<std::uint64_t> bitmap(column.bitmap_size());
+    assert(query.within(column, 1, bitmap.data()) == 4 * 30);
+    for (size_t i = 0; i < column.size(); ++i)
+    {
+        const bool bit = (bitmap[i / 64] >> (i % 64)) & 1;
+        assert(bit == (fxstring_distance_reference("johnson", std::string(column[i].data(), column[i].size())) <= 1));
+    }
+    std::vector<std::uint32_t> distances(column.size());
+    query.distance(column, distances.data());
+    assert(distances[0] == 0 && distances[1] == 1 && distances[3] == 3 && distances[6] == 7 && distances[7] == 5);
+    assert(distances[9] == 0);
 }
 
 static void fxstring_unittest(void)
@@ -816,6 +2889,29 @@ static void fxstring_unittest(void)
     fxstring_erase_tests();
     fxstring_iterator_tests();
     fxstring_replacing_tests();
+    fxstring_utf_tests();
+    fxstring_utf8_validation_tests();
+    fxstring_codec_tests();
+    fxstring_view_tests();
+    fxstring_column_tests();
+    fxstring_batch_tests();
+    fxstring_file_tests();
+    fxstring_serial_tests();
+    fxstring_reader_tests();
+    fxstring_csv_tests();
+    fxstring_split_tests();
+    fxstring_queue_tests();
+    fxstring_logger_tests();
+    fxstring_atomic_tests();
+    fxstring_concat_tests();
+    fxstring_builder_tests();
+    fxstring_hybrid_tests();
+    fxstring_arena_tests();
+    fxstring_ref_tests();
+    fxstring_stats_tests();
+    fxstring_glob_tests();
+    fxstring_regex_tests();
+    fxstring_distance_tests();
 }
 
 int main(void)
@@ -0,0 +1,497 @@
+// fxstring_utf.h --- UTF-8/UTF-16/UTF-32 transcoding and validation for fxstring
+// License: MIT
+
+#pragma once
+
+#include "fxstring.h"
+#include <cstdint>          // For std::uint16_t, std::uint32_t
+
+namespace khmz
+{
+    //
+    // The result of transcoding
+    //
+    struct transcode_result
+    {
+        size_t read;        // The number of source code units consumed
+        size_t written;     // The number of destination code units written
+    };
+
+    namespace detail
+    {
+        // The encoding is chosen by the width of the code unit:
+        // 1 byte is UTF-8, 2 bytes is UTF-16 and 4 bytes is UTF-32.
+        // wchar_t is UTF-16 on Windows and UTF-32 on Linux.
+        template <size_t t_width>
+        using _utf_width = std::integral_constant<size_t, t_width>;
+
+        template <typename T_CHAR>
+        using _utf_width_of = _utf_width<sizeof(T_CHAR)>;
+
+        static const char32_t _utf_replacement = 0xFFFD;
+
+        inline std::uint32_t _utf_unit(char ch)     { return static_cast<unsigned char>(ch); }
+        inline std::uint32_t _utf_unit(char16_t ch) { return ch; }
+        inline std::uint32_t _utf_unit(char32_t ch) { return ch; }
+        inline std::uint32_t _utf_unit(wchar_t ch)
+        {
+            return (sizeof(wchar_t) == 2) ? static_cast<std::uint16_t>(ch)
+                                          : static_cast<std::uint32_t>(ch);
+        }
+
+        inline bool _utf_is_scalar(char32_t cp)
+        {
+            return cp <= 0x10FFFF && !(0xD800 <= cp && cp <= 0xDFFF);
+        }
+
+        //
+        // Decoding one code point. An invalid sequence becomes U+FFFD.
+        //
+        template <typename T_CHAR>
+        inline char32_t _utf_decode(const T_CHAR *src, size_t len, size_t& i, _utf_width<1>)
+        {
+            const std::uint32_t c0 = _utf_unit(src[i]);
+            if (c0 < 0x80)
+            {
+                ++i;
+                return c0;
+            }
+
+            size_t count;
+            char32_t cp, cp_min;
+            if ((c0 & 0xE0) == 0xC0)
+            {
+                count = 1; cp = c0 & 0x1F; cp_min = 0x80;
+            }
+            else if ((c0 & 0xF0) == 0xE0)
+            {
+                count = 2; cp = c0 & 0x0F; cp_min = 0x800;
+            }
+            else if ((c0 & 0xF8) == 0xF0)
+            {
+                count = 3; cp = c0 & 0x07; cp_min = 0x10000;
+            }
+            else
+            {
+                ++i;
+                return _utf_replacement;
+            }
+
+            size_t k;
+            for (k = 1; k <= count && i + k < len; ++k)
+            {
+                const std::uint32_t c = _utf_unit(src[i + k]);
+                if ((c & 0xC0) != 0x80)
+                    break;
+                cp = (cp << 6) | (c & 0x3F);
+            }
+            if (k <= count)
+            {
+                i += k;
+                return _utf_replacement;
+            }
+
+            i += count + 1;
+            if (cp < cp_min || !_utf_is_scalar(cp))
+                return _utf_replacement;
+            return cp;
+        }
+        template <typename T_CHAR>
+        inline char32_t _utf_decode(const T_CHAR *src, size_t len, size_t& i, _utf_width<2>)
+        {
+            const char32_t c0 = _utf_unit(src[i++]);
+            if (c0 < 0xD800 || 0xDFFF < c0)
+                return c0;
+            if (c0 < 0xDC00 && i < len)
+            {
+                const char32_t c1 = _utf_unit(src[i]);
+                if (0xDC00 <= c1 && c1 <= 0xDFFF)
+                {
+                    ++i;
+                    return 0x10000 + ((c0 - 0xD800) << 10) + (c1 - 0xDC00);
+                }
+            }
+            return _utf_replacement;
+        }
+        template <typename T_CHAR>
+        inline char32_t _utf_decode(const T_CHAR *src, size_t, size_t& i, _utf_width<4>)
+        {
+            const char32_t cp = _utf_unit(src[i++]);
+            return _utf_is_scalar(cp) ? cp : _utf_replacement;
+        }
+
+        //
+        // Encoding one code point. Returns zero if it doesn't fit in room.
+        //
+        template <typename T_CHAR>
+        inline size_t _utf_encode(char32_t cp, T_CHAR *dest, size_t room, _utf_width<1>)
+        {
+            if (cp < 0x80)
+            {
+                if (room < 1)
+                    return 0;
+                dest[0] = static_cast<T_CHAR>(cp);
+                return 1;
+            }
+            if (cp < 0x800)
+            {
+                if (room < 2)
+                    return 0;
+                dest[0] = static_cast<T_CHAR>(0xC0 | (cp >> 6));
+                dest[1] = static_cast<T_CHAR>(0x80 | (cp & 0x3F));
+                return 2;
+            }
+            if (cp < 0x10000)
+            {
+                if (room < 3)
+                    return 0;
+                dest[0] = static_cast<T_CHAR>(0xE0 | (cp >> 12));
+                dest[1] = static_cast<T_CHAR>(0x80 | ((cp >> 6) & 0x3F));
+                dest[2] = static_cast<T_CHAR>(0x80 | (cp & 0x3F));
+                return 3;
+            }
+            if (room < 4)
+                return 0;
+            dest[0] = static_cast<T_CHAR>(0xF0 | (cp >> 18));
+            dest[1] = static_cast<T_CHAR>(0x80 | ((cp >> 12) & 0x3F));
+            dest[2] = static_cast<T_CHAR>(0x80 | ((cp >> 6) & 0x3F));
+            dest[3] = static_cast<T_CHAR>(0x80 | (cp & 0x3F));
+            return 4;
+        }
+        template <typename T_CHAR>
+        inline size_t _utf_encode(char32_t cp, T_CHAR *dest, size_t room, _utf_width<2>)
+        {
+            if (cp < 0x10000)
+            {
+                if (room < 1)
+                    return 0;
+                dest[0] = static_cast<T_CHAR>(cp);
+                return 1;
+            }
+            if (room < 2)
+                return 0;
+            cp -= 0x10000;
+            dest[0] = static_cast<T_CHAR>(0xD800 + (cp >> 10));
+            dest[1] = static_cast<T_CHAR>(0xDC00 + (cp & 0x3FF));
+            return 2;
+        }
+        template <typename T_CHAR>
+        inline size_t _utf_encode(char32_t cp, T_CHAR *dest, size_t room, _utf_width<4>)
+        {
+            if (room < 1)
+                return 0;
+            dest[0] = static_cast<T_CHAR>(cp);
+            return 1;
+        }
+
+        //
+        // ASCII fast path: copies the leading ASCII run of src into dest and
+        // returns its length. At most count code units are examined.
+        //
+        template <typename T_DEST, typename T_SRC, typename T_DEST_WIDTH, typename T_SRC_WIDTH>
+        inline size_t _utf_ascii_copy(T_DEST *dest, const T_SRC *src, size_t count,
+                                      T_DEST_WIDTH, T_SRC_WIDTH)
+        {
+            size_t n;
+            for (n = 0; n < count && _utf_unit(src[n]) < 0x80; ++n)
+                dest[n] = static_cast<T_DEST>(src[n]);
+            return n;
+        }
+
+#ifdef FXSTRING_SSE2
+        // UTF-8 to UTF-8
+        template <typename T_DEST, typename T_SRC>
+        inline size_t _utf_ascii_copy(T_DEST *dest, const T_SRC *src, size_t count,
+                                      _utf_width<1>, _utf_width<1>)
+        {
+            size_t n = 0;
+            for (; n + 16 <= count; n += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + n));
+                if (_mm_movemask_epi8(v))
+                    break;
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + n), v);
+            }
+            return n + _utf_ascii_copy(dest + n, src + n, count - n, _utf_width<0>(), _utf_width<0>());
+        }
+        // UTF-8 to UTF-16
+        template <typename T_DEST, typename T_SRC>
+        inline size_t _utf_ascii_copy(T_DEST *dest, const T_SRC *src, size_t count,
+                                      _utf_width<2>, _utf_width<1>)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            size_t n = 0;
+            for (; n + 16 <= count; n += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + n));
+                if (_mm_movemask_epi8(v))
+                    break;
+                __m128i *p = reinterpret_cast<__m128i *>(dest + n);
+                _mm_storeu_si128(p + 0, _mm_unpacklo_epi8(v, zero));
+                _mm_storeu_si128(p + 1, _mm_unpackhi_epi8(v, zero));
+            }
+            return n + _utf_ascii_copy(dest + n, src + n, count - n, _utf_width<0>(), _utf_width<0>());
+        }
+        // UTF-8 to UTF-32
+        template <typename T_DEST, typename T_SRC>
+        inline size_t _utf_ascii_copy(T_DEST *dest, const T_SRC *src, size_t count,
+                                      _utf_width<4>, _utf_width<1>)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            size_t n = 0;
+            for (; n + 16 <= count; n += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + n));
+                if (_mm_movemask_epi8(v))
+                    break;
+                __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+                __m128i *p = reinterpret_cast<__m128i *>(dest + n);
+                _mm_storeu_si128(p + 0, _mm_unpacklo_epi16(lo, zero));
+                _mm_storeu_si128(p + 1, _mm_unpackhi_epi16(lo, zero));
+                _mm_storeu_si128(p + 2, _mm_unpacklo_epi16(hi, zero));
+                _mm_storeu_si128(p + 3, _mm_unpackhi_epi16(hi, zero));
+            }
+            return n + _utf_ascii_copy(dest + n, src + n, count - n, _utf_width<0>(), _utf_width<0>());
+        }
+        // UTF-16 to UTF-8
+        template <typename T_DEST, typename T_SRC>
+        inline size_t _utf_ascii_copy(T_DEST *dest, const T_SRC *src, size_t count,
+                                      _utf_width<1>, _utf_width<2>)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i mask = _mm_set1_epi16(static_cast<short>(0xFF80));
+            size_t n = 0;
+            for (; n + 16 <= count; n += 16)
+            {
+                const __m128i *p = reinterpret_cast<const __m128i *>(src + n);
+                __m128i a = _mm_loadu_si128(p + 0), b = _mm_loadu_si128(p + 1);
+                __m128i high = _mm_and_si128(_mm_or_si128(a, b), mask);
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(high, zero)) != 0xFFFF)
+                    break;
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + n), _mm_packus_epi16(a, b));
+            }
+            return n + _utf_ascii_copy(dest + n, src + n, count - n, _utf_width<0>(), _utf_width<0>());
+        }
+        // UTF-32 to UTF-8
+        template <typename T_DEST, typename T_SRC>
+        inline size_t _utf_ascii_copy(T_DEST *dest, const T_SRC *src, size_t count,
+                                      _utf_width<1>, _utf_width<4>)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i mask = _mm_set1_epi32(static_cast<int>(0xFFFFFF80));
+            size_t n = 0;
+            for (; n + 16 <= count; n += 16)
+            {
+                const __m128i *p = reinterpret_cast<const __m128i *>(src + n);
+                __m128i a = _mm_loadu_si128(p + 0), b = _mm_loadu_si128(p + 1);
+                __m128i c = _mm_loadu_si128(p + 2), d = _mm_loadu_si128(p + 3);
+                __m128i high = _mm_and_si128(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)), mask);
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(high, zero)) != 0xFFFF)
+                    break;
+                __m128i ab = _mm_packs_epi32(a, b), cd = _mm_packs_epi32(c, d);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + n), _mm_packus_epi16(ab, cd));
+            }
+            return n + _utf_ascii_copy(dest + n, src + n, count - n, _utf_width<0>(), _utf_width<0>());
+        }
+#endif  // def FXSTRING_SSE2
+
+        // The length of the leading ASCII run of str
+        inline size_t _ascii_prefix(const char *str, size_t len)
+        {
+            size_t n = 0;
+#ifdef FXSTRING_SSE2
+            for (; n + 16 <= len; n += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(str + n));
+                if (_mm_movemask_epi8(v))
+                    break;
+            }
+#endif
+            while (n < len && _utf_unit(str[n]) < 0x80)
+                ++n;
+            return n;
+        }
+
+        //
+        // UTF-8 lead byte classes and the allowed range of the second byte
+        // (The Unicode Standard, Table 3-7)
+        //
+        struct _utf8_rule
+        {
+            unsigned char length, lo, hi;
+        };
+        static const _utf8_rule _utf8_rules[9] =
+        {
+            { 0, 0x00, 0x00 },  // 0: invalid lead byte
+            { 1, 0x00, 0x00 },  // 1: 00..7F
+            { 2, 0x80, 0xBF },  // 2: C2..DF
+            { 3, 0x80, 0xBF },  // 3: E1..EC, EE..EF
+            { 3, 0xA0, 0xBF },  // 4: E0
+            { 3, 0x80, 0x9F },  // 5: ED
+            { 4, 0x80, 0xBF },  // 6: F1..F3
+            { 4, 0x90, 0xBF },  // 7: F0
+            { 4, 0x80, 0x8F },  // 8: F4
+        };
+        static const unsigned char _utf8_classes[256] =
+        {
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 00..0F
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 10..1F
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 20..2F
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 30..3F
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 40..4F
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 50..5F
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 60..6F
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 70..7F
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 80..8F
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 90..9F
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // A0..AF
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // B0..BF
+            0, 0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, // C0..CF
+            2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, // D0..DF
+            4, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 5, 3, 3, // E0..EF
+            7, 6, 6, 6, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // F0..FF
+        };
+
+        // Without vector_ascii, ASCII runs are scanned a byte at a time, as
+        // for buffers too small to hold a 16-byte run
+        inline size_t _utf8_validate(const char *str, size_t len, bool vector_ascii)
+        {
+            size_t i = 0;
+            while (i < len)
+            {
+                if (_utf_unit(str[i]) < 0x80)
+                {
+                    i += vector_ascii ? _ascii_prefix(&str[i], len - i) : 1;
+                    continue;
+                }
+
+                const _utf8_rule& rule = _utf8_rules[_utf8_classes[_utf_unit(str[i])]];
+                if (!rule.length || rule.length > len - i)
+                    break;
+                const std::uint32_t c1 = _utf_unit(str[i + 1]);
+                if (c1 < rule.lo || rule.hi < c1)
+                    break;
+                size_t k;
+                for (k = 2; k < rule.length; ++k)
+                {
+                    if ((_utf_unit(str[i + k]) & 0xC0) != 0x80)
+                        break;
+                }
+                if (k < rule.length)
+                    break;
+                i += rule.length;
+            }
+            return i;
+        }
+    } // namespace detail
+
+    //
+    // UTF-8 validation. Returns the length of the longest valid prefix,
+    // which equals len if and only if str is valid UTF-8.
+    //
+    inline size_t utf8_validate(const char *str, size_t len)
+    {
+        return detail::_utf8_validate(str, len, true);
+    }
+    inline bool is_valid_utf8(const char *str, size_t len)
+    {
+        return utf8_validate(str, len) == len;
+    }
+    inline bool is_valid_utf8(const char *str)
+    {
+        return is_valid_utf8(str, std::char_traits<char>::length(str));
+    }
+    template <size_t t_buf_size>
+    inline bool is_valid_utf8(const fxstring<char, t_buf_size>& str)
+    {
+        const size_t len = str.size();
+        return detail::_utf8_validate(str.data(), len, t_buf_size > 16) == len;
+    }
+
+    //
+    // ASCII check
+    //
+    inline bool is_ascii(const char *str, size_t len)
+    {
+        return detail::_ascii_prefix(str, len) == len;
+    }
+    template <typename T_CHAR>
+    inline bool is_ascii(const T_CHAR *str, size_t len)
+    {
+        std::uint32_t bits = 0;
+        for (size_t i = 0; i < len; ++i)
+            bits |= detail::_utf_unit(str[i]);
+        return bits < 0x80;
+    }
+    template <typename T_CHAR, size_t t_buf_size>
+    inline bool is_ascii(const fxstring<T_CHAR, t_buf_size>& str)
+    {
+        return is_ascii(str.data(), str.size());
+    }
+
+    //
+    // Transcoding between UTF-8, UTF-16 and UTF-32 code unit arrays.
+    // Invalid input is replaced with U+FFFD. Writing stops before the first
+    // code point that doesn't fit in dest_size, so a code point is never split.
+    //
+    template <typename T_DEST, typename T_SRC>
+    inline transcode_result
+    transcode(T_DEST *dest, size_t dest_size, const T_SRC *src, size_t src_len)
+    {
+        using dest_width = detail::_utf_width_of<T_DEST>;
+        using src_width = detail::_utf_width_of<T_SRC>;
+        size_t i = 0, j = 0;
+        while (i < src_len)
+        {
+            const size_t count = khmz::detail::_min(src_len - i, dest_size - j);
+            if (count && detail::_utf_unit(src[i]) < 0x80)
+            {
+                const size_t n = detail::_utf_ascii_copy(&dest[j], &src[i], count,
+                                                         dest_width(), src_width());
+                i += n;
+                j += n;
+                continue;
+            }
+
+            size_t next = i;
+            const char32_t cp = detail::_utf_decode(src, src_len, next, src_width());
+            const size_t n = detail::_utf_encode(cp, &dest[j], dest_size - j, dest_width());
+            if (!n)
+                break;
+            i = next;
+            j += n;
+        }
+        transcode_result ret = { i, j };
+        return ret;
+    }
+
+    //
+    // Transcoding into fxstring
+    //
+    template <typename T_DEST, size_t t_dest_size, typename T_SRC>
+    inline transcode_result
+    transcode(fxstring<T_DEST, t_dest_size>& dest, const T_SRC *src, size_t src_len)
+    {
+        transcode_result ret = transcode(dest.data(), dest.max_size(), src, src_len);
+        dest[ret.written] = 0;
+        return ret;
+    }
+    template <typename T_DEST, size_t t_dest_size, typename T_SRC>
+    inline transcode_result
+    transcode(fxstring<T_DEST, t_dest_size>& dest, const T_SRC *src)
+    {
+        return transcode(dest, src, std::char_traits<T_SRC>::length(src));
+    }
+    template <typename T_DEST, size_t t_dest_size, typename T_SRC, size_t t_src_size>
+    inline transcode_result
+    transcode(fxstring<T_DEST, t_dest_size>& dest, const fxstring<T_SRC, t_src_size>& src)
+    {
+        return transcode(dest, src.data(), src.size());
+    }
+    template <typename T_DEST, size_t t_dest_size, typename T_SRC>
+    inline transcode_result
+    transcode(fxstring<T_DEST, t_dest_size>& dest, const std::basic_string<T_SRC>& src)
+    {
+        return transcode(dest, src.data(), src.size());
+    }
+} // namespace khmz